@@ -1,11 +1,13 @@
 #include <iostream>
 #include <chrono>
 #include <mapbox/vector_tile.hpp>
-#include <fstream>
+#include <mapbox/vector_tile/mapped_file.hpp>
+#include <mapbox/vector_tile/decompress.hpp>
+#include <mapbox/vector_tile/layer_index.hpp>
 
 std::size_t feature_count = 0;
 
-static void decode_entire_tile(std::string const& buffer) {
+static void decode_entire_tile(protozero::data_view const& buffer) {
     mapbox::vector_tile::buffer tile(buffer);
     for (auto const& name : tile.layerNames()) {
         const mapbox::vector_tile::layer layer = tile.getLayer(name);
@@ -17,7 +19,7 @@ static void decode_entire_tile(std::string const& buffer) {
         for (std::size_t i=0;i<num_features;++i) {
             auto const feature = mapbox::vector_tile::feature(layer.getFeature(i),layer);
             auto const& feature_id = feature.getID();
-            if (feature_id.is<mapbox::feature::null_value_t>()) {
+            if (std::holds_alternative<mapbox::feature::null_value_t>(feature_id)) {
                 throw std::runtime_error("Hit unexpected error decoding feature");
             }
             auto props = feature.getProperties();
@@ -27,32 +29,68 @@ static void decode_entire_tile(std::string const& buffer) {
     }
 }
 
-static void run_bench(std::vector<std::string> const& tiles, std::size_t iterations) {
+static void run_bench(std::vector<mapbox::vector_tile::mapped_file> const& tiles, std::size_t iterations) {
 
     for (std::size_t i=0;i<iterations;++i) {
         for (auto const& tile: tiles) {
-            decode_entire_tile(tile);
+            decode_entire_tile(tile.view());
         }
     }
 }
 
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+static std::string gzip_tile(protozero::data_view const& data) {
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    std::string output(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+static void run_compressed_bench(std::vector<std::string> const& tiles, std::size_t iterations) {
+    mapbox::vector_tile::buffer_pool pool;
+    mapbox::vector_tile::tile_decompressor decompressor(pool);
+    for (std::size_t i=0;i<iterations;++i) {
+        for (auto const& tile: tiles) {
+            decode_entire_tile(decompressor.decompress(protozero::data_view(tile)).view());
+        }
+    }
+}
+#endif
+
+// open a single layer of every tile, as a renderer needing few layers does
+static std::size_t open_first_layers(std::vector<mapbox::vector_tile::mapped_file> const& tiles,
+                                     std::vector<mapbox::vector_tile::tile_index> const* indexes, std::size_t iterations) {
+    std::size_t count = 0;
+    for (std::size_t i=0;i<iterations;++i) {
+        for (std::size_t t=0;t<tiles.size();++t) {
+            mapbox::vector_tile::buffer tile = indexes ? mapbox::vector_tile::buffer(tiles[t].view(), (*indexes)[t])
+                                                       : mapbox::vector_tile::buffer(tiles[t].view());
+            auto const names = tile.layerNames();
+            if (!names.empty()) {
+                count += tile.getLayer(names.front()).featureCount();
+            }
+        }
+    }
+    return count;
+}
+
 template <typename T>
 using milliseconds = std::chrono::duration<T, std::milli>;
 
 int main(/*int argc, char* const argv[]*/) {
     try {
-        std::vector<std::string> tiles;
+        std::vector<mapbox::vector_tile::mapped_file> tiles;
         for (std::size_t x=4680;x<=4693;++x) {
             for (std::size_t y=6260;y<=6274;++y) {
                 std::string path = "bench/mvt-bench-fixtures/fixtures/14-" + std::to_string(x) + "-" + std::to_string(y) + ".mvt";
-                std::ifstream stream(path.c_str(),std::ios_base::in|std::ios_base::binary);
-                if (!stream.is_open())
-                {
-                    throw std::runtime_error("could not open: '" + path + "'");
-                }
-                std::string message(std::istreambuf_iterator<char>(stream.rdbuf()),(std::istreambuf_iterator<char>()));
-                stream.close();
-                tiles.emplace_back(message);
+                tiles.emplace_back(path, mapbox::vector_tile::mapped_file::WILLNEED);
             }
         }
         std::clog << "decoding " << tiles.size() << " tiles\n";
@@ -69,6 +107,35 @@ int main(/*int argc, char* const argv[]*/) {
             std::clog << "Warning expected feature_count of 8157770, was: " << feature_count << "\n";
         }
         std::clog << "elapsed: " << std::fixed << elapsed << " ms\n";
+        std::vector<mapbox::vector_tile::tile_index> indexes;
+        for (auto const& tile: tiles) {
+            indexes.push_back(mapbox::vector_tile::tile_index::parse(mapbox::vector_tile::tile_index::build(tile.view()).serialize()));
+        }
+        std::clog << "running single layer open bench, scanning vs indexed...\n";
+        t1 = std::chrono::high_resolution_clock::now();
+        const std::size_t scanned = open_first_layers(tiles,nullptr,100);
+        t2 = std::chrono::high_resolution_clock::now();
+        std::clog << "elapsed: " << std::fixed << milliseconds<double>(t2 - t1).count() << " ms\n";
+        t1 = std::chrono::high_resolution_clock::now();
+        const std::size_t indexed = open_first_layers(tiles,&indexes,100);
+        t2 = std::chrono::high_resolution_clock::now();
+        std::clog << "elapsed: " << std::fixed << milliseconds<double>(t2 - t1).count() << " ms\n";
+        if (scanned != indexed) {
+            std::clog << "Warning indexed tiles gave " << indexed << " features, scanned " << scanned << "\n";
+        }
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+        // the same tiles gzip compressed, as served over http or from archives
+        std::vector<std::string> compressed;
+        for (auto const& tile: tiles) {
+            compressed.push_back(gzip_tile(tile.view()));
+        }
+        std::clog << "running decompress + decode bench...\n";
+        run_compressed_bench(compressed,1);
+        t1 = std::chrono::high_resolution_clock::now();
+        run_compressed_bench(compressed,100);
+        t2 = std::chrono::high_resolution_clock::now();
+        std::clog << "elapsed: " << std::fixed << milliseconds<double>(t2 - t1).count() << " ms\n";
+#endif
     } catch (std::exception const& ex) {
         std::cerr << ex.what() << "\n";
         return -1;
@@ -1,19 +1,8 @@
 #include <mapbox/vector_tile.hpp>
-#include <fstream>
+#include <mapbox/vector_tile/mapped_file.hpp>
 #include <stdexcept>
 #include <iostream>
 
-std::string open_tile(std::string const& path) {
-    std::ifstream stream(path.c_str(),std::ios_base::in|std::ios_base::binary);
-    if (!stream.is_open())
-    {
-        throw std::runtime_error("could not open: '" + path + "'");
-    }
-    std::string message(std::istreambuf_iterator<char>(stream.rdbuf()),(std::istreambuf_iterator<char>()));
-    stream.close();
-    return message;
-}
-
 class print_value {
 
 public:
@@ -58,8 +47,8 @@ int main(int argc, char** argv) {
             return -1;
         }
         std::string tile_path(argv[1]);
-        std::string buffer = open_tile(tile_path);
-        mapbox::vector_tile::buffer tile(buffer);
+        mapbox::vector_tile::mapped_file file(tile_path);
+        mapbox::vector_tile::buffer tile(file.view());
         std::cout << "Decoding tile: " << tile_path << "\n";
         for (auto const& name : tile.layerNames()) {
             const mapbox::vector_tile::layer layer = tile.getLayer(name);
@@ -73,8 +62,8 @@ int main(int argc, char** argv) {
             for (std::size_t i=0;i<feature_count;++i) {
                 auto const feature = mapbox::vector_tile::feature(layer.getFeature(i),layer);
                 auto const& feature_id = feature.getID();
-                if (feature_id.is<uint64_t>()) {
-                    std::cout << "    id: " << feature_id.get<uint64_t>() << "\n";
+                if (std::holds_alternative<uint64_t>(feature_id)) {
+                    std::cout << "    id: " << std::get<uint64_t>(feature_id) << "\n";
                 } else {
                     std::cout << "    id: (no id set)\n";
                 }
@@ -83,7 +72,7 @@ int main(int argc, char** argv) {
                 std::cout << "    Properties:\n";
                 for (auto const& prop : props) {
                     print_value printvisitor;
-                    std::string value = mapbox::util::apply_visitor(printvisitor, prop.second);
+                    std::string value = std::visit(printvisitor, static_cast<mapbox::feature::value_base const&>(prop.second));
                     std::cout << "      " << prop.first  << ": " << value << "\n";
                 }
                 std::cout << "    Vertices:\n";
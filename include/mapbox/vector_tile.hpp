@@ -5,12 +5,18 @@
 #include <mapbox/feature.hpp>
 #include <protozero/pbf_reader.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdint>
 #include <map>
 #include <functional> // reference_wrapper
+#include <limits>
 #include <string>
+#include <string_view>
 #include <stdexcept>
+#include <unordered_set>
+#include <vector>
 
 namespace mapbox { namespace vector_tile {
 
@@ -31,6 +37,7 @@ public:
 };
 
 class layer;
+class key_set;
 
 class feature {
 public:
@@ -57,14 +64,68 @@ public:
      *       and cleaned up after use.
      */
     mapbox::feature::value getValue(std::string const&, std::string* warning = nullptr) const;
+    /**
+     * Look up several keys in a single pass over the feature tags.
+     *
+     * @param keys    The keys to look up, compiled for the feature's layer.
+     * @param values  Resized to `keys.size()`; receives the value of each key
+     *                in the order the keys were given, or a null value if the
+     *                feature does not have the key.
+     * @param warning Set as in getValue if a found key is duplicated in the
+     *                layer's key table.
+     */
+    void getValues(key_set const& keys, std::vector<mapbox::feature::value>& values, std::string* warning = nullptr) const;
+    /**
+     * Same as above but returns the unparsed value messages, with an empty
+     * view for keys the feature does not have.
+     */
+    void getValues(key_set const& keys, std::vector<protozero::data_view>& values, std::string* warning = nullptr) const;
     properties_type getProperties() const;
     mapbox::feature::identifier const& getID() const;
     std::uint32_t getExtent() const;
     std::uint32_t getVersion() const;
     template <typename GeometryCollectionType>
     GeometryCollectionType getGeometries(float scale) const;
+    /**
+     * Walk the geometry command stream in tile coordinates without building
+     * any point arrays.
+     *
+     * @param visitor Object providing `moveTo(x, y)`, `lineTo(x, y)` and
+     *                `closePath()`, called with `std::int64_t` coordinates in
+     *                the order the commands appear in the stream.
+     */
+    template <typename Visitor>
+    void walkGeometry(Visitor&& visitor) const;
+    /**
+     * Compute the bounding box of the feature geometry in tile coordinates.
+     * Returns an inverted box (min > max) for an empty geometry.
+     */
+    mapbox::geometry::box<std::int64_t> getBoundingBox() const;
+    /**
+     * Test whether a point in tile coordinates lies inside a polygon feature,
+     * using the even-odd crossing rule over all rings, in one walk of the
+     * geometry. Always false for point and line features.
+     */
+    bool contains(mapbox::geometry::point<double> const& point) const;
+    /**
+     * As contains(point), but first rejects points outside bbox, a bounding
+     * box of the feature computed earlier, without decoding the geometry.
+     */
+    bool contains(mapbox::geometry::point<double> const& point, mapbox::geometry::box<std::int64_t> const& bbox) const;
+    /**
+     * Distance in tile units from a point in tile coordinates to the feature:
+     * to the nearest vertex for points, the nearest segment for lines and the
+     * nearest ring edge for polygons, or 0 if a polygon contains the point.
+     * Returns infinity for an empty geometry.
+     */
+    double distanceTo(mapbox::geometry::point<double> const& point) const;
 
 private:
+    friend class layer;
+
+    template <typename Callback>
+    void findValues(key_set const& keys, std::string* warning, Callback&& callback) const;
+
     const layer& layer_;
     mapbox::feature::identifier id;
     GeomType type = GeomType::UNKNOWN;
@@ -72,18 +133,82 @@ private:
     packed_iterator_type geometry_iter;
 };
 
+struct key_statistics {
+    std::string key;
+    // Bit `1 << ValueType` is set for every value type observed for the key.
+    std::uint32_t valueTypes = 0;
+    std::size_t distinctValues = 0;
+    std::size_t featureCount = 0;
+    // Fraction of the layer's features carrying the key.
+    double coverage = 0.0;
+    // Range of the numeric values, min > max if there are none.
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+};
+
+struct layer_statistics {
+    std::size_t featureCount = 0;
+    // Indexed by GeomType.
+    std::array<std::size_t, 4> geometryCounts{};
+    // Number of encoded vertices, implicit ring closing points excluded.
+    std::size_t vertexCount = 0;
+    // One entry per distinct key name, in key table order.
+    std::vector<key_statistics> keys;
+};
+
+/**
+ * Where a layer lies within its tile, as recorded by a tile_index. With
+ * tables the feature, key and value submessages are listed as well, as
+ * offset and length pairs relative to the start of the layer.
+ */
+struct layer_index_entry {
+    std::string name;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+    std::uint32_t version = 1;
+    std::uint32_t extent = 4096;
+    std::uint32_t featureCount = 0;
+    bool hasTables = false;
+    std::vector<std::uint32_t> features;
+    std::vector<std::uint32_t> keys;
+    std::vector<std::uint32_t> values;
+};
+
 class layer {
 public:
     layer(protozero::data_view const& layer_view);
+    /// Set up a layer from an index entry with tables, without parsing the layer.
+    layer(protozero::data_view const& layer_view, layer_index_entry const& entry);
 
     std::size_t featureCount() const { return features.size(); }
     protozero::data_view const& getFeature(std::size_t) const;
     std::string const& getName() const;
     std::uint32_t getExtent() const { return extent; }
     std::uint32_t getVersion() const { return version; }
+    /**
+     * Select the features with the largest numeric value for a given key.
+     *
+     * Only the feature tags and the layer value table are read, geometries are
+     * never decoded. Features without a numeric value for the key are skipped.
+     *
+     * @param key The key holding the ranking value, e.g. `ele` or `rank`.
+     * @param k   The maximum number of features to return.
+     * @return Indices of at most `k` features, ordered by descending value and
+     *         by ascending index for equal values.
+     */
+    std::vector<std::size_t> topFeatures(std::string const& key, std::size_t k) const;
+    /**
+     * Collect per key value statistics, geometry type counts and vertex counts
+     * in one pass over the key/value tables and the packed tag and geometry
+     * streams. No property maps or point arrays are built.
+     */
+    layer_statistics statistics() const;
+    /// Bytes allocated by the decoded layer, not counting the tile data it refers to.
+    std::size_t memoryUsage() const;
 
 private:
     friend class feature;
+    friend class key_set;
 
     std::string name;
     std::uint32_t version;
@@ -94,15 +219,63 @@ private:
     std::vector<protozero::data_view> features;
 };
 
+/**
+ * A set of keys resolved against the key table of one layer, to be passed to
+ * feature::getValues for features of that layer.
+ */
+class key_set {
+public:
+    key_set(layer const&, std::vector<std::string> const& keys);
+
+    std::size_t size() const { return keyCount; }
+
+private:
+    friend class feature;
+
+    static constexpr std::uint32_t no_slot = std::numeric_limits<std::uint32_t>::max();
+
+    std::size_t keyCount;
+    // Position in the requested keys for each key table entry, or no_slot.
+    std::vector<std::uint32_t> slots;
+    // Number of key table entries sharing the name of each requested key.
+    std::vector<std::uint32_t> tagIdCounts;
+};
+
+class tile_index;
+
 class buffer {
 public:
-    buffer(std::string const& data);
+    /// How much of each layer the constructor reads.
+    enum open_mode : unsigned {
+        SCAN = 0, ///< read every layer to the end, rejecting malformed layers up front
+        LAZY = 1  ///< read each layer up to its name only, layers are checked by getLayer()
+    };
+
+    buffer(std::string const& data, open_mode mode = SCAN);
+    /// Decode a tile held elsewhere, for instance in a mapped_file. The data has to outlive the buffer.
+    buffer(protozero::data_view const& data, open_mode mode = SCAN);
+    /**
+     * Open a tile with a tile_index built for it, without scanning the tile.
+     * Defined in mapbox/vector_tile/layer_index.hpp. The data and the index
+     * have to outlive the buffer, which refers to the entries of the index.
+     */
+    buffer(protozero::data_view const& data, tile_index const& index);
+    buffer(protozero::data_view const& data, tile_index&& index) = delete;
     std::vector<std::string> layerNames() const;
-    std::map<std::string, const protozero::data_view> getLayers() const { return layers; };
+    bool hasLayer(std::string const& name) const { return layers.find(name) != layers.end(); }
+    std::map<std::string, const protozero::data_view> getLayers() const;
     layer getLayer(const std::string&) const;
+    /// Bytes allocated by the layer index, not counting the tile data it refers to.
+    std::size_t memoryUsage() const;
 
 private:
-    std::map<std::string, const protozero::data_view> layers;
+    struct layer_data {
+        protozero::data_view view;
+        // The tile_index entry with tables to set the layer up from, if any.
+        layer_index_entry const* entry = nullptr;
+    };
+
+    std::map<std::string, layer_data> layers;
 };
 
 static mapbox::feature::value parseValue(protozero::data_view const& value_view) {
@@ -140,6 +313,41 @@ static mapbox::feature::value parseValue(protozero::data_view const& value_view)
     return value;
 }
 
+static bool parseNumericValue(protozero::data_view const& value_view, double& number) {
+    bool is_number = false;
+    protozero::pbf_reader value_reader(value_view);
+    while (value_reader.next())
+    {
+        switch (value_reader.tag()) {
+        case ValueType::FLOAT:
+            number = static_cast<double>(value_reader.get_float());
+            is_number = true;
+            break;
+        case ValueType::DOUBLE:
+            number = value_reader.get_double();
+            is_number = true;
+            break;
+        case ValueType::INT:
+            number = static_cast<double>(value_reader.get_int64());
+            is_number = true;
+            break;
+        case ValueType::UINT:
+            number = static_cast<double>(value_reader.get_uint64());
+            is_number = true;
+            break;
+        case ValueType::SINT:
+            number = static_cast<double>(value_reader.get_sint64());
+            is_number = true;
+            break;
+        default:
+            value_reader.skip();
+            is_number = false;
+            break;
+        }
+    }
+    return is_number && !std::isnan(number);
+}
+
 inline feature::feature(protozero::data_view const& feature_view, layer const& l)
     : layer_(l),
       id(),
@@ -211,6 +419,69 @@ inline mapbox::feature::value feature::getValue(const std::string& key, std::str
     return mapbox::feature::null_value;
 }
 
+template <typename Callback>
+void feature::findValues(key_set const& keys, std::string* warning, Callback&& callback) const {
+    const auto values_count = layer_.values.size();
+    std::size_t remaining = keys.size();
+    // Tracks which keys were already found; the bit mask covers the usual
+    // handful of keys without allocating.
+    std::uint64_t found_mask = 0;
+    std::vector<bool> found_overflow(keys.size() > 64 ? keys.size() : 0);
+    auto start_itr = tags_iter.begin();
+    const auto end_itr = tags_iter.end();
+    while (start_itr != end_itr && remaining > 0) {
+        std::uint32_t tag_key = static_cast<std::uint32_t>(*start_itr++);
+
+        if (start_itr == end_itr) {
+            throw std::runtime_error("uneven number of feature tag ids");
+        }
+
+        std::uint32_t tag_val = static_cast<std::uint32_t>(*start_itr++);
+        if (values_count <= tag_val) {
+            throw std::runtime_error("feature referenced out of range value");
+        }
+
+        if (keys.slots.size() <= tag_key) {
+            continue;
+        }
+        const std::uint32_t slot = keys.slots[tag_key];
+        if (slot == key_set::no_slot) {
+            continue;
+        }
+        if (slot < 64) {
+            const std::uint64_t bit = std::uint64_t(1) << slot;
+            if (found_mask & bit) {
+                continue;
+            }
+            found_mask |= bit;
+        } else {
+            if (found_overflow[slot]) {
+                continue;
+            }
+            found_overflow[slot] = true;
+        }
+        --remaining;
+        if (keys.tagIdCounts[slot] > 1 && warning) {
+            *warning = std::string("duplicate keys with different tag ids are found");
+        }
+        callback(slot, layer_.values[tag_val]);
+    }
+}
+
+inline void feature::getValues(key_set const& keys, std::vector<mapbox::feature::value>& values, std::string* warning) const {
+    values.assign(keys.size(), mapbox::feature::null_value);
+    findValues(keys, warning, [&values](std::uint32_t slot, protozero::data_view const& value_view) {
+        values[slot] = parseValue(value_view);
+    });
+}
+
+inline void feature::getValues(key_set const& keys, std::vector<protozero::data_view>& values, std::string* warning) const {
+    values.assign(keys.size(), protozero::data_view());
+    findValues(keys, warning, [&values](std::uint32_t slot, protozero::data_view const& value_view) {
+        values[slot] = value_view;
+    });
+}
+
 inline feature::properties_type feature::getProperties() const {
     auto start_itr = tags_iter.begin();
     const auto end_itr = tags_iter.end();
@@ -361,7 +632,205 @@ GeometryCollectionType feature::getGeometries(float scale) const {
     return paths;
 }
 
-inline buffer::buffer(std::string const& data)
+namespace detail {
+
+// Decode packed geometry commands, for features and code reading features without a layer.
+template <typename Visitor>
+void walkGeometry(protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator> const& geometry, Visitor&& visitor) {
+    std::uint8_t cmd = 1;
+    std::uint32_t length = 0;
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+
+    auto start_itr = geometry.begin();
+    const auto end_itr = geometry.end();
+    while (start_itr != end_itr) {
+        if (length == 0) {
+            std::uint32_t cmd_length = static_cast<std::uint32_t>(*start_itr++);
+            cmd = cmd_length & 0x7;
+            length = cmd_length >> 3;
+            if (cmd == CommandType::CLOSE) {
+                visitor.closePath();
+                length = 0;
+            } else if (cmd != CommandType::MOVE_TO && cmd != CommandType::LINE_TO) {
+                throw std::runtime_error("unknown command");
+            }
+            continue;
+        }
+
+        --length;
+        x += protozero::decode_zigzag32(static_cast<std::uint32_t>(*start_itr++));
+        if (start_itr == end_itr) {
+            throw std::runtime_error("uneven number of geometry coordinates");
+        }
+        y += protozero::decode_zigzag32(static_cast<std::uint32_t>(*start_itr++));
+        if (cmd == CommandType::MOVE_TO) {
+            visitor.moveTo(x, y);
+        } else {
+            visitor.lineTo(x, y);
+        }
+    }
+}
+
+} // namespace detail
+
+template <typename Visitor>
+void feature::walkGeometry(Visitor&& visitor) const {
+    detail::walkGeometry(geometry_iter, visitor);
+}
+
+namespace detail {
+
+struct bbox_visitor {
+    mapbox::geometry::box<std::int64_t> bbox{
+        { std::numeric_limits<std::int64_t>::max(), std::numeric_limits<std::int64_t>::max() },
+        { std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::min() } };
+
+    void moveTo(std::int64_t x, std::int64_t y) { lineTo(x, y); }
+    void lineTo(std::int64_t x, std::int64_t y) {
+        bbox.min.x = std::min(bbox.min.x, x);
+        bbox.min.y = std::min(bbox.min.y, y);
+        bbox.max.x = std::max(bbox.max.x, x);
+        bbox.max.y = std::max(bbox.max.y, y);
+    }
+    void closePath() {}
+};
+
+// Base for visitors that need every ring edge, including the closing one.
+// Rings of malformed polygons without a ClosePath are closed implicitly.
+template <typename Derived>
+struct ring_edge_visitor {
+    bool closeRings = true;
+    bool ringOpen = false;
+    std::int64_t startX = 0;
+    std::int64_t startY = 0;
+    std::int64_t lastX = 0;
+    std::int64_t lastY = 0;
+
+    void moveTo(std::int64_t x, std::int64_t y) {
+        finishRing();
+        startX = lastX = x;
+        startY = lastY = y;
+        ringOpen = true;
+        static_cast<Derived*>(this)->vertex(x, y);
+    }
+    void lineTo(std::int64_t x, std::int64_t y) {
+        static_cast<Derived*>(this)->edge(lastX, lastY, x, y);
+        lastX = x;
+        lastY = y;
+    }
+    void closePath() { finishRing(); }
+    void finishRing() {
+        if (ringOpen && closeRings) {
+            static_cast<Derived*>(this)->edge(lastX, lastY, startX, startY);
+        }
+        ringOpen = false;
+    }
+};
+
+// Whether the edge crosses the ray from (px, py) towards positive x. Edges
+// entirely above or below the point are rejected without a division.
+inline bool crossesRay(double px, double py, std::int64_t ax, std::int64_t ay, std::int64_t bx, std::int64_t by) {
+    const double ayd = static_cast<double>(ay);
+    const double byd = static_cast<double>(by);
+    if ((ayd > py) == (byd > py)) {
+        return false;
+    }
+    const double axd = static_cast<double>(ax);
+    return px < axd + (py - ayd) * (static_cast<double>(bx) - axd) / (byd - ayd);
+}
+
+struct crossing_visitor : ring_edge_visitor<crossing_visitor> {
+    double px;
+    double py;
+    bool inside = false;
+
+    crossing_visitor(double px_, double py_) : px(px_), py(py_) {}
+
+    void vertex(std::int64_t, std::int64_t) {}
+    void edge(std::int64_t ax, std::int64_t ay, std::int64_t bx, std::int64_t by) {
+        if (crossesRay(px, py, ax, ay, bx, by)) {
+            inside = !inside;
+        }
+    }
+};
+
+// Tracks the crossing parity along with the distance when closeRings is
+// set, so polygons need a single walk.
+struct distance_visitor : ring_edge_visitor<distance_visitor> {
+    double px;
+    double py;
+    double minSquared = std::numeric_limits<double>::infinity();
+    bool inside = false;
+
+    distance_visitor(double px_, double py_) : px(px_), py(py_) {}
+
+    void vertex(std::int64_t x, std::int64_t y) {
+        const double dx = static_cast<double>(x) - px;
+        const double dy = static_cast<double>(y) - py;
+        minSquared = std::min(minSquared, dx * dx + dy * dy);
+    }
+    void edge(std::int64_t ax, std::int64_t ay, std::int64_t bx, std::int64_t by) {
+        if (closeRings && crossesRay(px, py, ax, ay, bx, by)) {
+            inside = !inside;
+        }
+        const double axd = static_cast<double>(ax);
+        const double ayd = static_cast<double>(ay);
+        const double dx = static_cast<double>(bx) - axd;
+        const double dy = static_cast<double>(by) - ayd;
+        const double len_squared = dx * dx + dy * dy;
+        double t = 0.0;
+        if (len_squared > 0.0) {
+            t = std::clamp(((px - axd) * dx + (py - ayd) * dy) / len_squared, 0.0, 1.0);
+        }
+        const double ex = axd + t * dx - px;
+        const double ey = ayd + t * dy - py;
+        minSquared = std::min(minSquared, ex * ex + ey * ey);
+    }
+};
+
+} // namespace detail
+
+inline mapbox::geometry::box<std::int64_t> feature::getBoundingBox() const {
+    detail::bbox_visitor visitor;
+    walkGeometry(visitor);
+    return visitor.bbox;
+}
+
+inline bool feature::contains(mapbox::geometry::point<double> const& point) const {
+    if (type != GeomType::POLYGON) {
+        return false;
+    }
+    detail::crossing_visitor visitor(point.x, point.y);
+    walkGeometry(visitor);
+    visitor.finishRing();
+    return visitor.inside;
+}
+
+inline bool feature::contains(mapbox::geometry::point<double> const& point, mapbox::geometry::box<std::int64_t> const& bbox) const {
+    if (point.x < static_cast<double>(bbox.min.x) || point.x > static_cast<double>(bbox.max.x) ||
+        point.y < static_cast<double>(bbox.min.y) || point.y > static_cast<double>(bbox.max.y)) {
+        return false;
+    }
+    return contains(point);
+}
+
+inline double feature::distanceTo(mapbox::geometry::point<double> const& point) const {
+    detail::distance_visitor visitor(point.x, point.y);
+    visitor.closeRings = type == GeomType::POLYGON;
+    walkGeometry(visitor);
+    visitor.finishRing();
+    if (visitor.inside) {
+        return 0.0;
+    }
+    return std::sqrt(visitor.minSquared);
+}
+
+inline buffer::buffer(std::string const& data, open_mode mode)
+    : buffer(protozero::data_view(data), mode) {
+}
+
+inline buffer::buffer(protozero::data_view const& data, open_mode mode)
     : layers() {
         protozero::pbf_reader data_reader(data);
         while (data_reader.next(TileType::LAYERS)) {
@@ -369,14 +838,21 @@ inline buffer::buffer(std::string const& data)
             protozero::pbf_reader layer_reader(layer_view);
             std::string name;
             bool has_name = false;
+            // Encoders write the name ahead of the features, layer_builder
+            // after the version, so a lazy open reads a few small fields per
+            // layer instead of the whole layer. A scan keeps going to the
+            // end, where a repeated name overrides earlier ones.
             while (layer_reader.next(LayerType::NAME)) {
                 name = layer_reader.get_string();
                 has_name = true;
+                if (mode == LAZY) {
+                    break;
+                }
             }
             if (!has_name) {
                 throw std::runtime_error("Layer missing name");
             }
-            layers.emplace(name, layer_view);
+            layers.emplace(name, layer_data{ layer_view, nullptr });
         }
 }
 
@@ -389,12 +865,23 @@ inline std::vector<std::string> buffer::layerNames() const {
     return names;
 }
 
+inline std::map<std::string, const protozero::data_view> buffer::getLayers() const {
+    std::map<std::string, const protozero::data_view> views;
+    for (auto const& layer : layers) {
+        views.emplace_hint(views.end(), layer.first, layer.second.view);
+    }
+    return views;
+}
+
 inline layer buffer::getLayer(const std::string& name) const {
     auto layer_it = layers.find(name);
     if (layer_it == layers.end()) {
         throw std::runtime_error(std::string("no layer by the name of '")+name+"'");
     }
-    return layer(layer_it->second);
+    if (layer_it->second.entry) {
+        return layer(layer_it->second.view, *layer_it->second.entry);
+    }
+    return layer(layer_it->second.view);
 }
 
 inline layer::layer(protozero::data_view const& layer_view) :
@@ -470,6 +957,39 @@ inline layer::layer(protozero::data_view const& layer_view) :
     }
 }
 
+inline layer::layer(protozero::data_view const& layer_view, layer_index_entry const& entry) :
+    name(entry.name),
+    version(entry.version),
+    extent(entry.extent),
+    keysMap(),
+    keys(),
+    values(),
+    features()
+{
+    const auto view_at = [&layer_view](std::vector<std::uint32_t> const& table, std::size_t i) {
+        const std::uint64_t offset = table[i];
+        const std::uint64_t length = table[i + 1];
+        if (offset > layer_view.size() || length > layer_view.size() - offset) {
+            throw std::runtime_error("layer index does not match the layer");
+        }
+        return protozero::data_view(layer_view.data() + offset, static_cast<std::size_t>(length));
+    };
+    keys.reserve(entry.keys.size() / 2);
+    for (std::size_t i = 0; i + 1 < entry.keys.size(); i += 2) {
+        const protozero::data_view key = view_at(entry.keys, i);
+        auto iter = keysMap.emplace(std::string(key.data(), key.size()), uint32_t(keys.size()));
+        keys.emplace_back(std::reference_wrapper<const std::string>(iter->first));
+    }
+    values.reserve(entry.values.size() / 2);
+    for (std::size_t i = 0; i + 1 < entry.values.size(); i += 2) {
+        values.push_back(view_at(entry.values, i));
+    }
+    features.reserve(entry.features.size() / 2);
+    for (std::size_t i = 0; i + 1 < entry.features.size(); i += 2) {
+        features.push_back(view_at(entry.features, i));
+    }
+}
+
 inline protozero::data_view const& layer::getFeature(std::size_t i) const {
     return features.at(i);
 }
@@ -478,4 +998,233 @@ inline std::string const& layer::getName() const {
     return name;
 }
 
+inline std::vector<std::size_t> layer::topFeatures(std::string const& key, std::size_t k) const {
+    std::vector<std::size_t> result;
+    const auto key_range = keysMap.equal_range(key);
+    if (k == 0 || key_range.first == key_range.second) {
+        return result;
+    }
+
+    // Parse every value once instead of once per referencing feature.
+    std::vector<double> numbers(values.size());
+    std::vector<bool> is_number(values.size());
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        // NaN has no rank, it is skipped like other non-numeric values.
+        is_number[i] = parseNumericValue(values[i], numbers[i]) && !std::isnan(numbers[i]);
+    }
+
+    using entry_type = std::pair<double, std::size_t>;
+    const auto better = [](entry_type const& a, entry_type const& b) {
+        return b.first < a.first || (!(a.first < b.first) && a.second < b.second);
+    };
+    // Bounded heap holding the best k entries seen so far, worst on top.
+    std::vector<entry_type> heap;
+    heap.reserve(std::min(k, features.size()));
+
+    const auto values_count = values.size();
+    for (std::size_t i = 0; i < features.size(); ++i) {
+        const feature f(features[i], *this);
+        auto start_itr = f.tags_iter.begin();
+        const auto end_itr = f.tags_iter.end();
+        while (start_itr != end_itr) {
+            std::uint32_t tag_key = static_cast<std::uint32_t>(*start_itr++);
+            if (start_itr == end_itr) {
+                throw std::runtime_error("uneven number of feature tag ids");
+            }
+            std::uint32_t tag_val = static_cast<std::uint32_t>(*start_itr++);
+            if (values_count <= tag_val) {
+                throw std::runtime_error("feature referenced out of range value");
+            }
+
+            bool key_found = false;
+            for (auto j = key_range.first; j != key_range.second; ++j) {
+                if (j->second == tag_key) {
+                    key_found = true;
+                    break;
+                }
+            }
+            if (!key_found) {
+                continue;
+            }
+
+            // Same as getValue: the first matching tag decides.
+            if (is_number[tag_val]) {
+                const entry_type candidate(numbers[tag_val], i);
+                if (heap.size() < k) {
+                    heap.push_back(candidate);
+                    std::push_heap(heap.begin(), heap.end(), better);
+                } else if (better(candidate, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = candidate;
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+            }
+            break;
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), better);
+    result.reserve(heap.size());
+    for (auto const& entry : heap) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+inline key_set::key_set(layer const& l, std::vector<std::string> const& keys)
+    : keyCount(keys.size()),
+      slots(l.keys.size(), no_slot),
+      tagIdCounts(keys.size(), 0) {
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        const auto key_range = l.keysMap.equal_range(keys[i]);
+        for (auto j = key_range.first; j != key_range.second; ++j) {
+            // A key requested twice is reported in its first position only.
+            if (slots[j->second] == no_slot) {
+                slots[j->second] = static_cast<std::uint32_t>(i);
+                ++tagIdCounts[i];
+            }
+        }
+    }
+}
+
+inline layer_statistics layer::statistics() const {
+    layer_statistics stats;
+    stats.featureCount = features.size();
+
+    // Key names repeated in the key table share one entry.
+    std::vector<std::size_t> key_slots(keys.size());
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        std::string const& key = keys[i].get();
+        const auto first = keysMap.lower_bound(key);
+        if (first->second == i) {
+            key_slots[i] = stats.keys.size();
+            stats.keys.emplace_back();
+            stats.keys.back().key = key;
+        } else {
+            key_slots[i] = key_slots[first->second];
+        }
+    }
+
+    struct value_info {
+        std::uint32_t type = 0;
+        bool is_number = false;
+        double number = 0.0;
+    };
+    std::vector<value_info> value_infos(values.size());
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        protozero::pbf_reader value_reader(values[i]);
+        while (value_reader.next()) {
+            value_infos[i].type = value_reader.tag();
+            value_reader.skip();
+        }
+        value_infos[i].is_number = parseNumericValue(values[i], value_infos[i].number);
+    }
+
+    std::vector<std::unordered_set<std::string_view>> distinct_values(stats.keys.size());
+    std::vector<std::size_t> last_feature(stats.keys.size(), std::numeric_limits<std::size_t>::max());
+    for (std::size_t i = 0; i < features.size(); ++i) {
+        const feature f(features[i], *this);
+        if (f.type < stats.geometryCounts.size()) {
+            ++stats.geometryCounts[f.type];
+        }
+
+        auto tag_itr = f.tags_iter.begin();
+        const auto tag_end = f.tags_iter.end();
+        while (tag_itr != tag_end) {
+            std::uint32_t tag_key = static_cast<std::uint32_t>(*tag_itr++);
+            if (tag_itr == tag_end) {
+                throw std::runtime_error("uneven number of feature tag ids");
+            }
+            std::uint32_t tag_val = static_cast<std::uint32_t>(*tag_itr++);
+            if (keys.size() <= tag_key) {
+                throw std::runtime_error("feature referenced out of range key");
+            }
+            if (values.size() <= tag_val) {
+                throw std::runtime_error("feature referenced out of range value");
+            }
+
+            const auto slot = key_slots[tag_key];
+            key_statistics& key_stats = stats.keys[slot];
+            if (last_feature[slot] != i) {
+                last_feature[slot] = i;
+                ++key_stats.featureCount;
+            }
+            value_info const& info = value_infos[tag_val];
+            if (info.type < 32) {
+                key_stats.valueTypes |= std::uint32_t(1) << info.type;
+            }
+            if (info.is_number) {
+                key_stats.min = std::min(key_stats.min, info.number);
+                key_stats.max = std::max(key_stats.max, info.number);
+            }
+            distinct_values[slot].emplace(values[tag_val].data(), values[tag_val].size());
+        }
+
+        // Only command headers are decoded, parameters are skipped.
+        auto geom_itr = f.geometry_iter.begin();
+        const auto geom_end = f.geometry_iter.end();
+        while (geom_itr != geom_end) {
+            std::uint32_t cmd_length = static_cast<std::uint32_t>(*geom_itr++);
+            std::uint32_t cmd = cmd_length & 0x7;
+            std::uint32_t length = cmd_length >> 3;
+            if (cmd == CommandType::MOVE_TO || cmd == CommandType::LINE_TO) {
+                for (std::uint32_t j = 0; j < length && geom_itr != geom_end; ++j) {
+                    ++geom_itr;
+                    if (geom_itr == geom_end) {
+                        throw std::runtime_error("uneven number of geometry coordinates");
+                    }
+                    ++geom_itr;
+                    ++stats.vertexCount;
+                }
+            } else if (cmd != CommandType::CLOSE) {
+                throw std::runtime_error("unknown command");
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < stats.keys.size(); ++i) {
+        stats.keys[i].distinctValues = distinct_values[i].size();
+        if (stats.featureCount > 0) {
+            stats.keys[i].coverage = static_cast<double>(stats.keys[i].featureCount) / static_cast<double>(stats.featureCount);
+        }
+    }
+    return stats;
+}
+
+namespace detail {
+
+// Heap bytes of a string, nothing if it is stored inline.
+inline std::size_t stringMemoryUsage(std::string const& string) {
+    const auto* begin = reinterpret_cast<const char*>(&string);
+    const bool is_inline = string.data() >= begin && string.data() < begin + sizeof(string);
+    return is_inline ? 0 : string.capacity() + 1;
+}
+
+// Bytes of a std::map node holding a value, with the tree links of common implementations.
+template <typename Value>
+constexpr std::size_t mapNodeSize() {
+    return sizeof(Value) + 4 * sizeof(void*);
+}
+
+} // namespace detail
+
+inline std::size_t layer::memoryUsage() const {
+    std::size_t bytes = sizeof(layer) + detail::stringMemoryUsage(name);
+    for (auto const& key : keysMap) {
+        bytes += detail::mapNodeSize<std::pair<const std::string, std::uint32_t>>() + detail::stringMemoryUsage(key.first);
+    }
+    bytes += keys.capacity() * sizeof(decltype(keys)::value_type);
+    bytes += values.capacity() * sizeof(protozero::data_view);
+    bytes += features.capacity() * sizeof(protozero::data_view);
+    return bytes;
+}
+
+inline std::size_t buffer::memoryUsage() const {
+    std::size_t bytes = sizeof(buffer);
+    for (auto const& entry : layers) {
+        bytes += detail::mapNodeSize<std::pair<const std::string, layer_data>>() + detail::stringMemoryUsage(entry.first);
+    }
+    return bytes;
+}
+
 }} // namespace mapbox/vector_tile
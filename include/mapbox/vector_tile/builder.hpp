@@ -0,0 +1,745 @@
+#pragma once
+
+#include "vector_tile_config.hpp"
+#include <mapbox/geometry.hpp>
+#include <mapbox/feature.hpp>
+#include <protozero/pbf_writer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace mapbox { namespace vector_tile {
+
+namespace detail {
+
+struct string_hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view str) const { return std::hash<std::string_view>()(str); }
+};
+
+// Maps strings to their index in a table, looked up without allocating.
+using string_index_map = std::unordered_map<std::string, std::uint32_t, string_hash, std::equal_to<>>;
+
+// NaN cannot be ordered, such features are dropped first.
+inline double featurePriority(double priority) {
+    return std::isnan(priority) ? -std::numeric_limits<double>::infinity() : priority;
+}
+
+inline std::uint32_t command(CommandType cmd, std::size_t count) {
+    if (count > (std::numeric_limits<std::uint32_t>::max() >> 3)) {
+        throw std::runtime_error("geometry command count out of range");
+    }
+    return (static_cast<std::uint32_t>(count) << 3) | cmd;
+}
+
+// Appends command integers for coordinates relative to the previous vertex.
+class geometry_encoder {
+public:
+    explicit geometry_encoder(std::vector<std::uint32_t>& commands_) : commands(commands_) {}
+
+    void command(CommandType cmd, std::size_t count) {
+        commands.push_back(detail::command(cmd, count));
+    }
+
+    template <typename T>
+    void vertex(mapbox::geometry::point<T> const& p) {
+        const std::int64_t px = static_cast<std::int64_t>(p.x);
+        const std::int64_t py = static_cast<std::int64_t>(p.y);
+        const std::int64_t dx = px - x;
+        const std::int64_t dy = py - y;
+        if (dx < std::numeric_limits<std::int32_t>::min() || dx > std::numeric_limits<std::int32_t>::max() ||
+            dy < std::numeric_limits<std::int32_t>::min() || dy > std::numeric_limits<std::int32_t>::max()) {
+            throw std::runtime_error("geometry coordinate out of range");
+        }
+        commands.push_back(protozero::encode_zigzag32(static_cast<std::int32_t>(dx)));
+        commands.push_back(protozero::encode_zigzag32(static_cast<std::int32_t>(dy)));
+        x = px;
+        y = py;
+    }
+
+    // Same as vertex() for every point of a range, in one tight loop that
+    // checks the delta range once at the end.
+    template <typename It>
+    void vertices(It first, It last) {
+        const std::size_t start = commands.size();
+        commands.resize(start + 2 * static_cast<std::size_t>(std::distance(first, last)));
+        std::uint32_t* out = commands.data() + start;
+        std::int64_t px = x;
+        std::int64_t py = y;
+        bool overflow = false;
+        for (; first != last; ++first) {
+            const std::int64_t nx = static_cast<std::int64_t>(first->x);
+            const std::int64_t ny = static_cast<std::int64_t>(first->y);
+            const std::int64_t dx = nx - px;
+            const std::int64_t dy = ny - py;
+            overflow |= dx != static_cast<std::int32_t>(dx) || dy != static_cast<std::int32_t>(dy);
+            *out++ = protozero::encode_zigzag32(static_cast<std::int32_t>(dx));
+            *out++ = protozero::encode_zigzag32(static_cast<std::int32_t>(dy));
+            px = nx;
+            py = ny;
+        }
+        if (overflow) {
+            commands.resize(start);
+            throw std::runtime_error("geometry coordinate out of range");
+        }
+        x = px;
+        y = py;
+    }
+
+private:
+    std::vector<std::uint32_t>& commands;
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+};
+
+// Encoded size of a packed uint32 field with a tag below 16, 0 when empty.
+inline std::size_t packedFieldSize(std::vector<std::uint32_t> const& values) {
+    if (values.empty()) {
+        return 0;
+    }
+    const std::size_t size = protozero::length_of_varints(values.begin(), values.end());
+    return 1 + static_cast<std::size_t>(protozero::length_of_varint(size)) + size;
+}
+
+} // namespace detail
+
+class feature_builder;
+
+/**
+ * Collects the features of one layer together with its key and value
+ * tables. Every distinct key and value is stored once per layer.
+ */
+class layer_builder {
+public:
+    layer_builder(std::string name, std::uint32_t extent = 4096, std::uint32_t version = 2);
+
+    std::string const& getName() const { return name; }
+    std::uint32_t getExtent() const { return extent; }
+    std::uint32_t getVersion() const { return version; }
+    std::size_t featureCount() const { return records.size(); }
+    /// Exact size of the layer as a field of an encoded tile.
+    std::size_t encodedSize() const;
+
+    /**
+     * Take the priority of following features from a numeric property with
+     * this key, unless feature_builder::setPriority is called.
+     */
+    void setPriorityKey(std::string key) { priorityKey = std::move(key); }
+
+    /// Index of a key in the key table, adding it if needed.
+    std::uint32_t addKey(std::string_view key);
+    /// Index of a value in the value table, adding it if needed.
+    std::uint32_t addValue(mapbox::feature::value const& value);
+    std::uint32_t addValue(std::string_view value);
+    std::uint32_t addValue(std::string const& value) { return addValue(std::string_view(value)); }
+    std::uint32_t addValue(const char* value) { return addValue(std::string_view(value)); }
+    /// Signed integers are written as SINT, unsigned as UINT.
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    std::uint32_t addValue(T value);
+
+    /// Write the layer as a LAYERS field of a tile.
+    template <typename TBuffer>
+    void serialize(protozero::basic_pbf_writer<TBuffer>& tile_writer) const;
+
+private:
+    friend class feature_builder;
+    friend class tile_builder;
+
+    struct feature_record {
+        std::size_t offset;
+        std::size_t size;
+        double priority;
+    };
+
+    // Index of the value message in valueScratch, adding it if needed.
+    std::uint32_t addEncodedValue();
+    std::size_t bodySize() const { return header.size() + keysData.size() + valuesData.size() + featureData.size(); }
+
+    std::string name;
+    std::uint32_t extent;
+    std::uint32_t version;
+    // Encoded NAME, EXTENT and VERSION fields.
+    std::string header;
+    // Encoded KEYS, VALUES and FEATURES fields in the order they were added.
+    std::string keysData;
+    std::string valuesData;
+    std::string featureData;
+    detail::string_index_map keysMap;
+    detail::string_index_map valuesMap;
+    // Position and priority of every feature in featureData.
+    std::vector<feature_record> records;
+    std::string priorityKey;
+    // Scratch space reused by every feature of the layer.
+    std::string valueScratch;
+    std::vector<std::uint32_t> tags;
+    std::vector<std::uint32_t> geometry;
+    bool building = false;
+};
+
+/**
+ * Encodes one feature into a layer_builder. Only one feature_builder may be
+ * in use per layer at any time. The feature is only added by commit(),
+ * otherwise it is discarded when the builder is destroyed; keys and values
+ * added for a discarded feature stay in the layer tables.
+ */
+class feature_builder {
+public:
+    explicit feature_builder(layer_builder& layer);
+    ~feature_builder();
+
+    feature_builder(feature_builder const&) = delete;
+    feature_builder& operator=(feature_builder const&) = delete;
+
+    void setId(std::uint64_t id);
+    /// Features with lower priority are dropped first to meet a size budget, NaN is the lowest.
+    void setPriority(double priority);
+    template <typename V>
+    void addProperty(std::string_view key, V&& value);
+    /// Add a tag from key and value indices of the layer tables.
+    void addTag(std::uint32_t key, std::uint32_t value);
+
+    template <typename T>
+    void setGeometry(mapbox::geometry::point<T> const& point);
+    template <typename T>
+    void setGeometry(mapbox::geometry::multi_point<T> const& points);
+    template <typename T>
+    void setGeometry(mapbox::geometry::line_string<T> const& line);
+    template <typename T>
+    void setGeometry(mapbox::geometry::multi_line_string<T> const& lines);
+    template <typename T>
+    void setGeometry(mapbox::geometry::polygon<T> const& polygon);
+    template <typename T>
+    void setGeometry(mapbox::geometry::multi_polygon<T> const& polygons);
+    template <typename T>
+    void setGeometry(mapbox::geometry::geometry<T> const& geometry);
+    /// Copy an already encoded command stream.
+    template <typename InputIterator>
+    void setGeometry(GeomType type, InputIterator first, InputIterator last);
+
+    void commit();
+    void rollback();
+
+private:
+    void startGeometry(GeomType type);
+    template <typename T>
+    void encodeLine(detail::geometry_encoder& encoder, mapbox::geometry::line_string<T> const& line);
+    template <typename T>
+    void encodePolygon(detail::geometry_encoder& encoder, mapbox::geometry::polygon<T> const& polygon);
+
+    layer_builder* layer_;
+    GeomType type = GeomType::UNKNOWN;
+    bool hasId = false;
+    bool hasPriority = false;
+    std::uint64_t id = 0;
+    double priority = 0.0;
+};
+
+/**
+ * Collects layers and writes them as a vector tile that can be read with
+ * mapbox::vector_tile::buffer.
+ *
+ * Layers share no state, so different layers may be filled from different
+ * threads once they have been added.
+ */
+class tile_builder {
+public:
+    /// Add a new layer, the returned reference stays valid with the tile_builder.
+    layer_builder& addLayer(std::string name, std::uint32_t extent = 4096, std::uint32_t version = 2);
+    std::size_t layerCount() const { return layers.size(); }
+
+    /**
+     * Call build(layer) for every layer, running up to `threads` layers
+     * concurrently; 0 uses the hardware concurrency. Once all layers are
+     * done, the exception thrown by build for the first layer that failed,
+     * in the order the layers were added, is rethrown. If threads can't be
+     * started, the layers are built on the threads already running.
+     */
+    template <typename BuildFunction>
+    void buildLayers(BuildFunction&& build, unsigned threads = 0);
+
+    /// Exact size of the encoded tile.
+    std::size_t encodedSize() const;
+
+    /**
+     * Append the encoded tile to data, which can be any buffer supported by
+     * protozero::basic_pbf_writer, like a std::string or a
+     * protozero::fixed_size_buffer_adaptor over the memory it is sent from.
+     */
+    template <typename TBuffer>
+    void serialize(TBuffer& data) const;
+    std::string serialize() const;
+    /**
+     * Append the encoded tile to data, any buffer serialize(data) accepts,
+     * leaving out the features with the lowest priority until the tile is at
+     * most max_size bytes. Features of equal priority are dropped in reverse
+     * order of addition. Encoded features are copied, nothing is encoded
+     * again.
+     *
+     * @return The number of dropped features.
+     * @throws std::runtime_error if the tile does not fit even without any
+     *         features.
+     */
+    template <typename TBuffer>
+    std::size_t serialize(TBuffer& data, std::size_t max_size) const;
+
+private:
+    std::vector<std::unique_ptr<layer_builder>> layers;
+};
+
+inline layer_builder::layer_builder(std::string name_, std::uint32_t extent_, std::uint32_t version_)
+    : name(std::move(name_)),
+      extent(extent_),
+      version(version_) {
+    protozero::pbf_writer header_writer(header);
+    header_writer.add_uint32(LayerType::VERSION, version);
+    header_writer.add_string(LayerType::NAME, name);
+    header_writer.add_uint32(LayerType::EXTENT, extent);
+}
+
+inline std::uint32_t layer_builder::addKey(std::string_view key) {
+    auto it = keysMap.find(key);
+    if (it != keysMap.end()) {
+        return it->second;
+    }
+    const auto index = static_cast<std::uint32_t>(keysMap.size());
+    keysMap.emplace(std::string(key), index);
+    protozero::pbf_writer keys_writer(keysData);
+    keys_writer.add_string(LayerType::KEYS, key.data(), key.size());
+    return index;
+}
+
+inline std::uint32_t layer_builder::addEncodedValue() {
+    auto it = valuesMap.find(std::string_view(valueScratch));
+    if (it != valuesMap.end()) {
+        return it->second;
+    }
+    const auto index = static_cast<std::uint32_t>(valuesMap.size());
+    valuesMap.emplace(valueScratch, index);
+    protozero::pbf_writer values_writer(valuesData);
+    values_writer.add_message(LayerType::VALUES, valueScratch);
+    return index;
+}
+
+inline std::uint32_t layer_builder::addValue(std::string_view value) {
+    valueScratch.clear();
+    protozero::pbf_writer value_writer(valueScratch);
+    value_writer.add_string(ValueType::STRING, value.data(), value.size());
+    return addEncodedValue();
+}
+
+template <typename T>
+    requires std::is_arithmetic_v<T>
+std::uint32_t layer_builder::addValue(T value) {
+    valueScratch.clear();
+    protozero::pbf_writer value_writer(valueScratch);
+    if constexpr (std::is_same_v<T, bool>) {
+        value_writer.add_bool(ValueType::BOOL, value);
+    } else if constexpr (std::is_same_v<T, float>) {
+        value_writer.add_float(ValueType::FLOAT, value);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        value_writer.add_double(ValueType::DOUBLE, static_cast<double>(value));
+    } else if constexpr (std::is_signed_v<T>) {
+        value_writer.add_sint64(ValueType::SINT, static_cast<std::int64_t>(value));
+    } else {
+        value_writer.add_uint64(ValueType::UINT, static_cast<std::uint64_t>(value));
+    }
+    return addEncodedValue();
+}
+
+inline std::uint32_t layer_builder::addValue(mapbox::feature::value const& value) {
+    return std::visit([this](auto const& v) -> std::uint32_t {
+        using value_type = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<value_type, std::string> || std::is_arithmetic_v<value_type>) {
+            return addValue(v);
+        } else {
+            throw std::runtime_error("unsupported property value type");
+        }
+    }, static_cast<mapbox::feature::value_base const&>(value));
+}
+
+inline std::size_t layer_builder::encodedSize() const {
+    const std::size_t body = bodySize();
+    return 1 + static_cast<std::size_t>(protozero::length_of_varint(body)) + body;
+}
+
+template <typename TBuffer>
+void layer_builder::serialize(protozero::basic_pbf_writer<TBuffer>& tile_writer) const {
+    tile_writer.add_bytes_vectored(TileType::LAYERS, header, keysData, valuesData, featureData);
+}
+
+inline feature_builder::feature_builder(layer_builder& layer)
+    : layer_(&layer) {
+    if (layer_->building) {
+        throw std::runtime_error("another feature of this layer is being built");
+    }
+    layer_->building = true;
+    layer_->tags.clear();
+    layer_->geometry.clear();
+}
+
+inline feature_builder::~feature_builder() {
+    if (layer_) {
+        layer_->building = false;
+    }
+}
+
+inline void feature_builder::setId(std::uint64_t id_) {
+    id = id_;
+    hasId = true;
+}
+
+inline void feature_builder::setPriority(double priority_) {
+    priority = detail::featurePriority(priority_);
+    hasPriority = true;
+}
+
+template <typename V>
+void feature_builder::addProperty(std::string_view key, V&& value) {
+    if (!layer_) {
+        throw std::runtime_error("feature was already committed or rolled back");
+    }
+    if (!hasPriority && !layer_->priorityKey.empty() && key == layer_->priorityKey) {
+        using value_type = std::decay_t<V>;
+        if constexpr (std::is_arithmetic_v<value_type>) {
+            priority = detail::featurePriority(static_cast<double>(value));
+        } else if constexpr (std::is_same_v<value_type, mapbox::feature::value>) {
+            std::visit([this](auto const& v) {
+                if constexpr (std::is_arithmetic_v<std::decay_t<decltype(v)>>) {
+                    priority = detail::featurePriority(static_cast<double>(v));
+                }
+            }, static_cast<mapbox::feature::value_base const&>(value));
+        }
+    }
+    const std::uint32_t key_index = layer_->addKey(key);
+    const std::uint32_t value_index = layer_->addValue(std::forward<V>(value));
+    layer_->tags.push_back(key_index);
+    layer_->tags.push_back(value_index);
+}
+
+inline void feature_builder::addTag(std::uint32_t key, std::uint32_t value) {
+    if (!layer_) {
+        throw std::runtime_error("feature was already committed or rolled back");
+    }
+    if (key >= layer_->keysMap.size() || value >= layer_->valuesMap.size()) {
+        throw std::runtime_error("tag references key or value out of range");
+    }
+    layer_->tags.push_back(key);
+    layer_->tags.push_back(value);
+}
+
+inline void feature_builder::startGeometry(GeomType type_) {
+    if (!layer_) {
+        throw std::runtime_error("feature was already committed or rolled back");
+    }
+    if (type != GeomType::UNKNOWN) {
+        throw std::runtime_error("feature geometry was already set");
+    }
+    type = type_;
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::point<T> const& point) {
+    startGeometry(GeomType::POINT);
+    detail::geometry_encoder encoder(layer_->geometry);
+    encoder.command(CommandType::MOVE_TO, 1);
+    encoder.vertex(point);
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::multi_point<T> const& points) {
+    if (points.empty()) {
+        throw std::runtime_error("multi point without points");
+    }
+    startGeometry(GeomType::POINT);
+    detail::geometry_encoder encoder(layer_->geometry);
+    encoder.command(CommandType::MOVE_TO, points.size());
+    encoder.vertices(points.begin(), points.end());
+}
+
+template <typename T>
+void feature_builder::encodeLine(detail::geometry_encoder& encoder, mapbox::geometry::line_string<T> const& line) {
+    if (line.size() < 2) {
+        throw std::runtime_error("line string with less than two points");
+    }
+    encoder.command(CommandType::MOVE_TO, 1);
+    encoder.vertex(line.front());
+    encoder.command(CommandType::LINE_TO, line.size() - 1);
+    encoder.vertices(line.begin() + 1, line.end());
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::line_string<T> const& line) {
+    startGeometry(GeomType::LINESTRING);
+    detail::geometry_encoder encoder(layer_->geometry);
+    encodeLine(encoder, line);
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::multi_line_string<T> const& lines) {
+    if (lines.empty()) {
+        throw std::runtime_error("multi line string without lines");
+    }
+    startGeometry(GeomType::LINESTRING);
+    detail::geometry_encoder encoder(layer_->geometry);
+    for (auto const& line : lines) {
+        encodeLine(encoder, line);
+    }
+}
+
+template <typename T>
+void feature_builder::encodePolygon(detail::geometry_encoder& encoder, mapbox::geometry::polygon<T> const& polygon) {
+    if (polygon.empty()) {
+        throw std::runtime_error("polygon without rings");
+    }
+    for (auto const& ring : polygon) {
+        // The closing point is implied by the ClosePath command.
+        std::size_t size = ring.size();
+        if (size > 1 && ring.front() == ring.back()) {
+            --size;
+        }
+        if (size < 3) {
+            throw std::runtime_error("polygon ring with less than three points");
+        }
+        encoder.command(CommandType::MOVE_TO, 1);
+        encoder.vertex(ring.front());
+        encoder.command(CommandType::LINE_TO, size - 1);
+        encoder.vertices(ring.begin() + 1, ring.begin() + static_cast<std::ptrdiff_t>(size));
+        encoder.command(CommandType::CLOSE, 1);
+    }
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::polygon<T> const& polygon) {
+    startGeometry(GeomType::POLYGON);
+    detail::geometry_encoder encoder(layer_->geometry);
+    encodePolygon(encoder, polygon);
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::multi_polygon<T> const& polygons) {
+    if (polygons.empty()) {
+        throw std::runtime_error("multi polygon without polygons");
+    }
+    startGeometry(GeomType::POLYGON);
+    detail::geometry_encoder encoder(layer_->geometry);
+    for (auto const& polygon : polygons) {
+        encodePolygon(encoder, polygon);
+    }
+}
+
+template <typename T>
+void feature_builder::setGeometry(mapbox::geometry::geometry<T> const& geometry) {
+    std::visit([this](auto const& g) {
+        using geometry_type = std::decay_t<decltype(g)>;
+        if constexpr (std::is_same_v<geometry_type, mapbox::geometry::empty> ||
+                      std::is_same_v<geometry_type, mapbox::geometry::geometry_collection<T>>) {
+            throw std::runtime_error("unsupported geometry type");
+        } else {
+            setGeometry(g);
+        }
+    }, static_cast<mapbox::geometry::geometry_base<T> const&>(geometry));
+}
+
+template <typename InputIterator>
+void feature_builder::setGeometry(GeomType type_, InputIterator first, InputIterator last) {
+    startGeometry(type_);
+    layer_->geometry.insert(layer_->geometry.end(), first, last);
+}
+
+inline void feature_builder::commit() {
+    if (!layer_) {
+        throw std::runtime_error("feature was already committed or rolled back");
+    }
+    if (layer_->geometry.empty()) {
+        throw std::runtime_error("feature has no geometry");
+    }
+    const std::size_t offset = layer_->featureData.size();
+    {
+        // With the exact size known up front the feature is written in
+        // place instead of being moved behind its length afterwards.
+        std::size_t size = 1 + static_cast<std::size_t>(protozero::length_of_varint(type)) +
+                           detail::packedFieldSize(layer_->tags) + detail::packedFieldSize(layer_->geometry);
+        if (hasId) {
+            size += 1 + static_cast<std::size_t>(protozero::length_of_varint(id));
+        }
+        protozero::pbf_writer layer_writer(layer_->featureData);
+        protozero::pbf_writer feature_writer(layer_writer, LayerType::FEATURES, size);
+        if (hasId) {
+            feature_writer.add_uint64(FeatureType::ID, id);
+        }
+        feature_writer.add_packed_uint32(FeatureType::TAGS, layer_->tags.begin(), layer_->tags.end());
+        feature_writer.add_enum(FeatureType::TYPE, type);
+        feature_writer.add_packed_uint32(FeatureType::GEOMETRY, layer_->geometry.begin(), layer_->geometry.end());
+    }
+    layer_->records.push_back(layer_builder::feature_record{ offset, layer_->featureData.size() - offset, priority });
+    layer_->building = false;
+    layer_ = nullptr;
+}
+
+inline void feature_builder::rollback() {
+    if (!layer_) {
+        throw std::runtime_error("feature was already committed or rolled back");
+    }
+    layer_->building = false;
+    layer_ = nullptr;
+}
+
+inline layer_builder& tile_builder::addLayer(std::string name, std::uint32_t extent, std::uint32_t version) {
+    for (auto const& layer : layers) {
+        if (layer->getName() == name) {
+            throw std::runtime_error(std::string("duplicate layer name '") + name + "'");
+        }
+    }
+    layers.push_back(std::make_unique<layer_builder>(std::move(name), extent, version));
+    return *layers.back();
+}
+
+inline std::size_t tile_builder::encodedSize() const {
+    std::size_t size = 0;
+    for (auto const& layer : layers) {
+        size += layer->encodedSize();
+    }
+    return size;
+}
+
+template <typename TBuffer>
+std::size_t tile_builder::serialize(TBuffer& data, std::size_t max_size) const {
+    std::size_t total = encodedSize();
+    if (total <= max_size) {
+        serialize(data);
+        return 0;
+    }
+
+    struct candidate {
+        double priority;
+        std::size_t layer;
+        std::size_t feature;
+    };
+    std::vector<candidate> candidates;
+    std::vector<std::size_t> bodies;
+    std::vector<std::vector<bool>> dropped(layers.size());
+    for (std::size_t l = 0; l < layers.size(); ++l) {
+        bodies.push_back(layers[l]->bodySize());
+        dropped[l].assign(layers[l]->records.size(), false);
+        for (std::size_t f = 0; f < layers[l]->records.size(); ++f) {
+            candidates.push_back(candidate{ layers[l]->records[f].priority, l, f });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](candidate const& a, candidate const& b) {
+        if (a.priority < b.priority || b.priority < a.priority) {
+            return a.priority < b.priority;
+        }
+        return a.layer != b.layer ? a.layer > b.layer : a.feature > b.feature;
+    });
+
+    // The size of the length varint of a layer shrinks with its body.
+    const auto field_size = [](std::size_t body) {
+        return 1 + static_cast<std::size_t>(protozero::length_of_varint(body)) + body;
+    };
+    std::size_t dropped_count = 0;
+    for (auto const& c : candidates) {
+        if (total <= max_size) {
+            break;
+        }
+        const std::size_t body = bodies[c.layer] - layers[c.layer]->records[c.feature].size;
+        total = total - field_size(bodies[c.layer]) + field_size(body);
+        bodies[c.layer] = body;
+        dropped[c.layer][c.feature] = true;
+        ++dropped_count;
+    }
+    if (total > max_size) {
+        throw std::runtime_error("tile does not fit into the size budget");
+    }
+
+    using customization = protozero::buffer_customization<TBuffer>;
+    customization::reserve_additional(&data, total);
+    for (std::size_t l = 0; l < layers.size(); ++l) {
+        layer_builder const& layer = *layers[l];
+        char key_and_length[2 * protozero::max_varint_length];
+        int length = protozero::write_varint(key_and_length, (TileType::LAYERS << 3) | 2);
+        length += protozero::write_varint(key_and_length + length, bodies[l]);
+        customization::append(&data, key_and_length, static_cast<std::size_t>(length));
+        customization::append(&data, layer.header.data(), layer.header.size());
+        customization::append(&data, layer.keysData.data(), layer.keysData.size());
+        customization::append(&data, layer.valuesData.data(), layer.valuesData.size());
+        for (std::size_t f = 0; f < layer.records.size(); ++f) {
+            if (!dropped[l][f]) {
+                customization::append(&data, layer.featureData.data() + layer.records[f].offset, layer.records[f].size);
+            }
+        }
+    }
+    return dropped_count;
+}
+
+template <typename BuildFunction>
+void tile_builder::buildLayers(BuildFunction&& build, unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, layers.size()));
+    std::atomic<std::size_t> next(0);
+    std::vector<std::exception_ptr> errors(layers.size());
+    const auto work = [&]() {
+        for (std::size_t i = next++; i < layers.size(); i = next++) {
+            try {
+                build(*layers[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    // Reserved up front so that only starting a thread can throw below.
+    workers.reserve(threads);
+    for (unsigned i = 1; i < threads; ++i) {
+        try {
+            workers.emplace_back(work);
+        } catch (std::system_error const&) {
+            break;
+        }
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto const& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+template <typename TBuffer>
+void tile_builder::serialize(TBuffer& data) const {
+    // One allocation for the whole tile, the layers are then concatenated.
+    protozero::buffer_customization<TBuffer>::reserve_additional(&data, encodedSize());
+    protozero::basic_pbf_writer<TBuffer> tile_writer(data);
+    for (auto const& layer : layers) {
+        layer->serialize(tile_writer);
+    }
+}
+
+inline std::string tile_builder::serialize() const {
+    std::string data;
+    serialize(data);
+    return data;
+}
+
+}} // namespace mapbox/vector_tile
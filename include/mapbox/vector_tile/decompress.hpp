@@ -0,0 +1,431 @@
+#pragma once
+
+#include <mapbox/vector_tile.hpp>
+#include <protozero/types.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compression libraries are opt-in, define these (or enable the CMake
+// options of the same name) and link zlib and/or libzstd to use them.
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace mapbox { namespace vector_tile {
+
+enum TileCompression : std::uint8_t
+{
+    TILE_UNCOMPRESSED = 0,
+    TILE_GZIP = 1,
+    TILE_ZLIB = 2,
+    TILE_ZSTD = 3
+};
+
+/// Detect the compression of tile data from its first bytes.
+inline TileCompression detectCompression(protozero::data_view const& data) {
+    const auto byte = [&data](std::size_t i) { return static_cast<unsigned char>(data.data()[i]); };
+    if (data.size() >= 2 && byte(0) == 0x1f && byte(1) == 0x8b) {
+        return TILE_GZIP;
+    }
+    if (data.size() >= 4 && byte(0) == 0x28 && byte(1) == 0xb5 && byte(2) == 0x2f && byte(3) == 0xfd) {
+        return TILE_ZSTD;
+    }
+    // A zlib header is a multiple of 31 with the deflate method. An
+    // uncompressed tile starts with the LAYERS tag 0x1a instead.
+    if (data.size() >= 2 && (byte(0) & 0x0f) == 8 && (byte(0) >> 4) <= 7 && (byte(0) * 256 + byte(1)) % 31 == 0) {
+        return TILE_ZLIB;
+    }
+    return TILE_UNCOMPRESSED;
+}
+
+class buffer_pool;
+
+/**
+ * Memory from a buffer_pool, handed back to the pool on destruction. The
+ * capacity is the size class it was taken from.
+ */
+class pooled_buffer {
+public:
+    pooled_buffer() = default;
+    pooled_buffer(pooled_buffer&& other) noexcept;
+    pooled_buffer& operator=(pooled_buffer&& other) noexcept;
+    ~pooled_buffer();
+
+    char* data() { return storage.get(); }
+    const char* data() const { return storage.get(); }
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return capacity_; }
+    /// Set the number of bytes in use, at most the capacity.
+    void resize(std::size_t size);
+    protozero::data_view view() const { return protozero::data_view(storage.get(), size_); }
+
+private:
+    friend class buffer_pool;
+    void release() noexcept;
+
+    buffer_pool* pool = nullptr;
+    std::unique_ptr<char[]> storage;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+};
+
+/**
+ * Hands out buffers in power of two size classes from 4 KiB on and keeps
+ * returned ones for reuse, so steady state decompression does not allocate.
+ * Thread-safe. The pool has to outlive all buffers taken from it.
+ */
+class buffer_pool {
+public:
+    /// Keep at most max_free buffers of every size class.
+    explicit buffer_pool(std::size_t max_free = 16) : maxFree(max_free) {}
+    buffer_pool(buffer_pool const&) = delete;
+    buffer_pool& operator=(buffer_pool const&) = delete;
+
+    /// A buffer with a capacity of at least size bytes, its size is 0.
+    pooled_buffer acquire(std::size_t size);
+    /// Number of buffers waiting for reuse.
+    std::size_t freeCount() const;
+
+private:
+    friend class pooled_buffer;
+    static constexpr unsigned min_class_bits = 12;
+
+    void release(std::unique_ptr<char[]> storage, std::size_t capacity) noexcept;
+
+    std::size_t maxFree;
+    mutable std::mutex mutex;
+    // Free buffers per size class, class i holding 2^(min_class_bits + i) bytes.
+    std::vector<std::vector<std::unique_ptr<char[]>>> freeLists;
+};
+
+/**
+ * Tile data decompressed into a pooled buffer, or the original data if it
+ * was not compressed. Owns the bytes backing a buffer decoded from view().
+ */
+class decompressed_tile {
+public:
+    decompressed_tile() = default;
+    explicit decompressed_tile(protozero::data_view const& data) : data_(data) {}
+    explicit decompressed_tile(pooled_buffer&& storage_)
+        : storage(std::move(storage_)), data_(storage.view()) {}
+
+    protozero::data_view view() const { return data_; }
+    bool isCopy() const { return storage.data() != nullptr; }
+
+private:
+    pooled_buffer storage;
+    protozero::data_view data_;
+};
+
+/**
+ * Inflates gzip, zlib and zstd compressed tiles into pooled buffers,
+ * detecting the compression from the data. Uncompressed tiles are passed
+ * through without a copy.
+ *
+ *     buffer_pool pool;
+ *     tile_decompressor decompressor(pool);
+ *     decompressed_tile data = decompressor.decompress(received);
+ *     buffer tile(data.view());
+ *
+ * A decompressor keeps its decompression state between calls and must only
+ * be used by one thread at a time; use one per thread with a shared pool.
+ */
+class tile_decompressor {
+public:
+    /// Tiles decompressing to more than max_size bytes are rejected.
+    explicit tile_decompressor(buffer_pool& pool, std::size_t max_size = 64 * 1024 * 1024);
+    ~tile_decompressor();
+    tile_decompressor(tile_decompressor const&) = delete;
+    tile_decompressor& operator=(tile_decompressor const&) = delete;
+
+    /**
+     * Use a trained zstd dictionary for zstd compressed tiles. The dictionary
+     * is copied. An empty dictionary disables it again.
+     */
+    void setZstdDictionary(protozero::data_view const& dictionary);
+
+    decompressed_tile decompress(protozero::data_view const& data);
+
+private:
+    // Move the data of buffer into one of at least twice the capacity.
+    void grow(pooled_buffer& buffer);
+    decompressed_tile inflate(protozero::data_view const& data, std::size_t size_hint);
+    decompressed_tile decompressZstd(protozero::data_view const& data);
+
+    buffer_pool& pool;
+    std::size_t maxSize;
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+    z_stream zlibStream;
+    bool zlibReady = false;
+#endif
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+    ZSTD_DCtx* zstdContext = nullptr;
+    ZSTD_DDict* zstdDictionary = nullptr;
+#endif
+};
+
+inline pooled_buffer::pooled_buffer(pooled_buffer&& other) noexcept
+    : pool(std::exchange(other.pool, nullptr)),
+      storage(std::move(other.storage)),
+      capacity_(std::exchange(other.capacity_, 0)),
+      size_(std::exchange(other.size_, 0)) {
+}
+
+inline pooled_buffer& pooled_buffer::operator=(pooled_buffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = std::exchange(other.pool, nullptr);
+        storage = std::move(other.storage);
+        capacity_ = std::exchange(other.capacity_, 0);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+inline pooled_buffer::~pooled_buffer() {
+    release();
+}
+
+inline void pooled_buffer::resize(std::size_t size) {
+    if (size > capacity_) {
+        throw std::runtime_error("pooled buffer size exceeds its capacity");
+    }
+    size_ = size;
+}
+
+inline void pooled_buffer::release() noexcept {
+    if (pool && storage) {
+        pool->release(std::move(storage), capacity_);
+    }
+    pool = nullptr;
+    storage.reset();
+    capacity_ = 0;
+    size_ = 0;
+}
+
+inline pooled_buffer buffer_pool::acquire(std::size_t size) {
+    unsigned size_class = 0;
+    while ((std::size_t(1) << (min_class_bits + size_class)) < size) {
+        ++size_class;
+        if (min_class_bits + size_class >= std::numeric_limits<std::size_t>::digits) {
+            throw std::runtime_error("pooled buffer size out of range");
+        }
+    }
+    pooled_buffer buffer;
+    buffer.pool = this;
+    buffer.capacity_ = std::size_t(1) << (min_class_bits + size_class);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size_class < freeLists.size() && !freeLists[size_class].empty()) {
+            buffer.storage = std::move(freeLists[size_class].back());
+            freeLists[size_class].pop_back();
+            return buffer;
+        }
+    }
+    buffer.storage.reset(new char[buffer.capacity_]);
+    return buffer;
+}
+
+inline void buffer_pool::release(std::unique_ptr<char[]> storage, std::size_t capacity) noexcept {
+    unsigned size_class = 0;
+    while ((std::size_t(1) << (min_class_bits + size_class)) < capacity) {
+        ++size_class;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    try {
+        if (freeLists.size() <= size_class) {
+            freeLists.resize(size_class + 1);
+        }
+        if (freeLists[size_class].size() < maxFree) {
+            freeLists[size_class].push_back(std::move(storage));
+        }
+    } catch (...) {
+        // Not keeping a buffer is always fine.
+    }
+}
+
+inline std::size_t buffer_pool::freeCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t count = 0;
+    for (auto const& list : freeLists) {
+        count += list.size();
+    }
+    return count;
+}
+
+inline tile_decompressor::tile_decompressor(buffer_pool& pool_, std::size_t max_size)
+    : pool(pool_),
+      maxSize(max_size) {
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+    std::memset(&zlibStream, 0, sizeof(zlibStream));
+#endif
+}
+
+inline tile_decompressor::~tile_decompressor() {
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+    if (zlibReady) {
+        inflateEnd(&zlibStream);
+    }
+#endif
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+    ZSTD_freeDDict(zstdDictionary);
+    ZSTD_freeDCtx(zstdContext);
+#endif
+}
+
+inline void tile_decompressor::setZstdDictionary(protozero::data_view const& dictionary) {
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+    ZSTD_freeDDict(zstdDictionary);
+    zstdDictionary = nullptr;
+    if (dictionary.size() > 0) {
+        zstdDictionary = ZSTD_createDDict(dictionary.data(), dictionary.size());
+        if (!zstdDictionary) {
+            throw std::runtime_error("invalid zstd dictionary");
+        }
+    }
+#else
+    (void)dictionary;
+    throw std::runtime_error("zstd support is not enabled");
+#endif
+}
+
+inline void tile_decompressor::grow(pooled_buffer& buffer) {
+    if (buffer.capacity() >= maxSize) {
+        throw std::runtime_error("decompressed tile exceeds the size limit");
+    }
+    pooled_buffer larger = pool.acquire(buffer.capacity() * 2);
+    std::memcpy(larger.data(), buffer.data(), buffer.size());
+    larger.resize(buffer.size());
+    buffer = std::move(larger);
+}
+
+inline decompressed_tile tile_decompressor::decompress(protozero::data_view const& data) {
+    switch (detectCompression(data)) {
+    case TILE_GZIP: {
+        // The gzip trailer holds the uncompressed size modulo 2^32.
+        std::size_t size_hint = 0;
+        if (data.size() >= 18) {
+            const auto* end = reinterpret_cast<const unsigned char*>(data.data() + data.size());
+            size_hint = std::size_t(end[-4]) | std::size_t(end[-3]) << 8 | std::size_t(end[-2]) << 16 | std::size_t(end[-1]) << 24;
+        }
+        return inflate(data, size_hint);
+    }
+    case TILE_ZLIB:
+        return inflate(data, data.size() * 4);
+    case TILE_ZSTD:
+        return decompressZstd(data);
+    case TILE_UNCOMPRESSED:
+    default:
+        return decompressed_tile(data);
+    }
+}
+
+inline decompressed_tile tile_decompressor::inflate(protozero::data_view const& data, std::size_t size_hint) {
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+    if (data.size() > std::numeric_limits<uInt>::max()) {
+        throw std::runtime_error("compressed tile too large");
+    }
+    // Window bits of 15 + 32 accept both gzip and zlib headers.
+    if (!zlibReady) {
+        if (inflateInit2(&zlibStream, 15 + 32) != Z_OK) {
+            throw std::runtime_error("could not initialize zlib");
+        }
+        zlibReady = true;
+    } else if (inflateReset(&zlibStream) != Z_OK) {
+        throw std::runtime_error("could not reset zlib");
+    }
+    pooled_buffer output = pool.acquire(std::min(std::max<std::size_t>(size_hint, 1), maxSize));
+    zlibStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zlibStream.avail_in = static_cast<uInt>(data.size());
+    for (;;) {
+        const std::size_t available = std::min<std::size_t>(output.capacity() - output.size(), std::numeric_limits<uInt>::max());
+        zlibStream.next_out = reinterpret_cast<Bytef*>(output.data() + output.size());
+        zlibStream.avail_out = static_cast<uInt>(available);
+        const int result = ::inflate(&zlibStream, Z_NO_FLUSH);
+        output.resize(output.size() + available - zlibStream.avail_out);
+        if (result == Z_STREAM_END) {
+            break;
+        }
+        if (result == Z_BUF_ERROR && zlibStream.avail_in == 0) {
+            throw std::runtime_error("compressed tile is truncated");
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            throw std::runtime_error(zlibStream.msg ? zlibStream.msg : "invalid compressed tile");
+        }
+        if (output.size() > maxSize) {
+            throw std::runtime_error("decompressed tile exceeds the size limit");
+        }
+        if (output.size() == output.capacity()) {
+            grow(output);
+        }
+    }
+    if (output.size() > maxSize) {
+        throw std::runtime_error("decompressed tile exceeds the size limit");
+    }
+    return decompressed_tile(std::move(output));
+#else
+    (void)data;
+    (void)size_hint;
+    throw std::runtime_error("gzip support is not enabled");
+#endif
+}
+
+inline decompressed_tile tile_decompressor::decompressZstd(protozero::data_view const& data) {
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+    if (!zstdContext) {
+        zstdContext = ZSTD_createDCtx();
+        if (!zstdContext) {
+            throw std::runtime_error("could not initialize zstd");
+        }
+    }
+    ZSTD_DCtx_reset(zstdContext, ZSTD_reset_session_only);
+    ZSTD_DCtx_refDDict(zstdContext, zstdDictionary);
+
+    std::size_t size_hint = data.size() * 4;
+    const unsigned long long content_size = ZSTD_getFrameContentSize(data.data(), data.size());
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR) {
+        if (content_size > maxSize) {
+            throw std::runtime_error("decompressed tile exceeds the size limit");
+        }
+        size_hint = static_cast<std::size_t>(content_size);
+    }
+    pooled_buffer output = pool.acquire(std::min(std::max<std::size_t>(size_hint, 1), maxSize));
+    ZSTD_inBuffer input{ data.data(), data.size(), 0 };
+    for (;;) {
+        ZSTD_outBuffer out{ output.data(), output.capacity(), output.size() };
+        const std::size_t result = ZSTD_decompressStream(zstdContext, &out, &input);
+        if (ZSTD_isError(result)) {
+            throw std::runtime_error(ZSTD_getErrorName(result));
+        }
+        output.resize(out.pos);
+        if (result == 0) {
+            break;
+        }
+        if (input.pos == input.size && out.pos < out.size) {
+            throw std::runtime_error("compressed tile is truncated");
+        }
+        if (output.size() == output.capacity()) {
+            grow(output);
+        }
+    }
+    return decompressed_tile(std::move(output));
+#else
+    (void)data;
+    throw std::runtime_error("zstd support is not enabled");
+#endif
+}
+
+}} // namespace mapbox/vector_tile
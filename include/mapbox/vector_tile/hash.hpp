@@ -0,0 +1,20 @@
+#pragma once
+
+#include <protozero/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mapbox { namespace vector_tile {
+
+/// 64 bit FNV-1a hash of tile data, to recognize derived files of a tile. Not cryptographic.
+inline std::uint64_t hashTileData(protozero::data_view const& data) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        hash ^= static_cast<unsigned char>(data.data()[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+namespace mapbox { namespace vector_tile {
+
+namespace detail {
+
+// Position of (x, y) along the Hilbert curve filling a side x side grid,
+// side being a power of two.
+inline std::uint64_t hilbertIndex(std::uint64_t side, std::uint64_t x, std::uint64_t y) {
+    std::uint64_t d = 0;
+    for (std::uint64_t s = side / 2; s > 0; s /= 2) {
+        const std::uint64_t rx = (x & s) > 0 ? 1 : 0;
+        const std::uint64_t ry = (y & s) > 0 ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+} // namespace detail
+
+}} // namespace mapbox/vector_tile
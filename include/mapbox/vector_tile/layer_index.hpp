@@ -0,0 +1,298 @@
+#pragma once
+
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/hash.hpp>
+#include <protozero/pbf_reader.hpp>
+#include <protozero/pbf_writer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mapbox { namespace vector_tile {
+
+/**
+ * Sidecar index of the layers of a tile, computed once and stored next to
+ * the tile so that it can later be opened without scanning it:
+ *
+ *     std::string sidecar = tile_index::build(data).serialize();
+ *     ...
+ *     tile_index index = tile_index::parse(sidecar);
+ *     buffer tile(data, index);
+ *     layer roads = tile.getLayer("roads");
+ *
+ * Each entry records the name, position, version, extent and feature count
+ * of a layer. Built with tables, entries also list the features, keys and
+ * values, and getLayer() sets up layers from them instead of parsing the
+ * layer. Opening a tile only checks its size against the index, use
+ * matches() to compare the hash as well. A buffer refers to the entries of
+ * the index it was opened with, so the index has to outlive the buffer.
+ */
+class tile_index {
+public:
+    tile_index() = default;
+
+    /// Index the layers of a tile, with feature, key and value tables if requested.
+    static tile_index build(protozero::data_view const& tile, bool tables = true);
+    /// Read an index written by serialize().
+    static tile_index parse(protozero::data_view const& data);
+    std::string serialize() const;
+
+    /// Whether the index was built for the given tile data.
+    bool matches(protozero::data_view const& tile) const;
+    std::uint64_t tileSize() const { return tileSize_; }
+    std::uint64_t tileHash() const { return tileHash_; }
+    std::vector<layer_index_entry> const& getLayers() const { return layers; }
+    /// The entry of a layer, or nullptr.
+    layer_index_entry const* findLayer(std::string const& name) const;
+
+private:
+    friend class mapbox::vector_tile::buffer;
+
+    std::uint64_t tileSize_ = 0;
+    std::uint64_t tileHash_ = 0;
+    std::vector<layer_index_entry> layers;
+};
+
+namespace detail {
+
+// Field numbers of the index messages.
+enum TileIndexType : protozero::pbf_tag_type
+{
+    INDEX_VERSION = 1,
+    INDEX_TILE_SIZE = 2,
+    INDEX_TILE_HASH = 3,
+    INDEX_LAYERS = 4
+};
+
+enum LayerIndexType : protozero::pbf_tag_type
+{
+    INDEX_LAYER_NAME = 1,
+    INDEX_LAYER_OFFSET = 2,
+    INDEX_LAYER_LENGTH = 3,
+    INDEX_LAYER_VERSION = 4,
+    INDEX_LAYER_EXTENT = 5,
+    INDEX_LAYER_FEATURE_COUNT = 6,
+    INDEX_LAYER_HAS_TABLES = 7,
+    INDEX_LAYER_FEATURES = 8,
+    INDEX_LAYER_KEYS = 9,
+    INDEX_LAYER_VALUES = 10
+};
+
+constexpr std::uint32_t tile_index_version = 1;
+
+inline void addIndexTableEntry(std::vector<std::uint32_t>& table, protozero::data_view const& layer_view, protozero::data_view const& view) {
+    table.push_back(static_cast<std::uint32_t>(view.data() - layer_view.data()));
+    table.push_back(static_cast<std::uint32_t>(view.size()));
+}
+
+// Tables are written as the gap from the end of the previous entry and the
+// length, which keeps the varints short.
+inline void writeIndexTable(protozero::pbf_writer& writer, protozero::pbf_tag_type tag, std::vector<std::uint32_t> const& table) {
+    std::vector<std::uint32_t> deltas;
+    deltas.reserve(table.size());
+    std::uint32_t end = 0;
+    for (std::size_t i = 0; i + 1 < table.size(); i += 2) {
+        deltas.push_back(table[i] - end);
+        deltas.push_back(table[i + 1]);
+        end = table[i] + table[i + 1];
+    }
+    writer.add_packed_uint32(tag, deltas.begin(), deltas.end());
+}
+
+inline std::vector<std::uint32_t> readIndexTable(protozero::pbf_reader& reader) {
+    std::vector<std::uint32_t> table;
+    std::uint64_t end = 0;
+    bool is_offset = true;
+    for (const std::uint32_t value : reader.get_packed_uint32()) {
+        if (is_offset) {
+            end += value;
+            if (end > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::runtime_error("invalid tile index");
+            }
+            table.push_back(static_cast<std::uint32_t>(end));
+        } else {
+            table.push_back(value);
+            end += value;
+        }
+        is_offset = !is_offset;
+    }
+    if (!is_offset) {
+        throw std::runtime_error("invalid tile index");
+    }
+    return table;
+}
+
+} // namespace detail
+
+inline tile_index tile_index::build(protozero::data_view const& tile, bool tables) {
+    if (tile.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("tile too large to index");
+    }
+    tile_index index;
+    index.tileSize_ = tile.size();
+    index.tileHash_ = hashTileData(tile);
+    protozero::pbf_reader tile_reader(tile);
+    while (tile_reader.next(TileType::LAYERS)) {
+        const protozero::data_view layer_view = tile_reader.get_view();
+        // Decoding the layer checks it the same way as an unindexed buffer.
+        const layer decoded(layer_view);
+        layer_index_entry entry;
+        entry.name = decoded.getName();
+        entry.offset = static_cast<std::uint64_t>(layer_view.data() - tile.data());
+        entry.length = layer_view.size();
+        entry.version = decoded.getVersion();
+        entry.extent = decoded.getExtent();
+        entry.featureCount = static_cast<std::uint32_t>(decoded.featureCount());
+        entry.hasTables = tables;
+        if (tables) {
+            protozero::pbf_reader layer_reader(layer_view);
+            while (layer_reader.next()) {
+                switch (layer_reader.tag()) {
+                case LayerType::FEATURES:
+                    detail::addIndexTableEntry(entry.features, layer_view, layer_reader.get_view());
+                    break;
+                case LayerType::KEYS:
+                    detail::addIndexTableEntry(entry.keys, layer_view, layer_reader.get_view());
+                    break;
+                case LayerType::VALUES:
+                    detail::addIndexTableEntry(entry.values, layer_view, layer_reader.get_view());
+                    break;
+                default:
+                    layer_reader.skip();
+                    break;
+                }
+            }
+        }
+        index.layers.push_back(std::move(entry));
+    }
+    return index;
+}
+
+inline std::string tile_index::serialize() const {
+    std::string data;
+    protozero::pbf_writer writer(data);
+    writer.add_uint32(detail::INDEX_VERSION, detail::tile_index_version);
+    writer.add_uint64(detail::INDEX_TILE_SIZE, tileSize_);
+    writer.add_fixed64(detail::INDEX_TILE_HASH, tileHash_);
+    for (auto const& entry : layers) {
+        protozero::pbf_writer layer_writer(writer, detail::INDEX_LAYERS);
+        layer_writer.add_string(detail::INDEX_LAYER_NAME, entry.name);
+        layer_writer.add_uint64(detail::INDEX_LAYER_OFFSET, entry.offset);
+        layer_writer.add_uint64(detail::INDEX_LAYER_LENGTH, entry.length);
+        layer_writer.add_uint32(detail::INDEX_LAYER_VERSION, entry.version);
+        layer_writer.add_uint32(detail::INDEX_LAYER_EXTENT, entry.extent);
+        layer_writer.add_uint32(detail::INDEX_LAYER_FEATURE_COUNT, entry.featureCount);
+        if (entry.hasTables) {
+            layer_writer.add_bool(detail::INDEX_LAYER_HAS_TABLES, true);
+            detail::writeIndexTable(layer_writer, detail::INDEX_LAYER_FEATURES, entry.features);
+            detail::writeIndexTable(layer_writer, detail::INDEX_LAYER_KEYS, entry.keys);
+            detail::writeIndexTable(layer_writer, detail::INDEX_LAYER_VALUES, entry.values);
+        }
+    }
+    return data;
+}
+
+inline tile_index tile_index::parse(protozero::data_view const& data) {
+    tile_index index;
+    std::uint32_t version = 0;
+    protozero::pbf_reader reader(data);
+    while (reader.next()) {
+        switch (reader.tag()) {
+        case detail::INDEX_VERSION:
+            version = reader.get_uint32();
+            break;
+        case detail::INDEX_TILE_SIZE:
+            index.tileSize_ = reader.get_uint64();
+            break;
+        case detail::INDEX_TILE_HASH:
+            index.tileHash_ = reader.get_fixed64();
+            break;
+        case detail::INDEX_LAYERS: {
+            layer_index_entry entry;
+            protozero::pbf_reader layer_reader(reader.get_message());
+            while (layer_reader.next()) {
+                switch (layer_reader.tag()) {
+                case detail::INDEX_LAYER_NAME:
+                    entry.name = layer_reader.get_string();
+                    break;
+                case detail::INDEX_LAYER_OFFSET:
+                    entry.offset = layer_reader.get_uint64();
+                    break;
+                case detail::INDEX_LAYER_LENGTH:
+                    entry.length = layer_reader.get_uint64();
+                    break;
+                case detail::INDEX_LAYER_VERSION:
+                    entry.version = layer_reader.get_uint32();
+                    break;
+                case detail::INDEX_LAYER_EXTENT:
+                    entry.extent = layer_reader.get_uint32();
+                    break;
+                case detail::INDEX_LAYER_FEATURE_COUNT:
+                    entry.featureCount = layer_reader.get_uint32();
+                    break;
+                case detail::INDEX_LAYER_HAS_TABLES:
+                    entry.hasTables = layer_reader.get_bool();
+                    break;
+                case detail::INDEX_LAYER_FEATURES:
+                    entry.features = detail::readIndexTable(layer_reader);
+                    break;
+                case detail::INDEX_LAYER_KEYS:
+                    entry.keys = detail::readIndexTable(layer_reader);
+                    break;
+                case detail::INDEX_LAYER_VALUES:
+                    entry.values = detail::readIndexTable(layer_reader);
+                    break;
+                default:
+                    layer_reader.skip();
+                    break;
+                }
+            }
+            if (entry.hasTables && entry.features.size() != 2 * std::size_t(entry.featureCount)) {
+                throw std::runtime_error("invalid tile index");
+            }
+            index.layers.push_back(std::move(entry));
+            break;
+        }
+        default:
+            reader.skip();
+            break;
+        }
+    }
+    if (version != detail::tile_index_version) {
+        throw std::runtime_error("unsupported tile index version");
+    }
+    return index;
+}
+
+inline bool tile_index::matches(protozero::data_view const& tile) const {
+    return tile.size() == tileSize_ && hashTileData(tile) == tileHash_;
+}
+
+inline layer_index_entry const* tile_index::findLayer(std::string const& name) const {
+    for (auto const& entry : layers) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+inline buffer::buffer(protozero::data_view const& data, tile_index const& tile_index_)
+    : layers() {
+    if (data.size() != tile_index_.tileSize_) {
+        throw std::runtime_error("tile index does not match the tile");
+    }
+    for (auto const& entry : tile_index_.layers) {
+        if (entry.offset > data.size() || entry.length > data.size() - entry.offset) {
+            throw std::runtime_error("tile index does not match the tile");
+        }
+        const protozero::data_view layer_view(data.data() + entry.offset, static_cast<std::size_t>(entry.length));
+        layers.emplace(entry.name, layer_data{ layer_view, entry.hasTables ? &entry : nullptr });
+    }
+}
+
+}} // namespace mapbox/vector_tile
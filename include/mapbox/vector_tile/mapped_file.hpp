@@ -0,0 +1,167 @@
+#pragma once
+
+#include <protozero/types.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPBOX_VECTOR_TILE_HAS_MMAP 1
+#else
+#include <fstream>
+#endif
+
+namespace mapbox { namespace vector_tile {
+
+/**
+ * Read-only memory mapping of a file, unmapped on destruction.
+ *
+ * The contents are available through view() without being copied, so a
+ * tile file can be decoded in place:
+ *
+ *     mapped_file file("tile.mvt");
+ *     buffer tile(file.view());
+ *
+ * Data views taken from the mapping, including those held by a buffer,
+ * are only valid while the mapped_file exists. Where memory mapping is not
+ * available the file is read into memory instead.
+ */
+class mapped_file {
+public:
+    /// Hints on how the mapping will be accessed, may be combined.
+    enum advice : unsigned {
+        NORMAL = 0,
+        SEQUENTIAL = 1, ///< read front to back, enables aggressive read-ahead
+        WILLNEED = 2    ///< start reading the whole file in the background
+    };
+
+    explicit mapped_file(std::string const& path, unsigned hints = NORMAL);
+    ~mapped_file();
+
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    protozero::data_view view() const { return protozero::data_view(data_, size_); }
+
+private:
+    void release() noexcept;
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifndef MAPBOX_VECTOR_TILE_HAS_MMAP
+    std::string contents;
+#endif
+};
+
+#ifdef MAPBOX_VECTOR_TILE_HAS_MMAP
+
+inline mapped_file::mapped_file(std::string const& path, unsigned hints) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("could not open: '" + path + "'");
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("could not stat: '" + path + "'");
+    }
+    size_ = static_cast<std::size_t>(info.st_size);
+    if (size_ == 0) {
+        // Zero length mappings are not allowed, an empty file has no data.
+        ::close(fd);
+        return;
+    }
+    void* const address = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        size_ = 0;
+        throw std::runtime_error("could not map: '" + path + "'");
+    }
+    data_ = static_cast<const char*>(address);
+    // Advice only affects performance, failures are ignored.
+    if (hints & SEQUENTIAL) {
+        ::madvise(address, size_, MADV_SEQUENTIAL);
+    }
+    if (hints & WILLNEED) {
+        ::madvise(address, size_, MADV_WILLNEED);
+    }
+}
+
+inline void mapped_file::release() noexcept {
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
+
+inline mapped_file::mapped_file(mapped_file&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {
+}
+
+inline mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+#else
+
+inline mapped_file::mapped_file(std::string const& path, unsigned /*hints*/) {
+    std::ifstream stream(path.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!stream.is_open()) {
+        throw std::runtime_error("could not open: '" + path + "'");
+    }
+    stream.seekg(0, std::ios_base::end);
+    contents.resize(static_cast<std::size_t>(stream.tellg()));
+    stream.seekg(0, std::ios_base::beg);
+    stream.read(&contents[0], static_cast<std::streamsize>(contents.size()));
+    data_ = contents.data();
+    size_ = contents.size();
+}
+
+inline void mapped_file::release() noexcept {
+    contents.clear();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+inline mapped_file::mapped_file(mapped_file&& other) noexcept
+    : contents(std::move(other.contents)) {
+    data_ = contents.data();
+    size_ = contents.size();
+    other.release();
+}
+
+inline mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        contents = std::move(other.contents);
+        data_ = contents.data();
+        size_ = contents.size();
+        other.release();
+    }
+    return *this;
+}
+
+#endif
+
+inline mapped_file::~mapped_file() {
+    release();
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,388 @@
+#pragma once
+
+#include "hilbert.hpp"
+#include "mapped_file.hpp"
+#include <protozero/types.hpp>
+#include <protozero/varint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(MAPBOX_VECTOR_TILE_WITH_ZLIB) || defined(MAPBOX_VECTOR_TILE_WITH_ZSTD)
+#include "decompress.hpp"
+#endif
+
+namespace mapbox { namespace vector_tile {
+
+enum PMTilesCompression : std::uint8_t
+{
+    COMPRESSION_UNKNOWN = 0,
+    COMPRESSION_NONE = 1,
+    COMPRESSION_GZIP = 2,
+    COMPRESSION_BROTLI = 3,
+    COMPRESSION_ZSTD = 4
+};
+
+/**
+ * The fixed size header at the start of a PMTiles v3 archive. Offsets are
+ * from the start of the archive, coordinates in degrees times 10^7.
+ */
+struct pmtiles_header {
+    static constexpr std::size_t size = 127;
+
+    std::uint64_t rootDirectoryOffset = 0;
+    std::uint64_t rootDirectoryLength = 0;
+    std::uint64_t metadataOffset = 0;
+    std::uint64_t metadataLength = 0;
+    std::uint64_t leafDirectoriesOffset = 0;
+    std::uint64_t leafDirectoriesLength = 0;
+    std::uint64_t tileDataOffset = 0;
+    std::uint64_t tileDataLength = 0;
+    std::uint64_t addressedTiles = 0;
+    std::uint64_t tileEntries = 0;
+    std::uint64_t tileContents = 0;
+    bool clustered = false;
+    std::uint8_t internalCompression = COMPRESSION_UNKNOWN;
+    std::uint8_t tileCompression = COMPRESSION_UNKNOWN;
+    std::uint8_t tileType = 0;
+    std::uint8_t minZoom = 0;
+    std::uint8_t maxZoom = 0;
+    std::int32_t minLon = 0;
+    std::int32_t minLat = 0;
+    std::int32_t maxLon = 0;
+    std::int32_t maxLat = 0;
+    std::uint8_t centerZoom = 0;
+    std::int32_t centerLon = 0;
+    std::int32_t centerLat = 0;
+
+    static pmtiles_header parse(protozero::data_view const& data);
+};
+
+/**
+ * A directory entry. Entries with a run length of 0 point to a leaf
+ * directory, all others to the data of runLength consecutive tile ids.
+ */
+struct pmtiles_entry {
+    std::uint64_t tileId;
+    std::uint64_t offset;
+    std::uint32_t length;
+    std::uint32_t runLength;
+};
+
+/**
+ * Reads tiles from a PMTiles v3 archive.
+ *
+ * The archive is memory mapped and tiles are returned as views into the
+ * mapping, ready to be passed to buffer when the archive holds uncompressed
+ * vector tiles. The root directory is decoded when the archive is opened.
+ * Leaf directories are decoded on first use and kept in a small cache that
+ * evicts the least recently used ones approximately, with a second chance
+ * scheme. Directories may be gzip or zstd compressed when support for the
+ * compression is enabled in decompress.hpp.
+ *
+ * getTile and getMetadata may be called concurrently from any number of
+ * threads. Cache lookups and updates use atomic operations only and never
+ * wait: a reader pins a cache slot with a counter while searching it, and a
+ * slot is only replaced when nobody has it pinned. Concurrent misses on the
+ * same leaf directory may decode it more than once.
+ */
+class pmtiles_reader {
+public:
+    explicit pmtiles_reader(std::string const& path, std::size_t cache_size = 64);
+    /// Read an archive held in memory, which has to outlive the reader.
+    explicit pmtiles_reader(protozero::data_view const& archive, std::size_t cache_size = 64);
+
+    /// Tile id of a tile, its position along the Hilbert curves of all zoom levels.
+    static std::uint64_t tileId(std::uint8_t z, std::uint32_t x, std::uint32_t y);
+
+    pmtiles_header const& getHeader() const { return header; }
+    protozero::data_view getMetadata() const;
+    /// The data of a tile, empty if the archive does not contain it.
+    std::optional<protozero::data_view> getTile(std::uint8_t z, std::uint32_t x, std::uint32_t y) const;
+    std::optional<protozero::data_view> getTile(std::uint64_t tile_id) const;
+
+private:
+    struct cache_slot {
+        // Number of readers searching the directory, or `replacing`.
+        std::atomic<std::uint32_t> users{ 0 };
+        std::atomic<bool> referenced{ false };
+        // Only changed while users is `replacing`.
+        std::uint64_t offset = std::numeric_limits<std::uint64_t>::max();
+        std::vector<pmtiles_entry> entries;
+    };
+
+    static constexpr std::size_t cache_ways = 4;
+    static constexpr std::uint32_t replacing = std::numeric_limits<std::uint32_t>::max();
+
+    void open(std::size_t cache_size);
+    protozero::data_view section(std::uint64_t offset, std::uint64_t length) const;
+    // Decompress a directory with the internal compression of the archive and decode it.
+    void readDirectory(protozero::data_view const& data, std::vector<pmtiles_entry>& entries) const;
+    std::optional<pmtiles_entry> findInLeaf(std::uint64_t offset, std::uint64_t length, std::uint64_t tile_id) const;
+
+    std::optional<mapped_file> file;
+    protozero::data_view archive;
+    pmtiles_header header;
+    std::vector<pmtiles_entry> root;
+    std::unique_ptr<cache_slot[]> cache;
+    std::size_t cacheSets = 0;
+};
+
+namespace detail {
+
+template <typename T>
+inline T readLittleEndian(const char* data) {
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i));
+    }
+    return value;
+}
+
+inline void decodeDirectory(protozero::data_view const& data, std::vector<pmtiles_entry>& entries) {
+    const char* pos = data.data();
+    const char* const end = data.data() + data.size();
+    const std::uint64_t count = protozero::decode_varint(&pos, end);
+    // Every entry takes at least four bytes.
+    if (count > data.size() / 4) {
+        throw std::runtime_error("PMTiles directory is truncated");
+    }
+    entries.resize(static_cast<std::size_t>(count));
+    std::uint64_t tile_id = 0;
+    for (auto& entry : entries) {
+        tile_id += protozero::decode_varint(&pos, end);
+        entry.tileId = tile_id;
+    }
+    for (auto& entry : entries) {
+        entry.runLength = static_cast<std::uint32_t>(protozero::decode_varint(&pos, end));
+    }
+    for (auto& entry : entries) {
+        entry.length = static_cast<std::uint32_t>(protozero::decode_varint(&pos, end));
+    }
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const std::uint64_t value = protozero::decode_varint(&pos, end);
+        // 0 means the data directly follows that of the previous entry.
+        if (value == 0 && i > 0) {
+            entries[i].offset = entries[i - 1].offset + entries[i - 1].length;
+        } else if (value == 0) {
+            throw std::runtime_error("PMTiles directory starts with a relative offset");
+        } else {
+            entries[i].offset = value - 1;
+        }
+    }
+}
+
+// The entry responsible for a tile id, if there is one.
+inline std::optional<pmtiles_entry> findEntry(std::vector<pmtiles_entry> const& entries, std::uint64_t tile_id) {
+    auto it = std::upper_bound(entries.begin(), entries.end(), tile_id,
+                               [](std::uint64_t id, pmtiles_entry const& entry) { return id < entry.tileId; });
+    if (it == entries.begin()) {
+        return std::nullopt;
+    }
+    --it;
+    if (it->runLength == 0 || tile_id - it->tileId < it->runLength) {
+        return *it;
+    }
+    return std::nullopt;
+}
+
+} // namespace detail
+
+inline pmtiles_header pmtiles_header::parse(protozero::data_view const& data) {
+    if (data.size() < size || std::memcmp(data.data(), "PMTiles", 7) != 0) {
+        throw std::runtime_error("not a PMTiles archive");
+    }
+    if (data.data()[7] != 3) {
+        throw std::runtime_error("unsupported PMTiles version");
+    }
+    const char* d = data.data();
+    pmtiles_header h;
+    h.rootDirectoryOffset = detail::readLittleEndian<std::uint64_t>(d + 8);
+    h.rootDirectoryLength = detail::readLittleEndian<std::uint64_t>(d + 16);
+    h.metadataOffset = detail::readLittleEndian<std::uint64_t>(d + 24);
+    h.metadataLength = detail::readLittleEndian<std::uint64_t>(d + 32);
+    h.leafDirectoriesOffset = detail::readLittleEndian<std::uint64_t>(d + 40);
+    h.leafDirectoriesLength = detail::readLittleEndian<std::uint64_t>(d + 48);
+    h.tileDataOffset = detail::readLittleEndian<std::uint64_t>(d + 56);
+    h.tileDataLength = detail::readLittleEndian<std::uint64_t>(d + 64);
+    h.addressedTiles = detail::readLittleEndian<std::uint64_t>(d + 72);
+    h.tileEntries = detail::readLittleEndian<std::uint64_t>(d + 80);
+    h.tileContents = detail::readLittleEndian<std::uint64_t>(d + 88);
+    h.clustered = d[96] != 0;
+    h.internalCompression = static_cast<std::uint8_t>(d[97]);
+    h.tileCompression = static_cast<std::uint8_t>(d[98]);
+    h.tileType = static_cast<std::uint8_t>(d[99]);
+    h.minZoom = static_cast<std::uint8_t>(d[100]);
+    h.maxZoom = static_cast<std::uint8_t>(d[101]);
+    h.minLon = detail::readLittleEndian<std::int32_t>(d + 102);
+    h.minLat = detail::readLittleEndian<std::int32_t>(d + 106);
+    h.maxLon = detail::readLittleEndian<std::int32_t>(d + 110);
+    h.maxLat = detail::readLittleEndian<std::int32_t>(d + 114);
+    h.centerZoom = static_cast<std::uint8_t>(d[118]);
+    h.centerLon = detail::readLittleEndian<std::int32_t>(d + 119);
+    h.centerLat = detail::readLittleEndian<std::int32_t>(d + 123);
+    return h;
+}
+
+inline pmtiles_reader::pmtiles_reader(std::string const& path, std::size_t cache_size)
+    : file(std::in_place, path) {
+    archive = file->view();
+    open(cache_size);
+}
+
+inline pmtiles_reader::pmtiles_reader(protozero::data_view const& archive_, std::size_t cache_size)
+    : archive(archive_) {
+    open(cache_size);
+}
+
+inline void pmtiles_reader::open(std::size_t cache_size) {
+    header = pmtiles_header::parse(archive);
+    switch (header.internalCompression) {
+    case COMPRESSION_NONE:
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+    case COMPRESSION_GZIP:
+#endif
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+    case COMPRESSION_ZSTD:
+#endif
+        break;
+    default:
+        throw std::runtime_error("unsupported PMTiles directory compression");
+    }
+    // Check the sections once, entries are checked against them on use.
+    section(header.metadataOffset, header.metadataLength);
+    section(header.leafDirectoriesOffset, header.leafDirectoriesLength);
+    section(header.tileDataOffset, header.tileDataLength);
+    readDirectory(section(header.rootDirectoryOffset, header.rootDirectoryLength), root);
+
+    cacheSets = std::max<std::size_t>(1, (cache_size + cache_ways - 1) / cache_ways);
+    cache.reset(new cache_slot[cacheSets * cache_ways]);
+}
+
+inline std::uint64_t pmtiles_reader::tileId(std::uint8_t z, std::uint32_t x, std::uint32_t y) {
+    if (z > 31) {
+        throw std::runtime_error("zoom level out of range");
+    }
+    const std::uint64_t side = std::uint64_t(1) << z;
+    if (x >= side || y >= side) {
+        throw std::runtime_error("tile coordinates out of range");
+    }
+    // Ids of all tiles of lower zoom levels come first.
+    const std::uint64_t base = (side * side - 1) / 3;
+    return base + detail::hilbertIndex(side, x, y);
+}
+
+inline protozero::data_view pmtiles_reader::section(std::uint64_t offset, std::uint64_t length) const {
+    if (offset > archive.size() || length > archive.size() - offset) {
+        throw std::runtime_error("PMTiles archive is truncated");
+    }
+    return protozero::data_view(archive.data() + offset, static_cast<std::size_t>(length));
+}
+
+inline protozero::data_view pmtiles_reader::getMetadata() const {
+    return section(header.metadataOffset, header.metadataLength);
+}
+
+inline void pmtiles_reader::readDirectory(protozero::data_view const& data, std::vector<pmtiles_entry>& entries) const {
+    if (header.internalCompression == COMPRESSION_NONE) {
+        detail::decodeDirectory(data, entries);
+        return;
+    }
+#if defined(MAPBOX_VECTOR_TILE_WITH_ZLIB) || defined(MAPBOX_VECTOR_TILE_WITH_ZSTD)
+    const TileCompression expected = header.internalCompression == COMPRESSION_GZIP ? TILE_GZIP : TILE_ZSTD;
+    if (detectCompression(data) != expected) {
+        throw std::runtime_error("PMTiles directory is not compressed as declared");
+    }
+    // Decompressors must not be shared between threads. Directories are only
+    // read on open and on cache misses, so each read sets up its own.
+    buffer_pool pool(1);
+    tile_decompressor decompressor(pool);
+    detail::decodeDirectory(decompressor.decompress(data).view(), entries);
+#else
+    throw std::runtime_error("unsupported PMTiles directory compression");
+#endif
+}
+
+inline std::optional<pmtiles_entry> pmtiles_reader::findInLeaf(std::uint64_t offset, std::uint64_t length, std::uint64_t tile_id) const {
+    cache_slot* const set = cache.get() + (std::hash<std::uint64_t>()(offset) % cacheSets) * cache_ways;
+    for (std::size_t i = 0; i < cache_ways; ++i) {
+        cache_slot& slot = set[i];
+        std::uint32_t users = slot.users.load(std::memory_order_relaxed);
+        do {
+            if (users == replacing) {
+                break;
+            }
+        } while (!slot.users.compare_exchange_weak(users, users + 1, std::memory_order_acquire, std::memory_order_relaxed));
+        if (users == replacing) {
+            continue;
+        }
+        std::optional<pmtiles_entry> entry;
+        const bool hit = slot.offset == offset;
+        if (hit) {
+            entry = detail::findEntry(slot.entries, tile_id);
+            slot.referenced.store(true, std::memory_order_relaxed);
+        }
+        slot.users.fetch_sub(1, std::memory_order_release);
+        if (hit) {
+            return entry;
+        }
+    }
+
+    if (offset > header.leafDirectoriesLength || length > header.leafDirectoriesLength - offset) {
+        throw std::runtime_error("PMTiles leaf directory out of range");
+    }
+    std::vector<pmtiles_entry> entries;
+    readDirectory(section(header.leafDirectoriesOffset + offset, length), entries);
+    const std::optional<pmtiles_entry> entry = detail::findEntry(entries, tile_id);
+
+    // Replace the first slot not used since the last pass, clearing the
+    // marks of the ones passed over. If it is in use, the directory is
+    // just not cached.
+    std::size_t victim = 0;
+    for (std::size_t i = 0; i < 2 * cache_ways; ++i) {
+        if (!set[i % cache_ways].referenced.exchange(false, std::memory_order_relaxed)) {
+            victim = i % cache_ways;
+            break;
+        }
+    }
+    cache_slot& slot = set[victim];
+    std::uint32_t idle = 0;
+    if (slot.users.compare_exchange_strong(idle, replacing, std::memory_order_acquire, std::memory_order_relaxed)) {
+        slot.offset = offset;
+        slot.entries.swap(entries);
+        slot.users.store(0, std::memory_order_release);
+    }
+    return entry;
+}
+
+inline std::optional<protozero::data_view> pmtiles_reader::getTile(std::uint8_t z, std::uint32_t x, std::uint32_t y) const {
+    return getTile(tileId(z, x, y));
+}
+
+inline std::optional<protozero::data_view> pmtiles_reader::getTile(std::uint64_t tile_id) const {
+    std::optional<pmtiles_entry> entry = detail::findEntry(root, tile_id);
+    // The specification allows up to three levels of leaf directories.
+    for (int depth = 0; entry && depth < 4; ++depth) {
+        if (entry->runLength > 0) {
+            if (entry->offset > header.tileDataLength || entry->length > header.tileDataLength - entry->offset) {
+                throw std::runtime_error("PMTiles tile out of range");
+            }
+            return protozero::data_view(archive.data() + header.tileDataOffset + entry->offset, entry->length);
+        }
+        entry = findInLeaf(entry->offset, entry->length, tile_id);
+    }
+    return std::nullopt;
+}
+
+}} // namespace mapbox/vector_tile
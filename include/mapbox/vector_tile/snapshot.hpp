@@ -0,0 +1,701 @@
+#pragma once
+
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/hash.hpp>
+#include <protozero/pbf_reader.hpp>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+namespace mapbox { namespace vector_tile {
+
+using snapshot_point = mapbox::geometry::point<std::int32_t>;
+
+/**
+ * Triangulates a polygon feature for a snapshot, returning three indices per
+ * triangle into the points of the feature in snapshot order, which is the
+ * order of feature::getGeometries flattened.
+ */
+using snapshot_triangulator = std::function<std::vector<std::uint32_t>(feature const&)>;
+
+namespace detail {
+
+// Snapshot image layout, all offsets are from the start of the image and
+// all sections are 8 byte aligned:
+//
+//   snapshot_header
+//   snapshot_layer_record[layerCount]
+//   per layer: features, keys, values, ring ends, points, tags, triangles
+//   string pool
+constexpr std::uint32_t snapshot_version = 1;
+constexpr std::uint32_t snapshot_byte_order = 0x01020304;
+constexpr char snapshot_magic[8] = { 'M', 'V', 'T', 'S', 'N', 'A', 'P', '\0' };
+
+struct snapshot_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t layerCount;
+    std::uint32_t reserved;
+    std::uint64_t sourceHash;
+    std::uint64_t sourceSize;
+    std::uint64_t size;
+    std::uint64_t layers;
+    std::uint64_t strings;
+    std::uint64_t stringsSize;
+};
+
+// A string in the string pool.
+struct snapshot_string {
+    std::uint64_t offset;
+    std::uint64_t length;
+};
+
+enum SnapshotValueType : std::uint32_t
+{
+    SNAPSHOT_NULL = 0,
+    SNAPSHOT_BOOL = 1,
+    SNAPSHOT_UINT = 2,
+    SNAPSHOT_INT = 3,
+    SNAPSHOT_DOUBLE = 4,
+    SNAPSHOT_STRING = 5
+};
+
+// A value, payload holds the bits of the number or the string pool offset.
+struct snapshot_value {
+    std::uint32_t type;
+    std::uint32_t length;
+    std::uint64_t payload;
+};
+
+struct snapshot_feature_record {
+    std::uint64_t id;
+    std::uint32_t type;
+    std::uint32_t hasId;
+    std::uint32_t firstRing;
+    std::uint32_t ringCount;
+    std::uint32_t firstPoint;
+    std::uint32_t pointCount;
+    std::uint32_t firstTag;
+    std::uint32_t tagCount;
+    std::uint32_t firstTriangle;
+    std::uint32_t triangleCount;
+};
+
+struct snapshot_layer_record {
+    snapshot_string name;
+    std::uint32_t version;
+    std::uint32_t extent;
+    std::uint64_t featureCount;
+    std::uint64_t keyCount;
+    std::uint64_t valueCount;
+    std::uint64_t ringCount;
+    std::uint64_t pointCount;
+    std::uint64_t tagCount;
+    std::uint64_t triangleCount;
+    std::uint64_t features;
+    std::uint64_t keys;
+    std::uint64_t values;
+    std::uint64_t rings;
+    std::uint64_t points;
+    std::uint64_t tags;
+    std::uint64_t triangles;
+};
+
+inline std::size_t alignSnapshot(std::size_t size) {
+    return (size + 7) & ~std::size_t(7);
+}
+
+} // namespace detail
+
+class tile_snapshot;
+class snapshot_feature;
+
+/// A layer of a tile_snapshot, its tables are views into the snapshot.
+class snapshot_layer {
+public:
+    std::string_view getName() const;
+    std::uint32_t getVersion() const { return record->version; }
+    std::uint32_t getExtent() const { return record->extent; }
+    std::size_t featureCount() const { return record->featureCount; }
+    std::size_t keyCount() const { return record->keyCount; }
+    std::size_t valueCount() const { return record->valueCount; }
+    std::string_view getKey(std::size_t i) const;
+    mapbox::feature::value getValue(std::size_t i) const;
+    snapshot_feature getFeature(std::size_t i) const;
+
+private:
+    friend class tile_snapshot;
+    friend class snapshot_feature;
+    snapshot_layer(tile_snapshot const& snapshot, detail::snapshot_layer_record const& record);
+
+    template <typename T>
+    const T* section(std::uint64_t offset) const;
+
+    tile_snapshot const* snapshot;
+    detail::snapshot_layer_record const* record;
+};
+
+/// A feature of a snapshot layer, its geometry and tags are views into the snapshot.
+class snapshot_feature {
+public:
+    GeomType getType() const { return static_cast<GeomType>(record->type); }
+    mapbox::feature::identifier getID() const;
+    std::size_t ringCount() const { return record->ringCount; }
+    /// Points of a ring, rings are the paths of feature::getGeometries.
+    std::span<const snapshot_point> getRing(std::size_t i) const;
+    /// All points of the feature, ring after ring.
+    std::span<const snapshot_point> getPoints() const;
+    /// Key and value index pairs as in the encoded tile.
+    std::span<const std::uint32_t> getTags() const;
+    /// Triangle indices into getPoints(), empty if not triangulated.
+    std::span<const std::uint32_t> getTriangles() const;
+    feature::properties_type getProperties() const;
+
+private:
+    friend class snapshot_layer;
+    snapshot_feature(snapshot_layer const& layer, detail::snapshot_feature_record const& record);
+
+    snapshot_layer layer_;
+    detail::snapshot_feature_record const* record;
+};
+
+/**
+ * A decoded tile in a relocatable binary image that is used in place, with
+ * columnar geometry, key and value tables, tags and optional triangulation.
+ * Restoring a tile maps the image and does no protobuf parsing:
+ *
+ *     saveSnapshot("tile.snapshot", createSnapshot(tile_data));
+ *     ...
+ *     mapped_file file("tile.snapshot");
+ *     tile_snapshot snapshot(file.view(), tile_data);
+ *
+ * A snapshot is checked against the hash of the tile it was made from, its
+ * layout is checked when opened and when features are accessed. The image
+ * must be 8 byte aligned and outlive the snapshot.
+ */
+class tile_snapshot {
+public:
+    /// Open a snapshot image made from the given tile data.
+    tile_snapshot(protozero::data_view const& image, protozero::data_view const& source);
+    /// Open a snapshot image made from a tile with the given hashSource().
+    tile_snapshot(protozero::data_view const& image, std::uint64_t source_hash);
+
+    /// Hash of tile data identifying the source of a snapshot, not cryptographic.
+    static std::uint64_t hashSource(protozero::data_view const& data);
+
+    std::uint64_t sourceHash() const { return header().sourceHash; }
+    std::size_t layerCount() const { return header().layerCount; }
+    std::vector<std::string> layerNames() const;
+    snapshot_layer getLayer(std::size_t i) const;
+    snapshot_layer getLayer(std::string const& name) const;
+
+private:
+    friend class snapshot_layer;
+    friend class snapshot_feature;
+
+    detail::snapshot_header const& header() const {
+        return *reinterpret_cast<detail::snapshot_header const*>(image.data());
+    }
+    std::string_view getString(detail::snapshot_string const& string) const;
+    // Whether count elements of size bytes at offset lie within the image.
+    bool inRange(std::uint64_t offset, std::uint64_t count, std::size_t size) const;
+
+    protozero::data_view image;
+};
+
+/// Decode a tile into a snapshot image, triangulating polygons if given a triangulator.
+std::string createSnapshot(protozero::data_view const& tile, snapshot_triangulator const& triangulate = nullptr);
+
+/// Write a snapshot image with a single write, replacing the file atomically.
+void saveSnapshot(std::string const& path, std::string const& image);
+
+namespace detail {
+
+struct snapshot_layer_builder {
+    snapshot_layer_record record{};
+    std::vector<snapshot_feature_record> features;
+    std::vector<snapshot_string> keys;
+    std::vector<snapshot_value> values;
+    std::vector<std::uint32_t> rings;
+    std::vector<snapshot_point> points;
+    std::vector<std::uint32_t> tags;
+    std::vector<std::uint32_t> triangles;
+};
+
+// Collects rings the way feature::getGeometries builds paths.
+struct snapshot_geometry_visitor {
+    std::vector<std::uint32_t>& rings;
+    std::vector<snapshot_point>& points;
+    std::size_t ringStart;
+
+    void moveTo(std::int64_t x, std::int64_t y) {
+        if (points.size() > ringStart) {
+            rings.push_back(static_cast<std::uint32_t>(points.size()));
+            ringStart = points.size();
+        }
+        lineTo(x, y);
+    }
+    void lineTo(std::int64_t x, std::int64_t y) {
+        if (x < std::numeric_limits<std::int32_t>::min() || x > std::numeric_limits<std::int32_t>::max() ||
+            y < std::numeric_limits<std::int32_t>::min() || y > std::numeric_limits<std::int32_t>::max()) {
+            throw std::runtime_error("paths outside valid range of coordinate_type");
+        }
+        points.emplace_back(static_cast<std::int32_t>(x), static_cast<std::int32_t>(y));
+    }
+    void closePath() {
+        if (points.size() > ringStart) {
+            points.push_back(points[ringStart]);
+        }
+    }
+    void finish() {
+        if (points.size() > ringStart) {
+            rings.push_back(static_cast<std::uint32_t>(points.size()));
+        }
+    }
+};
+
+inline snapshot_string addSnapshotString(std::string& pool, protozero::data_view const& string) {
+    const snapshot_string result{ pool.size(), string.size() };
+    pool.append(string.data(), string.size());
+    return result;
+}
+
+inline snapshot_value parseSnapshotValue(protozero::data_view const& value_view, std::string& pool) {
+    snapshot_value value{ SNAPSHOT_NULL, 0, 0 };
+    protozero::pbf_reader value_reader(value_view);
+    while (value_reader.next()) {
+        switch (value_reader.tag()) {
+        case ValueType::STRING: {
+            const auto string = addSnapshotString(pool, value_reader.get_view());
+            value = snapshot_value{ SNAPSHOT_STRING, static_cast<std::uint32_t>(string.length), string.offset };
+            break;
+        }
+        case ValueType::FLOAT:
+            value = snapshot_value{ SNAPSHOT_DOUBLE, 0, std::bit_cast<std::uint64_t>(static_cast<double>(value_reader.get_float())) };
+            break;
+        case ValueType::DOUBLE:
+            value = snapshot_value{ SNAPSHOT_DOUBLE, 0, std::bit_cast<std::uint64_t>(value_reader.get_double()) };
+            break;
+        case ValueType::INT:
+            value = snapshot_value{ SNAPSHOT_INT, 0, static_cast<std::uint64_t>(value_reader.get_int64()) };
+            break;
+        case ValueType::UINT:
+            value = snapshot_value{ SNAPSHOT_UINT, 0, value_reader.get_uint64() };
+            break;
+        case ValueType::SINT:
+            value = snapshot_value{ SNAPSHOT_INT, 0, static_cast<std::uint64_t>(value_reader.get_sint64()) };
+            break;
+        case ValueType::BOOL:
+            value = snapshot_value{ SNAPSHOT_BOOL, 0, value_reader.get_bool() ? 1u : 0u };
+            break;
+        default:
+            value_reader.skip();
+            break;
+        }
+    }
+    return value;
+}
+
+inline snapshot_layer_builder buildSnapshotLayer(protozero::data_view const& layer_view, std::string& pool, snapshot_triangulator const& triangulate) {
+    const layer source(layer_view);
+    snapshot_layer_builder builder;
+    builder.record.name = addSnapshotString(pool, protozero::data_view(source.getName()));
+    builder.record.version = source.getVersion();
+    builder.record.extent = source.getExtent();
+
+    protozero::pbf_reader layer_pbf(layer_view);
+    while (layer_pbf.next()) {
+        switch (layer_pbf.tag()) {
+        case LayerType::KEYS:
+            builder.keys.push_back(addSnapshotString(pool, layer_pbf.get_view()));
+            break;
+        case LayerType::VALUES:
+            builder.values.push_back(parseSnapshotValue(layer_pbf.get_view(), pool));
+            break;
+        default:
+            layer_pbf.skip();
+            break;
+        }
+    }
+
+    builder.features.reserve(source.featureCount());
+    for (std::size_t i = 0; i < source.featureCount(); ++i) {
+        const feature f(source.getFeature(i), source);
+        snapshot_feature_record record{};
+        record.type = f.getType();
+        const auto& id = f.getID();
+        if (std::holds_alternative<std::uint64_t>(id)) {
+            record.id = std::get<std::uint64_t>(id);
+            record.hasId = 1;
+        }
+
+        record.firstTag = static_cast<std::uint32_t>(builder.tags.size());
+        protozero::pbf_reader feature_pbf(source.getFeature(i));
+        while (feature_pbf.next(FeatureType::TAGS)) {
+            for (const std::uint32_t tag : feature_pbf.get_packed_uint32()) {
+                builder.tags.push_back(tag);
+            }
+        }
+        if ((builder.tags.size() - record.firstTag) % 2 != 0) {
+            throw std::runtime_error("uneven number of feature tag ids");
+        }
+        for (std::size_t t = record.firstTag; t < builder.tags.size(); t += 2) {
+            if (builder.tags[t] >= builder.keys.size()) {
+                throw std::runtime_error("feature referenced out of range key");
+            }
+            if (builder.tags[t + 1] >= builder.values.size()) {
+                throw std::runtime_error("feature referenced out of range value");
+            }
+        }
+        record.tagCount = static_cast<std::uint32_t>(builder.tags.size() - record.firstTag);
+
+        record.firstRing = static_cast<std::uint32_t>(builder.rings.size());
+        record.firstPoint = static_cast<std::uint32_t>(builder.points.size());
+        snapshot_geometry_visitor visitor{ builder.rings, builder.points, builder.points.size() };
+        f.walkGeometry(visitor);
+        visitor.finish();
+        record.ringCount = static_cast<std::uint32_t>(builder.rings.size() - record.firstRing);
+        record.pointCount = static_cast<std::uint32_t>(builder.points.size() - record.firstPoint);
+
+        record.firstTriangle = static_cast<std::uint32_t>(builder.triangles.size());
+        if (triangulate && f.getType() == GeomType::POLYGON) {
+            const std::vector<std::uint32_t> indices = triangulate(f);
+            for (const std::uint32_t index : indices) {
+                if (index >= record.pointCount) {
+                    throw std::runtime_error("triangle index out of range");
+                }
+            }
+            builder.triangles.insert(builder.triangles.end(), indices.begin(), indices.end());
+        }
+        record.triangleCount = static_cast<std::uint32_t>(builder.triangles.size() - record.firstTriangle);
+        builder.features.push_back(record);
+    }
+    if (builder.points.size() > std::numeric_limits<std::uint32_t>::max() || builder.tags.size() > std::numeric_limits<std::uint32_t>::max() ||
+        builder.triangles.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("layer too large for a snapshot");
+    }
+    return builder;
+}
+
+template <typename T>
+std::size_t placeSnapshotSection(std::size_t& offset, std::vector<T> const& items) {
+    const std::size_t start = offset;
+    offset = alignSnapshot(offset + items.size() * sizeof(T));
+    return start;
+}
+
+template <typename T>
+void copySnapshotSection(std::string& image, std::uint64_t offset, std::vector<T> const& items) {
+    if (!items.empty()) {
+        std::memcpy(&image[offset], items.data(), items.size() * sizeof(T));
+    }
+}
+
+} // namespace detail
+
+inline std::string createSnapshot(protozero::data_view const& tile, snapshot_triangulator const& triangulate) {
+    std::string pool;
+    std::vector<detail::snapshot_layer_builder> layers;
+    protozero::pbf_reader tile_reader(tile);
+    while (tile_reader.next(TileType::LAYERS)) {
+        layers.push_back(detail::buildSnapshotLayer(tile_reader.get_view(), pool, triangulate));
+    }
+
+    std::size_t offset = detail::alignSnapshot(sizeof(detail::snapshot_header) + layers.size() * sizeof(detail::snapshot_layer_record));
+    for (auto& layer : layers) {
+        auto& record = layer.record;
+        record.featureCount = layer.features.size();
+        record.keyCount = layer.keys.size();
+        record.valueCount = layer.values.size();
+        record.ringCount = layer.rings.size();
+        record.pointCount = layer.points.size();
+        record.tagCount = layer.tags.size();
+        record.triangleCount = layer.triangles.size();
+        record.features = detail::placeSnapshotSection(offset, layer.features);
+        record.keys = detail::placeSnapshotSection(offset, layer.keys);
+        record.values = detail::placeSnapshotSection(offset, layer.values);
+        record.rings = detail::placeSnapshotSection(offset, layer.rings);
+        record.points = detail::placeSnapshotSection(offset, layer.points);
+        record.tags = detail::placeSnapshotSection(offset, layer.tags);
+        record.triangles = detail::placeSnapshotSection(offset, layer.triangles);
+    }
+
+    detail::snapshot_header header{};
+    std::memcpy(header.magic, detail::snapshot_magic, sizeof(header.magic));
+    header.version = detail::snapshot_version;
+    header.byteOrder = detail::snapshot_byte_order;
+    header.layerCount = static_cast<std::uint32_t>(layers.size());
+    header.sourceHash = tile_snapshot::hashSource(tile);
+    header.sourceSize = tile.size();
+    header.layers = sizeof(detail::snapshot_header);
+    header.strings = offset;
+    header.stringsSize = pool.size();
+    header.size = detail::alignSnapshot(offset + pool.size());
+
+    // Sized once, the sections are copied in place.
+    std::string image(header.size, '\0');
+    std::memcpy(&image[0], &header, sizeof(header));
+    for (std::size_t i = 0; i < layers.size(); ++i) {
+        auto const& layer = layers[i];
+        std::memcpy(&image[header.layers + i * sizeof(detail::snapshot_layer_record)], &layer.record, sizeof(layer.record));
+        detail::copySnapshotSection(image, layer.record.features, layer.features);
+        detail::copySnapshotSection(image, layer.record.keys, layer.keys);
+        detail::copySnapshotSection(image, layer.record.values, layer.values);
+        detail::copySnapshotSection(image, layer.record.rings, layer.rings);
+        detail::copySnapshotSection(image, layer.record.points, layer.points);
+        detail::copySnapshotSection(image, layer.record.tags, layer.tags);
+        detail::copySnapshotSection(image, layer.record.triangles, layer.triangles);
+    }
+    if (!pool.empty()) {
+        std::memcpy(&image[header.strings], pool.data(), pool.size());
+    }
+    return image;
+}
+
+inline void saveSnapshot(std::string const& path, std::string const& image) {
+    const std::string temporary = path + ".tmp";
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("could not open: '" + temporary + "'");
+    }
+    std::size_t done = 0;
+    while (done < image.size()) {
+        const ssize_t result = ::write(fd, image.data() + done, image.size() - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            ::close(fd);
+            ::unlink(temporary.c_str());
+            throw std::runtime_error("could not write: '" + temporary + "'");
+        }
+        done += static_cast<std::size_t>(result);
+    }
+    if (::close(fd) != 0) {
+        ::unlink(temporary.c_str());
+        throw std::runtime_error("could not write: '" + temporary + "'");
+    }
+#else
+    {
+        std::ofstream stream(temporary.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        if (!stream.write(image.data(), static_cast<std::streamsize>(image.size()))) {
+            throw std::runtime_error("could not write: '" + temporary + "'");
+        }
+    }
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("could not write: '" + path + "'");
+    }
+}
+
+inline std::uint64_t tile_snapshot::hashSource(protozero::data_view const& data) {
+    return hashTileData(data);
+}
+
+inline tile_snapshot::tile_snapshot(protozero::data_view const& image_, protozero::data_view const& source)
+    : tile_snapshot(image_, hashSource(source)) {
+}
+
+inline tile_snapshot::tile_snapshot(protozero::data_view const& image_, std::uint64_t source_hash)
+    : image(image_) {
+    if (image.size() < sizeof(detail::snapshot_header) || std::memcmp(image.data(), detail::snapshot_magic, sizeof(detail::snapshot_magic)) != 0) {
+        throw std::runtime_error("not a tile snapshot");
+    }
+    if (reinterpret_cast<std::uintptr_t>(image.data()) % 8 != 0) {
+        throw std::runtime_error("tile snapshot is not 8 byte aligned");
+    }
+    auto const& h = header();
+    if (h.version != detail::snapshot_version) {
+        throw std::runtime_error("unsupported tile snapshot version");
+    }
+    if (h.byteOrder != detail::snapshot_byte_order) {
+        throw std::runtime_error("tile snapshot written with a different byte order");
+    }
+    if (h.sourceHash != source_hash) {
+        throw std::runtime_error("tile snapshot does not match its source tile");
+    }
+    if (h.size != image.size() || !inRange(h.layers, h.layerCount, sizeof(detail::snapshot_layer_record)) ||
+        !inRange(h.strings, h.stringsSize, 1)) {
+        throw std::runtime_error("tile snapshot is corrupt");
+    }
+    const auto* records = reinterpret_cast<detail::snapshot_layer_record const*>(image.data() + h.layers);
+    for (std::size_t i = 0; i < h.layerCount; ++i) {
+        auto const& r = records[i];
+        const bool valid = r.name.offset <= h.stringsSize && r.name.length <= h.stringsSize - r.name.offset &&
+            inRange(r.features, r.featureCount, sizeof(detail::snapshot_feature_record)) &&
+            inRange(r.keys, r.keyCount, sizeof(detail::snapshot_string)) &&
+            inRange(r.values, r.valueCount, sizeof(detail::snapshot_value)) &&
+            inRange(r.rings, r.ringCount, sizeof(std::uint32_t)) &&
+            inRange(r.points, r.pointCount, sizeof(snapshot_point)) &&
+            inRange(r.tags, r.tagCount, sizeof(std::uint32_t)) &&
+            inRange(r.triangles, r.triangleCount, sizeof(std::uint32_t));
+        if (!valid) {
+            throw std::runtime_error("tile snapshot is corrupt");
+        }
+    }
+}
+
+inline bool tile_snapshot::inRange(std::uint64_t offset, std::uint64_t count, std::size_t size) const {
+    return (size == 1 || offset % 8 == 0) && offset <= image.size() && count <= (image.size() - offset) / size;
+}
+
+inline std::string_view tile_snapshot::getString(detail::snapshot_string const& string) const {
+    auto const& h = header();
+    if (string.offset > h.stringsSize || string.length > h.stringsSize - string.offset) {
+        throw std::runtime_error("tile snapshot is corrupt");
+    }
+    return std::string_view(image.data() + h.strings + string.offset, string.length);
+}
+
+inline std::vector<std::string> tile_snapshot::layerNames() const {
+    std::vector<std::string> names;
+    names.reserve(layerCount());
+    for (std::size_t i = 0; i < layerCount(); ++i) {
+        names.emplace_back(getLayer(i).getName());
+    }
+    return names;
+}
+
+inline snapshot_layer tile_snapshot::getLayer(std::size_t i) const {
+    if (i >= layerCount()) {
+        throw std::out_of_range("snapshot layer index out of range");
+    }
+    const auto* records = reinterpret_cast<detail::snapshot_layer_record const*>(image.data() + header().layers);
+    return snapshot_layer(*this, records[i]);
+}
+
+inline snapshot_layer tile_snapshot::getLayer(std::string const& name) const {
+    for (std::size_t i = 0; i < layerCount(); ++i) {
+        snapshot_layer layer = getLayer(i);
+        if (layer.getName() == name) {
+            return layer;
+        }
+    }
+    throw std::runtime_error(std::string("no layer by the name of '") + name + "'");
+}
+
+inline snapshot_layer::snapshot_layer(tile_snapshot const& snapshot_, detail::snapshot_layer_record const& record_)
+    : snapshot(&snapshot_),
+      record(&record_) {
+}
+
+template <typename T>
+const T* snapshot_layer::section(std::uint64_t offset) const {
+    return reinterpret_cast<const T*>(snapshot->image.data() + offset);
+}
+
+inline std::string_view snapshot_layer::getName() const {
+    return snapshot->getString(record->name);
+}
+
+inline std::string_view snapshot_layer::getKey(std::size_t i) const {
+    if (i >= record->keyCount) {
+        throw std::out_of_range("snapshot key index out of range");
+    }
+    return snapshot->getString(section<detail::snapshot_string>(record->keys)[i]);
+}
+
+inline mapbox::feature::value snapshot_layer::getValue(std::size_t i) const {
+    if (i >= record->valueCount) {
+        throw std::out_of_range("snapshot value index out of range");
+    }
+    auto const& value = section<detail::snapshot_value>(record->values)[i];
+    switch (value.type) {
+    case detail::SNAPSHOT_BOOL:
+        return value.payload != 0;
+    case detail::SNAPSHOT_UINT:
+        return value.payload;
+    case detail::SNAPSHOT_INT:
+        return static_cast<std::int64_t>(value.payload);
+    case detail::SNAPSHOT_DOUBLE:
+        return std::bit_cast<double>(value.payload);
+    case detail::SNAPSHOT_STRING:
+        return std::string(snapshot->getString(detail::snapshot_string{ value.payload, value.length }));
+    default:
+        return mapbox::feature::null_value;
+    }
+}
+
+inline snapshot_feature snapshot_layer::getFeature(std::size_t i) const {
+    if (i >= record->featureCount) {
+        throw std::out_of_range("snapshot feature index out of range");
+    }
+    auto const& f = section<detail::snapshot_feature_record>(record->features)[i];
+    const bool valid = std::uint64_t(f.firstRing) + f.ringCount <= record->ringCount &&
+        std::uint64_t(f.firstPoint) + f.pointCount <= record->pointCount &&
+        std::uint64_t(f.firstTag) + f.tagCount <= record->tagCount &&
+        std::uint64_t(f.firstTriangle) + f.triangleCount <= record->triangleCount;
+    if (!valid) {
+        throw std::runtime_error("tile snapshot is corrupt");
+    }
+    return snapshot_feature(*this, f);
+}
+
+inline snapshot_feature::snapshot_feature(snapshot_layer const& layer, detail::snapshot_feature_record const& record_)
+    : layer_(layer),
+      record(&record_) {
+}
+
+inline mapbox::feature::identifier snapshot_feature::getID() const {
+    if (record->hasId) {
+        return record->id;
+    }
+    return mapbox::feature::null_value;
+}
+
+inline std::span<const snapshot_point> snapshot_feature::getRing(std::size_t i) const {
+    if (i >= record->ringCount) {
+        throw std::out_of_range("snapshot ring index out of range");
+    }
+    const std::uint32_t* ends = layer_.section<std::uint32_t>(layer_.record->rings);
+    const std::uint32_t begin = i == 0 ? record->firstPoint : ends[record->firstRing + i - 1];
+    const std::uint32_t end = ends[record->firstRing + i];
+    if (begin > end || begin < record->firstPoint || end > record->firstPoint + record->pointCount) {
+        throw std::runtime_error("tile snapshot is corrupt");
+    }
+    return std::span<const snapshot_point>(layer_.section<snapshot_point>(layer_.record->points) + begin, end - begin);
+}
+
+inline std::span<const snapshot_point> snapshot_feature::getPoints() const {
+    return std::span<const snapshot_point>(layer_.section<snapshot_point>(layer_.record->points) + record->firstPoint, record->pointCount);
+}
+
+inline std::span<const std::uint32_t> snapshot_feature::getTags() const {
+    return std::span<const std::uint32_t>(layer_.section<std::uint32_t>(layer_.record->tags) + record->firstTag, record->tagCount);
+}
+
+inline std::span<const std::uint32_t> snapshot_feature::getTriangles() const {
+    return std::span<const std::uint32_t>(layer_.section<std::uint32_t>(layer_.record->triangles) + record->firstTriangle, record->triangleCount);
+}
+
+inline feature::properties_type snapshot_feature::getProperties() const {
+    feature::properties_type properties;
+    const auto tags = getTags();
+    for (std::size_t i = 0; i + 1 < tags.size(); i += 2) {
+        properties.emplace(std::string(layer_.getKey(tags[i])), layer_.getValue(tags[i + 1]));
+    }
+    return properties;
+}
+
+}} // namespace mapbox/vector_tile
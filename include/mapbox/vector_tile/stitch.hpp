@@ -0,0 +1,418 @@
+#pragma once
+
+#include <mapbox/vector_tile.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace mapbox { namespace vector_tile {
+
+/**
+ * Joins line features that were cut at tile boundaries back into continuous
+ * lines in world coordinates.
+ *
+ * Features from adjacent tiles of one zoom level are added together with the
+ * column and row of their tile. Fragments belong together if their features
+ * have the same id and properties, and are joined where an endpoint lying on
+ * a tile edge coincides with an endpoint of another fragment.
+ *
+ * Tiles encoded with a buffer repeat the parts of lines near their edges.
+ * Given the buffer size, lines are clipped to their own tile first, so that
+ * each part is kept once and fragments end on the edges. Points where the
+ * clipped lines cross an edge are rounded, endpoints up to one unit apart
+ * along the edge are therefore joined.
+ *
+ * World coordinates are `tile_x * extent + x` and `tile_y * extent + y`. All
+ * vertices of all stitched lines are stored in one contiguous array.
+ */
+class line_stitcher {
+public:
+    using point_type = mapbox::geometry::point<std::int64_t>;
+
+    struct group_type {
+        mapbox::feature::identifier id;
+        feature::properties_type properties;
+    };
+
+    struct line_type {
+        std::size_t group;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    /// Stitch tiles encoded with the given buffer around their extent.
+    explicit line_stitcher(std::uint32_t tile_buffer = 0) : tileBuffer(tile_buffer) {}
+
+    /// Add the parts of a line feature, other geometry types are ignored.
+    void addFeature(feature const& f, std::uint32_t tile_x, std::uint32_t tile_y);
+    /// Add all line features of a layer.
+    void addLayer(layer const& l, std::uint32_t tile_x, std::uint32_t tile_y);
+    /// Join the fragments added so far, replacing the result of a previous call.
+    void stitch();
+    /// Forget all fragments and results but keep the allocated memory.
+    void clear();
+
+    std::vector<group_type> const& getGroups() const { return groups; }
+    std::vector<line_type> const& getLines() const { return lines; }
+    std::span<const point_type> getPoints(line_type const& line) const {
+        return std::span<const point_type>(points.data() + line.offset, line.size);
+    }
+
+private:
+    struct fragment_type {
+        std::size_t group;
+        std::size_t offset;
+        std::size_t size;
+        bool startOnEdge;
+        bool endOnEdge;
+    };
+
+    struct endpoint_key {
+        std::size_t group;
+        std::int64_t x;
+        std::int64_t y;
+
+        bool operator==(endpoint_key const& other) const {
+            return group == other.group && x == other.x && y == other.y;
+        }
+    };
+
+    struct endpoint_hash {
+        std::size_t operator()(endpoint_key const& key) const {
+            std::size_t h = std::hash<std::size_t>()(key.group);
+            h ^= std::hash<std::int64_t>()(key.x) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            h ^= std::hash<std::int64_t>()(key.y) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    // Reference to one end of a fragment: index * 2, plus 1 for its last point.
+    using endpoint_ref = std::size_t;
+
+    using local_point = mapbox::geometry::point<std::int64_t>;
+
+    std::size_t findGroup(feature const& f);
+    // Add one part of a line in tile coordinates, clipped to the tile with a buffer.
+    void addPart(std::size_t group, point_type const& origin, std::vector<local_point> const& line);
+    void addFragment(std::size_t group, point_type const& origin, local_point const* first, std::size_t count);
+    bool findNext(endpoint_ref end, endpoint_ref& next) const;
+
+    std::uint32_t tileBuffer = 0;
+    std::uint32_t extent = 0;
+    std::vector<local_point> part;
+    std::vector<local_point> clipped;
+    std::string signature;
+    std::unordered_map<std::string, std::size_t> groupIndex;
+    std::vector<group_type> groups;
+    std::vector<fragment_type> fragments;
+    std::vector<point_type> fragmentPoints;
+    std::vector<bool> used;
+    std::unordered_multimap<endpoint_key, endpoint_ref, endpoint_hash> endpoints;
+    std::vector<line_type> lines;
+    std::vector<point_type> points;
+};
+
+namespace detail {
+
+inline void appendSignature(std::string& signature, mapbox::feature::value const& value) {
+    signature += static_cast<char>(value.index());
+    std::visit([&signature](auto const& v) {
+        using value_type = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<value_type, std::string>) {
+            const auto size = static_cast<std::uint64_t>(v.size());
+            signature.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            signature += v;
+        } else if constexpr (std::is_same_v<value_type, bool> || std::is_arithmetic_v<value_type>) {
+            signature.append(reinterpret_cast<const char*>(&v), sizeof(v));
+        } else if constexpr (!std::is_same_v<value_type, mapbox::feature::null_value_t>) {
+            throw std::runtime_error("unsupported property value type");
+        }
+    }, static_cast<mapbox::feature::value_base const&>(value));
+}
+
+} // namespace detail
+
+inline std::size_t line_stitcher::findGroup(feature const& f) {
+    auto properties = f.getProperties();
+
+    // Properties are hashed in key order, so the signature is the same for
+    // equal features of different tiles.
+    std::vector<std::pair<std::string const*, mapbox::feature::value const*>> sorted;
+    sorted.reserve(properties.size());
+    for (auto const& property : properties) {
+        sorted.emplace_back(&property.first, &property.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) { return *a.first < *b.first; });
+
+    signature.clear();
+    signature += static_cast<char>(f.getID().index());
+    std::visit([this](auto const& id) {
+        // The null id has no value bytes, its type index says it all.
+        if constexpr (!std::is_same_v<std::decay_t<decltype(id)>, mapbox::feature::null_value_t>) {
+            signature.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        }
+    }, f.getID());
+    for (auto const& property : sorted) {
+        const auto size = static_cast<std::uint64_t>(property.first->size());
+        signature.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        signature += *property.first;
+        detail::appendSignature(signature, *property.second);
+    }
+
+    auto it = groupIndex.find(signature);
+    if (it != groupIndex.end()) {
+        return it->second;
+    }
+    groupIndex.emplace(signature, groups.size());
+    groups.push_back(group_type{ f.getID(), std::move(properties) });
+    return groups.size() - 1;
+}
+
+inline void line_stitcher::addFeature(feature const& f, std::uint32_t tile_x, std::uint32_t tile_y) {
+    if (f.getType() != GeomType::LINESTRING) {
+        return;
+    }
+    if (extent == 0) {
+        extent = f.getExtent();
+    } else if (extent != f.getExtent()) {
+        throw std::runtime_error("features with different extents cannot be stitched");
+    }
+    const std::size_t group = findGroup(f);
+
+    struct part_visitor {
+        line_stitcher& stitcher;
+        std::size_t group;
+        point_type origin;
+
+        void finish() {
+            if (!stitcher.part.empty()) {
+                stitcher.addPart(group, origin, stitcher.part);
+                stitcher.part.clear();
+            }
+        }
+        void moveTo(std::int64_t x, std::int64_t y) {
+            finish();
+            stitcher.part.emplace_back(x, y);
+        }
+        void lineTo(std::int64_t x, std::int64_t y) {
+            if (stitcher.part.empty()) {
+                throw std::runtime_error("line geometry does not start with a MoveTo command");
+            }
+            stitcher.part.emplace_back(x, y);
+        }
+        void closePath() {}
+    };
+
+    part.clear();
+    part_visitor visitor{ *this, group,
+                          point_type(static_cast<std::int64_t>(tile_x) * extent, static_cast<std::int64_t>(tile_y) * extent) };
+    f.walkGeometry(visitor);
+    visitor.finish();
+}
+
+inline void line_stitcher::addFragment(std::size_t group, point_type const& origin, local_point const* first, std::size_t count) {
+    const auto tile_extent = static_cast<std::int64_t>(extent);
+    const auto on_edge = [tile_extent](local_point const& p) {
+        return p.x <= 0 || p.y <= 0 || p.x >= tile_extent || p.y >= tile_extent;
+    };
+    fragments.push_back(fragment_type{ group, fragmentPoints.size(), count, on_edge(first[0]), on_edge(first[count - 1]) });
+    for (std::size_t i = 0; i < count; ++i) {
+        fragmentPoints.emplace_back(origin.x + first[i].x, origin.y + first[i].y);
+    }
+}
+
+inline void line_stitcher::addPart(std::size_t group, point_type const& origin, std::vector<local_point> const& line) {
+    if (tileBuffer == 0) {
+        addFragment(group, origin, line.data(), line.size());
+        return;
+    }
+    // Clip every segment to the tile (Liang-Barsky), starting a fragment
+    // where the line enters the tile and ending it where the line leaves.
+    const auto tile_extent = static_cast<double>(extent);
+    const auto flush = [this, group, &origin]() {
+        if (clipped.size() >= 2) {
+            addFragment(group, origin, clipped.data(), clipped.size());
+        }
+        clipped.clear();
+    };
+    const auto round_point = [](double x, double y) {
+        return local_point(std::llround(x), std::llround(y));
+    };
+    clipped.clear();
+    if (line.size() == 1) {
+        clipped.push_back(line[0]);
+    }
+    for (std::size_t i = 1; i < line.size(); ++i) {
+        const auto x0 = static_cast<double>(line[i - 1].x);
+        const auto y0 = static_cast<double>(line[i - 1].y);
+        const double dx = static_cast<double>(line[i].x) - x0;
+        const double dy = static_cast<double>(line[i].y) - y0;
+        double t0 = 0.0;
+        double t1 = 1.0;
+        bool visible = true;
+        const auto clip = [&t0, &t1, &visible](double p, double q) {
+            if (p < 0.0 || p > 0.0) {
+                const double t = q / p;
+                if (p < 0.0) {
+                    t0 = std::max(t0, t);
+                } else {
+                    t1 = std::min(t1, t);
+                }
+            } else if (q < 0.0) {
+                visible = false;
+            }
+        };
+        clip(-dx, x0);
+        clip(dx, tile_extent - x0);
+        clip(-dy, y0);
+        clip(dy, tile_extent - y0);
+        if (!visible || t0 > t1) {
+            flush();
+            continue;
+        }
+        const local_point enter = t0 > 0.0 ? round_point(x0 + t0 * dx, y0 + t0 * dy) : line[i - 1];
+        const local_point leave = t1 < 1.0 ? round_point(x0 + t1 * dx, y0 + t1 * dy) : line[i];
+        if (t0 > 0.0 || clipped.empty()) {
+            flush();
+            clipped.push_back(enter);
+        }
+        if (leave != clipped.back()) {
+            clipped.push_back(leave);
+        }
+        if (t1 < 1.0) {
+            flush();
+        }
+    }
+    flush();
+}
+
+inline void line_stitcher::addLayer(layer const& l, std::uint32_t tile_x, std::uint32_t tile_y) {
+    for (std::size_t i = 0; i < l.featureCount(); ++i) {
+        addFeature(feature(l.getFeature(i), l), tile_x, tile_y);
+    }
+}
+
+inline bool line_stitcher::findNext(endpoint_ref end, endpoint_ref& next) const {
+    fragment_type const& f = fragments[end / 2];
+    const bool is_last = end % 2 == 1;
+    if (!(is_last ? f.endOnEdge : f.startOnEdge)) {
+        return false;
+    }
+    point_type const& p = fragmentPoints[is_last ? f.offset + f.size - 1 : f.offset];
+    // Edge crossings of clipped lines are rounded, look around them.
+    const std::int64_t tolerance = tileBuffer > 0 ? 1 : 0;
+    for (std::int64_t dx = -tolerance; dx <= tolerance; ++dx) {
+        for (std::int64_t dy = -tolerance; dy <= tolerance; ++dy) {
+            const auto range = endpoints.equal_range(endpoint_key{ f.group, p.x + dx, p.y + dy });
+            for (auto it = range.first; it != range.second; ++it) {
+                if (!used[it->second / 2]) {
+                    next = it->second;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+inline void line_stitcher::stitch() {
+    lines.clear();
+    points.clear();
+    points.reserve(fragmentPoints.size());
+    used.assign(fragments.size(), false);
+
+    endpoints.clear();
+    endpoints.reserve(fragments.size() * 2);
+    for (std::size_t i = 0; i < fragments.size(); ++i) {
+        fragment_type const& fragment = fragments[i];
+        if (fragment.startOnEdge) {
+            point_type const& p = fragmentPoints[fragment.offset];
+            endpoints.emplace(endpoint_key{ fragment.group, p.x, p.y }, i * 2);
+        }
+        if (fragment.endOnEdge) {
+            point_type const& p = fragmentPoints[fragment.offset + fragment.size - 1];
+            endpoints.emplace(endpoint_key{ fragment.group, p.x, p.y }, i * 2 + 1);
+        }
+    }
+
+    // Chains of (fragment, reversed) pairs growing from the first and the
+    // last point of the starting fragment, reused across lines.
+    std::vector<std::pair<std::size_t, bool>> backward;
+    std::vector<std::pair<std::size_t, bool>> forward;
+    for (std::size_t i = 0; i < fragments.size(); ++i) {
+        if (used[i]) {
+            continue;
+        }
+        used[i] = true;
+        forward.clear();
+        backward.clear();
+        forward.emplace_back(i, false);
+
+        endpoint_ref next;
+        endpoint_ref tail = i * 2 + 1;
+        while (findNext(tail, next)) {
+            used[next / 2] = true;
+            // Entering a fragment at its last point means walking it backwards.
+            forward.emplace_back(next / 2, next % 2 == 1);
+            tail = next ^ 1;
+        }
+        endpoint_ref head = i * 2;
+        while (findNext(head, next)) {
+            used[next / 2] = true;
+            // Reaching a fragment at its first point means it precedes reversed.
+            backward.emplace_back(next / 2, next % 2 == 0);
+            head = next ^ 1;
+        }
+
+        const std::size_t offset = points.size();
+        const auto append = [this](std::size_t index, bool reversed) {
+            fragment_type const& f = fragments[index];
+            const auto first = fragmentPoints.begin() + static_cast<std::ptrdiff_t>(f.offset);
+            const auto last = first + static_cast<std::ptrdiff_t>(f.size);
+            if (reversed) {
+                points.insert(points.end(), std::make_reverse_iterator(last), std::make_reverse_iterator(first));
+            } else {
+                points.insert(points.end(), first, last);
+            }
+        };
+        // Consecutive fragments share their joining point, keep it once.
+        for (auto it = backward.rbegin(); it != backward.rend(); ++it) {
+            append(it->first, it->second);
+            points.pop_back();
+        }
+        for (std::size_t j = 0; j < forward.size(); ++j) {
+            append(forward[j].first, forward[j].second);
+            if (j + 1 < forward.size()) {
+                points.pop_back();
+            }
+        }
+        lines.push_back(line_type{ fragments[i].group, offset, points.size() - offset });
+    }
+}
+
+inline void line_stitcher::clear() {
+    extent = 0;
+    part.clear();
+    clipped.clear();
+    groupIndex.clear();
+    groups.clear();
+    fragments.clear();
+    fragmentPoints.clear();
+    used.clear();
+    endpoints.clear();
+    lines.clear();
+    points.clear();
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace mapbox { namespace vector_tile {
+
+struct tile_address {
+    std::uint32_t z = 0;
+    std::uint32_t x = 0;
+    std::uint32_t y = 0;
+};
+
+inline bool operator==(tile_address const& lhs, tile_address const& rhs) {
+    return lhs.z == rhs.z && lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+inline bool operator!=(tile_address const& lhs, tile_address const& rhs) {
+    return !(lhs == rhs);
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/tile_address.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mapbox { namespace vector_tile {
+
+/// A tile of a tile source, applications number their sources.
+struct tile_key {
+    std::uint32_t source = 0;
+    tile_address address;
+};
+
+inline bool operator==(tile_key const& lhs, tile_key const& rhs) {
+    return lhs.source == rhs.source && lhs.address == rhs.address;
+}
+
+inline bool operator!=(tile_key const& lhs, tile_key const& rhs) {
+    return !(lhs == rhs);
+}
+
+/**
+ * Tile data together with its decoded buffer and layers. Decoding happens
+ * once on construction, afterwards the tile is immutable and can be shared
+ * between threads.
+ */
+class decoded_tile {
+public:
+    explicit decoded_tile(std::string data);
+    // The buffer and layers refer into the data.
+    decoded_tile(decoded_tile const&) = delete;
+    decoded_tile& operator=(decoded_tile const&) = delete;
+
+    protozero::data_view data() const { return protozero::data_view(data_); }
+    buffer const& getBuffer() const { return buffer_; }
+    std::vector<std::string> layerNames() const { return buffer_.layerNames(); }
+    layer const& getLayer(std::string const& name) const;
+    /// Bytes allocated for the tile data, buffer and layers.
+    std::size_t memoryUsage() const;
+
+private:
+    std::string data_;
+    buffer buffer_;
+    std::map<std::string, layer> layers;
+};
+
+/// Cost of a cached value in bytes, from its memoryUsage().
+struct tile_cache_cost {
+    template <typename Value>
+    std::size_t operator()(Value const& value) const {
+        return value.memoryUsage();
+    }
+};
+
+namespace detail {
+
+struct tile_key_hash {
+    std::size_t operator()(tile_key const& key) const {
+        std::uint64_t hash = (std::uint64_t(key.source) << 32 | key.address.z) * 0x9e3779b97f4a7c15ULL;
+        hash ^= (std::uint64_t(key.address.x) << 32 | key.address.y) + 0x7f4a7c159e3779b9ULL + (hash << 6) + (hash >> 2);
+        hash ^= hash >> 29;
+        return static_cast<std::size_t>(hash * 0xbf58476d1ce4e5b9ULL);
+    }
+};
+
+} // namespace detail
+
+/**
+ * Thread-safe cache of decoded tiles, or any other per tile value, within a
+ * memory budget:
+ *
+ *     tile_cache<> cache(256 * 1024 * 1024);
+ *     std::shared_ptr<const decoded_tile> tile = cache.get(key, [](tile_key const& k) {
+ *         return std::make_shared<const decoded_tile>(readTile(k));
+ *     });
+ *
+ * Keys are spread over shards with a lock and a least recently used list
+ * each, all sharing one memory budget. Values are accounted with their cost
+ * in bytes. When a store takes the cache over budget, the least recently
+ * used values of the shard written to are dropped first, then those of
+ * other shards that are not locked at the time, so a hot shard can use
+ * what the others leave free. Values larger than the whole budget are
+ * returned but not kept. Callers hold values by shared_ptr, so dropped
+ * values stay valid for them.
+ *
+ * Concurrent get() calls for a key that is not cached wait for a single
+ * load; if it throws all of them see the exception and nothing is cached.
+ */
+template <typename Value = decoded_tile, typename Cost = tile_cache_cost>
+class tile_cache {
+public:
+    using value_type = std::shared_ptr<const Value>;
+    using loader_type = std::function<value_type(tile_key const&)>;
+
+    explicit tile_cache(std::size_t memory_budget, unsigned shard_count = 16, Cost cost = Cost());
+    tile_cache(tile_cache const&) = delete;
+    tile_cache& operator=(tile_cache const&) = delete;
+
+    /// The cached value for a key, loaded and cached if missing.
+    value_type get(tile_key const& key, loader_type const& load);
+    /// The cached value for a key, or nullptr.
+    value_type find(tile_key const& key);
+    void insert(tile_key const& key, value_type value);
+    void erase(tile_key const& key);
+    void clear();
+
+    std::size_t size() const;
+    /// Sum of the costs of the cached values.
+    std::size_t memoryUsage() const;
+    std::size_t memoryBudget() const { return budget; }
+
+private:
+    struct entry {
+        tile_key key;
+        value_type value;
+        std::size_t cost;
+    };
+
+    struct shard {
+        mutable std::mutex mutex;
+        // Most recently used first.
+        std::list<entry> entries;
+        std::unordered_map<tile_key, typename std::list<entry>::iterator, detail::tile_key_hash> index;
+        std::unordered_map<tile_key, std::shared_future<value_type>, detail::tile_key_hash> loading;
+    };
+
+    shard& shardFor(tile_key const& key) {
+        return shards[detail::tile_key_hash()(key) % shards.size()];
+    }
+    // Add or replace an entry and evict down to the budget, with the shard locked.
+    void store(shard& s, tile_key const& key, value_type value);
+    // Drop the least recently used entry of a locked shard.
+    void evictOldest(shard& s);
+
+    std::size_t budget;
+    Cost cost;
+    std::vector<shard> shards;
+    // Sum of the costs of the entries of all shards.
+    std::atomic<std::size_t> usage{ 0 };
+};
+
+inline decoded_tile::decoded_tile(std::string data)
+    : data_(std::move(data)),
+      buffer_(data_) {
+    for (auto const& entry : buffer_.getLayers()) {
+        layers.emplace(entry.first, layer(entry.second));
+    }
+}
+
+inline layer const& decoded_tile::getLayer(std::string const& name) const {
+    const auto it = layers.find(name);
+    if (it == layers.end()) {
+        throw std::runtime_error(std::string("no layer by the name of '") + name + "'");
+    }
+    return it->second;
+}
+
+inline std::size_t decoded_tile::memoryUsage() const {
+    std::size_t bytes = sizeof(decoded_tile) - sizeof(buffer) + detail::stringMemoryUsage(data_) + buffer_.memoryUsage();
+    for (auto const& entry : layers) {
+        bytes += detail::mapNodeSize<std::pair<const std::string, layer>>() - sizeof(layer) + detail::stringMemoryUsage(entry.first) +
+                 entry.second.memoryUsage();
+    }
+    return bytes;
+}
+
+template <typename Value, typename Cost>
+tile_cache<Value, Cost>::tile_cache(std::size_t memory_budget, unsigned shard_count, Cost cost_)
+    : budget(memory_budget),
+      cost(std::move(cost_)),
+      shards(shard_count ? shard_count : 1) {
+}
+
+template <typename Value, typename Cost>
+typename tile_cache<Value, Cost>::value_type tile_cache<Value, Cost>::get(tile_key const& key, loader_type const& load) {
+    shard& s = shardFor(key);
+    std::promise<value_type> promise;
+    {
+        std::unique_lock<std::mutex> lock(s.mutex);
+        const auto it = s.index.find(key);
+        if (it != s.index.end()) {
+            s.entries.splice(s.entries.begin(), s.entries, it->second);
+            return it->second->value;
+        }
+        const auto pending = s.loading.find(key);
+        if (pending != s.loading.end()) {
+            std::shared_future<value_type> result = pending->second;
+            lock.unlock();
+            return result.get();
+        }
+        s.loading.emplace(key, promise.get_future().share());
+    }
+
+    value_type value;
+    try {
+        value = load(key);
+        if (!value) {
+            throw std::runtime_error("tile loader returned no value");
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.loading.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.loading.erase(key);
+        store(s, key, value);
+    }
+    promise.set_value(value);
+    return value;
+}
+
+template <typename Value, typename Cost>
+typename tile_cache<Value, Cost>::value_type tile_cache<Value, Cost>::find(tile_key const& key) {
+    shard& s = shardFor(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(key);
+    if (it == s.index.end()) {
+        return nullptr;
+    }
+    s.entries.splice(s.entries.begin(), s.entries, it->second);
+    return it->second->value;
+}
+
+template <typename Value, typename Cost>
+void tile_cache<Value, Cost>::insert(tile_key const& key, value_type value) {
+    if (!value) {
+        throw std::runtime_error("cannot cache an empty value");
+    }
+    shard& s = shardFor(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    store(s, key, std::move(value));
+}
+
+template <typename Value, typename Cost>
+void tile_cache<Value, Cost>::store(shard& s, tile_key const& key, value_type value) {
+    const auto existing = s.index.find(key);
+    if (existing != s.index.end()) {
+        usage -= existing->second->cost;
+        s.entries.erase(existing->second);
+        s.index.erase(existing);
+    }
+    const std::size_t value_cost = cost(*value);
+    if (value_cost > budget) {
+        return;
+    }
+    s.entries.push_front(entry{ key, std::move(value), value_cost });
+    s.index.emplace(key, s.entries.begin());
+    usage += value_cost;
+    while (usage > budget && s.entries.size() > 1) {
+        evictOldest(s);
+    }
+    // Other shards are only tried, never waited for, so two stores can't
+    // deadlock. A shard skipped here evicts on its own next store.
+    const std::size_t first = static_cast<std::size_t>(&s - shards.data());
+    for (std::size_t i = 1; i < shards.size() && usage > budget; ++i) {
+        shard& other = shards[(first + i) % shards.size()];
+        std::unique_lock<std::mutex> lock(other.mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            continue;
+        }
+        while (usage > budget && !other.entries.empty()) {
+            evictOldest(other);
+        }
+    }
+}
+
+template <typename Value, typename Cost>
+void tile_cache<Value, Cost>::evictOldest(shard& s) {
+    entry const& oldest = s.entries.back();
+    usage -= oldest.cost;
+    s.index.erase(oldest.key);
+    s.entries.pop_back();
+}
+
+template <typename Value, typename Cost>
+void tile_cache<Value, Cost>::erase(tile_key const& key) {
+    shard& s = shardFor(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(key);
+    if (it != s.index.end()) {
+        usage -= it->second->cost;
+        s.entries.erase(it->second);
+        s.index.erase(it);
+    }
+}
+
+template <typename Value, typename Cost>
+void tile_cache<Value, Cost>::clear() {
+    for (auto& s : shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto const& cached : s.entries) {
+            usage -= cached.cost;
+        }
+        s.entries.clear();
+        s.index.clear();
+    }
+}
+
+template <typename Value, typename Cost>
+std::size_t tile_cache<Value, Cost>::size() const {
+    std::size_t count = 0;
+    for (auto const& s : shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        count += s.entries.size();
+    }
+    return count;
+}
+
+template <typename Value, typename Cost>
+std::size_t tile_cache<Value, Cost>::memoryUsage() const {
+    return usage;
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,632 @@
+#pragma once
+
+#include <mapbox/vector_tile/tile_address.hpp>
+#include <protozero/types.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPBOX_VECTOR_TILE_HAS_POSIX_IO 1
+#else
+#include <fstream>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define MAPBOX_VECTOR_TILE_HAS_IO_URING 1
+#endif
+#endif
+
+namespace mapbox { namespace vector_tile {
+
+struct tile_loader_options {
+    std::string extension = ".mvt";
+    /// Number of tiles being opened or read at the same time.
+    unsigned queueDepth = 64;
+    /// Bytes of tile data held at most, a single larger tile is still read.
+    std::size_t memoryBudget = 64 * 1024 * 1024;
+    /// Reader threads when io_uring is not used, 0 for one per core.
+    unsigned threads = 0;
+    bool useIoUring = true;
+};
+
+namespace detail {
+
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+
+// Minimal io_uring submission and completion queue on the raw system calls.
+class io_uring_queue {
+public:
+    explicit io_uring_queue(unsigned entries);
+    ~io_uring_queue();
+    io_uring_queue(io_uring_queue const&) = delete;
+    io_uring_queue& operator=(io_uring_queue const&) = delete;
+
+    /// Whether the kernel supports io_uring with the operations used here.
+    bool valid() const { return ringFd >= 0; }
+
+    /// A cleared submission entry, the caller never has more entries in
+    /// flight than the queue was created with.
+    io_uring_sqe& next();
+    /// Submit queued entries and wait for at least one completion.
+    void submitAndWait();
+    /// Call function(user_data, result) for every available completion.
+    template <typename Function>
+    void drain(Function&& function);
+
+private:
+    bool setup(unsigned entries);
+    void release() noexcept;
+
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    std::size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    std::size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+#endif
+
+} // namespace detail
+
+/**
+ * Reads batches of tiles from a z/x/y directory tree, such as the output
+ * of a tile seeding job, and hands each tile to a callback:
+ *
+ *     tile_loader loader("tiles");
+ *     loader.load(addresses, [](tile_address const& address, protozero::data_view const& data) {
+ *         buffer tile(data);
+ *         ...
+ *     });
+ *
+ * On Linux opens and reads are submitted in batches through io_uring, so
+ * many requests are in flight at once without a thread per request.
+ * Elsewhere, or where the kernel does not support it, a pool of reader
+ * threads is used instead. Either way the callback is invoked on the thread
+ * calling load(), one tile at a time and in completion order, and the data
+ * is only valid during the call. Missing tiles are skipped.
+ *
+ * A loader must only be used by one thread at a time.
+ */
+class tile_loader {
+public:
+    using callback_type = std::function<void(tile_address const&, protozero::data_view const&)>;
+
+    explicit tile_loader(std::string root, tile_loader_options opts = tile_loader_options());
+
+    /// Whether tiles are read through io_uring.
+    bool usesIoUring() const;
+    std::string path(tile_address const& address) const;
+
+    /**
+     * Read the given tiles, returning how many were found. Throws
+     * std::runtime_error if a tile exists but cannot be read, exceptions
+     * from the callback are passed on after outstanding reads finished.
+     */
+    std::size_t load(std::vector<tile_address> const& tiles, callback_type const& callback);
+
+private:
+    std::size_t loadWithThreads(std::vector<tile_address> const& tiles, callback_type const& callback);
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+    std::size_t loadWithIoUring(std::vector<tile_address> const& tiles, callback_type const& callback);
+
+    std::unique_ptr<detail::io_uring_queue> ring;
+#endif
+
+    std::string root;
+    tile_loader_options opts;
+};
+
+namespace detail {
+
+// Read a whole file into data, returning false if it does not exist.
+inline bool readFile(std::string const& path, std::string& data) {
+#ifdef MAPBOX_VECTOR_TILE_HAS_POSIX_IO
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return false;
+        }
+        throw std::runtime_error("could not open: '" + path + "'");
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("could not read: '" + path + "'");
+    }
+    data.resize(static_cast<std::size_t>(info.st_size));
+    std::size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t result = ::read(fd, &data[done], data.size() - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            ::close(fd);
+            throw std::runtime_error("could not read: '" + path + "'");
+        }
+        done += static_cast<std::size_t>(result);
+    }
+    ::close(fd);
+    return true;
+#else
+    std::ifstream stream(path.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    stream.seekg(0, std::ios_base::end);
+    data.resize(static_cast<std::size_t>(stream.tellg()));
+    stream.seekg(0, std::ios_base::beg);
+    if (!stream.read(&data[0], static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error("could not read: '" + path + "'");
+    }
+    return true;
+#endif
+}
+
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+
+inline io_uring_queue::io_uring_queue(unsigned entries) {
+    if (!setup(entries)) {
+        release();
+    }
+}
+
+inline io_uring_queue::~io_uring_queue() {
+    release();
+}
+
+inline bool io_uring_queue::setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ringFd < 0) {
+        return false;
+    }
+    // Openat and read were added in Linux 5.6, check they are available.
+    const std::size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::unique_ptr<unsigned char[]> probe_data(new unsigned char[probe_size]());
+    auto* probe = reinterpret_cast<io_uring_probe*>(probe_data.get());
+    if (::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+        probe->last_op < IORING_OP_READ ||
+        !(probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) ||
+        !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)) {
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        return false;
+    }
+    if (!single_mmap) {
+        cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = nullptr;
+            return false;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_map = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqes_map == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_map);
+
+    auto* sq = static_cast<char*>(sqRing);
+    auto* cq = static_cast<char*>(single_mmap ? sqRing : cqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+inline void io_uring_queue::release() noexcept {
+    if (sqes) {
+        ::munmap(sqes, sqesSize);
+    }
+    if (cqRing) {
+        ::munmap(cqRing, cqRingSize);
+    }
+    if (sqRing) {
+        ::munmap(sqRing, sqRingSize);
+    }
+    if (ringFd >= 0) {
+        ::close(ringFd);
+    }
+    sqes = nullptr;
+    cqRing = nullptr;
+    sqRing = nullptr;
+    ringFd = -1;
+}
+
+inline io_uring_sqe& io_uring_queue::next() {
+    // Only this thread writes the tail, the kernel reads it.
+    const unsigned tail = *sqTail;
+    const unsigned index = tail & sqMask;
+    io_uring_sqe& entry = sqes[index];
+    std::memset(&entry, 0, sizeof(entry));
+    sqArray[index] = index;
+    std::atomic_ref<unsigned>(*sqTail).store(tail + 1, std::memory_order_release);
+    return entry;
+}
+
+inline void io_uring_queue::submitAndWait() {
+    for (;;) {
+        const unsigned pending = *sqTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire);
+        if (::syscall(__NR_io_uring_enter, ringFd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0) {
+            return;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::runtime_error("io_uring submission failed");
+        }
+    }
+}
+
+template <typename Function>
+void io_uring_queue::drain(Function&& function) {
+    unsigned head = *cqHead;
+    for (;;) {
+        if (head == std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire)) {
+            break;
+        }
+        const io_uring_cqe entry = cqes[head & cqMask];
+        ++head;
+        // Hand the entry back before the callback, which may throw.
+        std::atomic_ref<unsigned>(*cqHead).store(head, std::memory_order_release);
+        function(entry.user_data, entry.res);
+    }
+}
+
+#endif
+
+} // namespace detail
+
+inline tile_loader::tile_loader(std::string root_, tile_loader_options opts_)
+    : root(std::move(root_)),
+      opts(std::move(opts_)) {
+    opts.queueDepth = std::max(opts.queueDepth, 1u);
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+    if (opts.useIoUring) {
+        ring = std::make_unique<detail::io_uring_queue>(opts.queueDepth);
+        if (!ring->valid()) {
+            ring.reset();
+        }
+    }
+#endif
+}
+
+inline bool tile_loader::usesIoUring() const {
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+    return ring != nullptr;
+#else
+    return false;
+#endif
+}
+
+inline std::string tile_loader::path(tile_address const& address) const {
+    return root + "/" + std::to_string(address.z) + "/" + std::to_string(address.x) + "/" + std::to_string(address.y) + opts.extension;
+}
+
+inline std::size_t tile_loader::load(std::vector<tile_address> const& tiles, callback_type const& callback) {
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+    if (ring) {
+        return loadWithIoUring(tiles, callback);
+    }
+#endif
+    return loadWithThreads(tiles, callback);
+}
+
+inline std::size_t tile_loader::loadWithThreads(std::vector<tile_address> const& tiles, callback_type const& callback) {
+    struct loaded_tile {
+        std::size_t index;
+        std::string data;
+    };
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+    std::condition_variable spaceChanged;
+    std::deque<loaded_tile> ready;
+    std::size_t buffered = 0;
+    bool stop = false;
+    std::exception_ptr error;
+    std::atomic<std::size_t> next{ 0 };
+
+    unsigned thread_count = opts.threads ? opts.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    thread_count = static_cast<unsigned>(std::min<std::size_t>(std::min(thread_count, opts.queueDepth), tiles.size()));
+    unsigned running = thread_count;
+
+    const auto read_tiles = [&]() {
+        for (std::size_t index = next++; index < tiles.size(); index = next++) {
+            loaded_tile tile{ index, std::string() };
+            try {
+                if (!detail::readFile(path(tiles[index]), tile.data)) {
+                    continue;
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                stop = true;
+                break;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceChanged.wait(lock, [&]() { return stop || buffered == 0 || buffered + tile.data.size() <= opts.memoryBudget; });
+            if (stop) {
+                break;
+            }
+            buffered += tile.data.size();
+            ready.push_back(std::move(tile));
+            readyChanged.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        readyChanged.notify_one();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    std::size_t found = 0;
+    try {
+        for (unsigned i = 0; i < thread_count; ++i) {
+            threads.emplace_back(read_tiles);
+        }
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mutex);
+            readyChanged.wait(lock, [&]() { return stop || !ready.empty() || running == 0; });
+            if (stop || ready.empty()) {
+                break;
+            }
+            loaded_tile tile = std::move(ready.front());
+            ready.pop_front();
+            lock.unlock();
+            callback(tiles[tile.index], protozero::data_view(tile.data.data(), tile.data.size()));
+            ++found;
+            lock.lock();
+            buffered -= tile.data.size();
+            spaceChanged.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+        stop = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = stop || error;
+        spaceChanged.notify_all();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return found;
+}
+
+#ifdef MAPBOX_VECTOR_TILE_HAS_IO_URING
+
+inline std::size_t tile_loader::loadWithIoUring(std::vector<tile_address> const& tiles, callback_type const& callback) {
+    enum class slot_state : std::uint8_t { FREE, OPENING, WAITING, READING };
+    // A tile being loaded, which has at most one operation in flight.
+    struct slot {
+        slot_state state = slot_state::FREE;
+        std::size_t index = 0;
+        std::string path;
+        int fd = -1;
+        std::unique_ptr<char[]> data;
+        std::size_t size = 0;
+        std::size_t done = 0;
+    };
+    std::vector<slot> slots(opts.queueDepth);
+    std::vector<std::size_t> free_slots;
+    for (std::size_t i = slots.size(); i > 0; --i) {
+        free_slots.push_back(i - 1);
+    }
+    std::deque<std::size_t> waiting;
+    std::size_t next = 0;
+    std::size_t in_flight = 0;
+    std::size_t buffered = 0;
+    std::size_t found = 0;
+
+    const auto submit_open = [&](std::size_t id) {
+        slot& s = slots[id];
+        io_uring_sqe& entry = ring->next();
+        entry.opcode = IORING_OP_OPENAT;
+        entry.fd = AT_FDCWD;
+        entry.addr = reinterpret_cast<std::uint64_t>(s.path.c_str());
+        entry.open_flags = O_RDONLY | O_CLOEXEC;
+        entry.user_data = id;
+        s.state = slot_state::OPENING;
+        ++in_flight;
+    };
+    const auto submit_read = [&](std::size_t id) {
+        slot& s = slots[id];
+        io_uring_sqe& entry = ring->next();
+        entry.opcode = IORING_OP_READ;
+        entry.fd = s.fd;
+        entry.addr = reinterpret_cast<std::uint64_t>(s.data.get() + s.done);
+        entry.len = static_cast<std::uint32_t>(std::min<std::size_t>(s.size - s.done, 1u << 30));
+        entry.off = s.done;
+        entry.user_data = id;
+        s.state = slot_state::READING;
+        ++in_flight;
+    };
+    const auto finish = [&](std::size_t id) {
+        slot& s = slots[id];
+        if (s.fd >= 0) {
+            ::close(s.fd);
+        }
+        buffered -= s.data ? s.size : 0;
+        s.fd = -1;
+        s.data.reset();
+        s.state = slot_state::FREE;
+        free_slots.push_back(id);
+    };
+    const auto complete = [&](std::uint64_t user_data, int result) {
+        const auto id = static_cast<std::size_t>(user_data);
+        slot& s = slots[id];
+        --in_flight;
+        if (result == -EINTR || result == -EAGAIN) {
+            if (s.state == slot_state::READING) {
+                submit_read(id);
+            } else {
+                submit_open(id);
+            }
+            return;
+        }
+        if (s.state == slot_state::OPENING) {
+            if (result == -ENOENT) {
+                finish(id);
+                return;
+            }
+            if (result < 0) {
+                const std::string message = "could not open: '" + s.path + "'";
+                finish(id);
+                throw std::runtime_error(message);
+            }
+            s.fd = result;
+            struct stat info;
+            if (::fstat(s.fd, &info) != 0) {
+                const std::string message = "could not read: '" + s.path + "'";
+                finish(id);
+                throw std::runtime_error(message);
+            }
+            s.size = static_cast<std::size_t>(info.st_size);
+            s.done = 0;
+            s.state = slot_state::WAITING;
+            waiting.push_back(id);
+            return;
+        }
+        if (result <= 0) {
+            const std::string message = "could not read: '" + s.path + "'";
+            finish(id);
+            throw std::runtime_error(message);
+        }
+        s.done += static_cast<std::size_t>(result);
+        if (s.done < s.size) {
+            submit_read(id);
+            return;
+        }
+        ::close(s.fd);
+        s.fd = -1;
+        // Hand the slot back first so a throwing callback leaks nothing.
+        const std::unique_ptr<char[]> data = std::move(s.data);
+        const tile_address& address = tiles[s.index];
+        const std::size_t size = s.size;
+        buffered -= size;
+        s.state = slot_state::FREE;
+        free_slots.push_back(id);
+        callback(address, protozero::data_view(data.get(), size));
+        ++found;
+    };
+
+    try {
+        for (;;) {
+            while (next < tiles.size() && !free_slots.empty()) {
+                const std::size_t id = free_slots.back();
+                free_slots.pop_back();
+                slots[id].index = next++;
+                slots[id].path = path(tiles[slots[id].index]);
+                submit_open(id);
+            }
+            while (!waiting.empty()) {
+                slot& s = slots[waiting.front()];
+                if (buffered > 0 && buffered + s.size > opts.memoryBudget) {
+                    break;
+                }
+                const std::size_t id = waiting.front();
+                waiting.pop_front();
+                if (s.size == 0) {
+                    // Empty tiles need no read.
+                    ::close(s.fd);
+                    s.fd = -1;
+                    s.state = slot_state::FREE;
+                    free_slots.push_back(id);
+                    callback(tiles[s.index], protozero::data_view());
+                    ++found;
+                    continue;
+                }
+                s.data.reset(new char[s.size]);
+                buffered += s.size;
+                submit_read(id);
+            }
+            if (in_flight == 0) {
+                break;
+            }
+            ring->submitAndWait();
+            ring->drain(complete);
+        }
+    } catch (...) {
+        // The kernel may still write into slot buffers, wait for it.
+        while (in_flight > 0) {
+            ring->submitAndWait();
+            ring->drain([&](std::uint64_t user_data, int result) {
+                slot& s = slots[static_cast<std::size_t>(user_data)];
+                --in_flight;
+                if (s.state == slot_state::OPENING && result >= 0) {
+                    s.fd = result;
+                }
+            });
+        }
+        for (auto& s : slots) {
+            if (s.fd >= 0) {
+                ::close(s.fd);
+                s.fd = -1;
+            }
+        }
+        throw;
+    }
+    return found;
+}
+
+#endif
+
+}} // namespace mapbox/vector_tile
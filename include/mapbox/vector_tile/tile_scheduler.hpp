@@ -0,0 +1,390 @@
+#pragma once
+
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/mapped_file.hpp>
+#include <mapbox/vector_tile/tile_cache.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mapbox { namespace vector_tile {
+
+/// The center of a view, in tiles at zoom level z.
+struct tile_view {
+    double x = 0;
+    double y = 0;
+    std::uint32_t z = 0;
+};
+
+/**
+ * Priority of a tile for a view, lower values are more urgent: the distance
+ * of the tile center from the view center in tiles of its zoom level, plus
+ * zoom_weight for every level between the tile and the view.
+ */
+inline double tilePriority(tile_address const& tile, tile_view const& view, double zoom_weight = 4.0) {
+    const double scale = std::ldexp(1.0, static_cast<int>(tile.z) - static_cast<int>(view.z));
+    const double dx = tile.x + 0.5 - view.x * scale;
+    const double dy = tile.y + 0.5 - view.y * scale;
+    const double levels = std::abs(static_cast<double>(tile.z) - static_cast<double>(view.z));
+    return std::sqrt(dx * dx + dy * dy) + zoom_weight * levels;
+}
+
+struct tile_scheduler_options {
+    /// Decoding threads, 0 for one per core.
+    unsigned threads = 0;
+    /// Queued tiles, most urgent first, whose data is advised to be read ahead of decoding.
+    std::size_t readAhead = 16;
+    buffer::open_mode openMode = buffer::SCAN;
+};
+
+/**
+ * Decodes requested tiles on a pool of threads, most urgent first:
+ *
+ *     tile_scheduler scheduler(
+ *         [&archive](tile_key const& key) { return archive.getTile(key.address.z, key.address.x, key.address.y); },
+ *         [](tile_key const& key, buffer const& tile) { ... },
+ *         tile_scheduler_options());
+ *     for (auto const& key : visible) {
+ *         scheduler.request(key, tilePriority(key.address, view));
+ *     }
+ *
+ * The locate function returns the data of a tile, typically a view into a
+ * mapped_file or pmtiles_reader, or nothing for missing tiles. Each tile is
+ * opened as a buffer and passed to the decoded function on one of the
+ * threads. After decoding a tile, the thread advises the data of the next
+ * readAhead queued tiles in priority order with madvise(MADV_WILLNEED), so
+ * the kernel reads their pages in the background.
+ *
+ * Requesting a queued tile again changes its priority. When the view moves,
+ * reprioritize() rescores every queued tile and rebuilds the queue in
+ * linear time; tiles that are already being decoded are not affected.
+ * Errors from the functions or from decoding are reported by wait().
+ */
+class tile_scheduler {
+public:
+    using locate_function = std::function<std::optional<protozero::data_view>(tile_key const&)>;
+    using decoded_function = std::function<void(tile_key const&, buffer const&)>;
+
+    tile_scheduler(locate_function locate, decoded_function decoded, tile_scheduler_options options = tile_scheduler_options());
+    /// Drops queued tiles and waits for those being decoded.
+    ~tile_scheduler();
+    tile_scheduler(tile_scheduler const&) = delete;
+    tile_scheduler& operator=(tile_scheduler const&) = delete;
+
+    /// Queue a tile, or change its priority if it is queued already.
+    void request(tile_key const& key, double priority);
+    /// Remove a tile from the queue, returning whether it was queued.
+    bool cancel(tile_key const& key);
+    /// Set the priority of every queued tile, called with the queue locked.
+    void reprioritize(std::function<double(tile_key const&)> const& priority);
+    /// Remove all queued tiles.
+    void clear();
+    /// Wait until the queue is empty and no tile is being decoded, rethrowing the first error since the last wait.
+    void wait();
+    /// Number of queued tiles.
+    std::size_t size() const;
+
+private:
+    struct queued_tile {
+        double priority;
+        std::uint64_t generation;
+        std::optional<protozero::data_view> data;
+        bool located = false;
+        bool advised = false;
+    };
+
+    // Heap entries, superseded ones are skipped when they come up.
+    struct queue_entry {
+        double priority;
+        std::uint64_t generation;
+        tile_key key;
+    };
+
+    struct later {
+        bool operator()(queue_entry const& lhs, queue_entry const& rhs) const {
+            if (lhs.priority < rhs.priority || rhs.priority < lhs.priority) {
+                return rhs.priority < lhs.priority;
+            }
+            return lhs.generation > rhs.generation;
+        }
+    };
+
+    bool isCurrent(queue_entry const& entry) const;
+    void rebuildQueue();
+    // Take the most urgent tile from the queue, with the mutex locked.
+    bool popTile(tile_key& key, queued_tile& tile);
+    // Tiles among the next readAhead that have not been advised yet, with the mutex locked.
+    std::vector<tile_key> takeReadAhead();
+    void readAhead(std::vector<tile_key> const& keys);
+    void decode(tile_key const& key, queued_tile& tile);
+    void work();
+
+    locate_function locate;
+    decoded_function decoded;
+    tile_scheduler_options opts;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::condition_variable idle;
+    std::unordered_map<tile_key, queued_tile, detail::tile_key_hash> tiles;
+    std::vector<queue_entry> queue;
+    std::uint64_t nextGeneration = 0;
+    std::size_t running = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::vector<std::thread> threads;
+};
+
+namespace detail {
+
+// Ask the kernel to read the pages holding the data, for mapped memory.
+inline void adviseWillNeed(protozero::data_view const& data) {
+#ifdef MAPBOX_VECTOR_TILE_HAS_MMAP
+    if (data.size() == 0) {
+        return;
+    }
+    static const auto page_size = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<std::uintptr_t>(data.data()) & ~(page_size - 1);
+    const auto end = reinterpret_cast<std::uintptr_t>(data.data()) + data.size();
+    // Advice only affects performance, failures are ignored.
+    ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+#else
+    (void)data;
+#endif
+}
+
+} // namespace detail
+
+inline tile_scheduler::tile_scheduler(locate_function locate_, decoded_function decoded_, tile_scheduler_options options)
+    : locate(std::move(locate_)),
+      decoded(std::move(decoded_)),
+      opts(options) {
+    const unsigned thread_count = opts.threads ? opts.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    threads.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        threads.emplace_back([this]() { work(); });
+    }
+}
+
+inline tile_scheduler::~tile_scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        tiles.clear();
+        queue.clear();
+    }
+    changed.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+inline bool tile_scheduler::isCurrent(queue_entry const& entry) const {
+    const auto it = tiles.find(entry.key);
+    return it != tiles.end() && it->second.generation == entry.generation;
+}
+
+inline void tile_scheduler::rebuildQueue() {
+    queue.clear();
+    queue.reserve(tiles.size());
+    for (auto const& tile : tiles) {
+        queue.push_back(queue_entry{ tile.second.priority, tile.second.generation, tile.first });
+    }
+    std::make_heap(queue.begin(), queue.end(), later());
+}
+
+inline void tile_scheduler::request(tile_key const& key, double priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = tiles.find(key);
+        if (it == tiles.end()) {
+            it = tiles.emplace(key, queued_tile{ priority, nextGeneration, std::nullopt }).first;
+        } else {
+            it->second.priority = priority;
+            it->second.generation = nextGeneration;
+        }
+        ++nextGeneration;
+        if (queue.size() > 2 * tiles.size() + 64) {
+            rebuildQueue();
+        } else {
+            queue.push_back(queue_entry{ priority, it->second.generation, key });
+            std::push_heap(queue.begin(), queue.end(), later());
+        }
+    }
+    changed.notify_one();
+}
+
+inline bool tile_scheduler::cancel(tile_key const& key) {
+    bool empty = false;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        found = tiles.erase(key) > 0;
+        empty = tiles.empty() && running == 0;
+    }
+    if (empty) {
+        idle.notify_all();
+    }
+    return found;
+}
+
+inline void tile_scheduler::reprioritize(std::function<double(tile_key const&)> const& priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& tile : tiles) {
+        tile.second.priority = priority(tile.first);
+    }
+    rebuildQueue();
+}
+
+inline void tile_scheduler::clear() {
+    bool empty = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles.clear();
+        queue.clear();
+        empty = running == 0;
+    }
+    if (empty) {
+        idle.notify_all();
+    }
+}
+
+inline void tile_scheduler::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return tiles.empty() && running == 0; });
+    if (error) {
+        std::exception_ptr first = std::move(error);
+        error = nullptr;
+        std::rethrow_exception(first);
+    }
+}
+
+inline std::size_t tile_scheduler::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tiles.size();
+}
+
+inline bool tile_scheduler::popTile(tile_key& key, queued_tile& tile) {
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), later());
+        const queue_entry entry = queue.back();
+        queue.pop_back();
+        const auto it = tiles.find(entry.key);
+        if (it != tiles.end() && it->second.generation == entry.generation) {
+            key = entry.key;
+            tile = std::move(it->second);
+            tiles.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline std::vector<tile_key> tile_scheduler::takeReadAhead() {
+    std::vector<tile_key> keys;
+    std::vector<queue_entry> next;
+    while (next.size() < opts.readAhead && !queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), later());
+        if (isCurrent(queue.back())) {
+            next.push_back(std::move(queue.back()));
+        }
+        queue.pop_back();
+    }
+    for (auto& entry : next) {
+        queued_tile& tile = tiles.find(entry.key)->second;
+        if (!tile.advised) {
+            tile.advised = true;
+            keys.push_back(entry.key);
+        }
+        queue.push_back(std::move(entry));
+        std::push_heap(queue.begin(), queue.end(), later());
+    }
+    return keys;
+}
+
+inline void tile_scheduler::readAhead(std::vector<tile_key> const& keys) {
+    std::vector<std::pair<tile_key, std::optional<protozero::data_view>>> located;
+    located.reserve(keys.size());
+    for (auto const& key : keys) {
+        try {
+            located.emplace_back(key, locate(key));
+        } catch (...) {
+            // Located again and reported when the tile is decoded.
+            continue;
+        }
+        if (located.back().second) {
+            detail::adviseWillNeed(*located.back().second);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : located) {
+        const auto it = tiles.find(entry.first);
+        if (it != tiles.end()) {
+            it->second.data = entry.second;
+            it->second.located = true;
+        }
+    }
+}
+
+inline void tile_scheduler::decode(tile_key const& key, queued_tile& tile) {
+    if (!tile.located) {
+        tile.data = locate(key);
+    }
+    if (tile.data) {
+        const buffer data(*tile.data, opts.openMode);
+        decoded(key, data);
+    }
+}
+
+inline void tile_scheduler::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        tile_key key;
+        queued_tile tile{ 0, 0, std::nullopt };
+        if (!popTile(key, tile)) {
+            continue;
+        }
+        ++running;
+        lock.unlock();
+        try {
+            decode(key, tile);
+            // Read ahead only once the popped tile is done, so its decode
+            // never waits for other tiles to be located.
+            std::vector<tile_key> ahead;
+            {
+                std::lock_guard<std::mutex> ahead_lock(mutex);
+                ahead = takeReadAhead();
+            }
+            if (!ahead.empty()) {
+                readAhead(ahead);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> error_lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        lock.lock();
+        --running;
+        if (tiles.empty() && running == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,386 @@
+#pragma once
+
+#include <protozero/types.hpp>
+#include <protozero/varint.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <unistd.h>
+#define MAPBOX_VECTOR_TILE_HAS_FD_STREAMS 1
+#endif
+
+namespace mapbox { namespace vector_tile {
+
+struct tile_stream_options {
+    /// Frame buffers in the ring, the memory used is bounded by bufferCount * maxFrameSize.
+    std::size_t bufferCount = 4;
+    /// Frames larger than this are rejected.
+    std::size_t maxFrameSize = 64 * 1024 * 1024;
+    /// Read frames ahead on a second thread while the caller decodes.
+    bool readAhead = false;
+};
+
+/**
+ * Reads a stream of length-prefixed tiles, each a varint byte count
+ * followed by the tile data as in protobuf's delimited message format:
+ *
+ *     tile_stream_reader reader(STDIN_FILENO);
+ *     while (auto data = reader.next()) {
+ *         buffer tile(*data);
+ *         ...
+ *     }
+ *
+ * Frames are read into a ring of reused buffers, so memory stays bounded
+ * however long the stream is. A view returned by next() is valid until the
+ * following call. With readAhead a second thread fills the other buffers of
+ * the ring meanwhile; destroying such a reader before the end of the stream
+ * waits for a read already in progress.
+ */
+class tile_stream_reader {
+public:
+    /// Reads up to size bytes into data, returning 0 at the end of the stream.
+    using read_function = std::function<std::size_t(char* data, std::size_t size)>;
+
+    explicit tile_stream_reader(read_function read, tile_stream_options options = tile_stream_options());
+    explicit tile_stream_reader(std::istream& stream, tile_stream_options options = tile_stream_options());
+#ifdef MAPBOX_VECTOR_TILE_HAS_FD_STREAMS
+    explicit tile_stream_reader(int fd, tile_stream_options options = tile_stream_options());
+#endif
+    ~tile_stream_reader();
+    tile_stream_reader(tile_stream_reader const&) = delete;
+    tile_stream_reader& operator=(tile_stream_reader const&) = delete;
+
+    /// The next tile, or nothing at the end of the stream.
+    std::optional<protozero::data_view> next();
+
+private:
+    struct frame_buffer {
+        std::unique_ptr<char[]> data;
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+    };
+
+    static constexpr std::size_t no_slot = static_cast<std::size_t>(-1);
+    static constexpr std::size_t staging_size = 64 * 1024;
+
+    // Read a frame, returning false at a clean end of the stream.
+    bool readFrame(frame_buffer& frame);
+    bool readByte(char& byte);
+    void readExactly(char* data, std::size_t size);
+    void produce();
+
+    read_function readSome;
+    tile_stream_options opts;
+    std::unique_ptr<char[]> staging;
+    std::size_t stagingBegin = 0;
+    std::size_t stagingEnd = 0;
+    std::vector<frame_buffer> slots;
+    std::size_t current = no_slot;
+
+    // Shared with the read-ahead thread.
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::size_t> freeSlots;
+    std::deque<std::size_t> filledSlots;
+    bool finished = false;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::thread reader;
+};
+
+/**
+ * Writes tiles as a length-prefixed stream readable by tile_stream_reader.
+ * Small frames are collected in a buffer and written together, large ones
+ * are written directly. The destructor flushes but ignores errors, call
+ * flush() to see them.
+ */
+class tile_stream_writer {
+public:
+    using write_function = std::function<void(const char* data, std::size_t size)>;
+
+    explicit tile_stream_writer(write_function write, std::size_t buffer_size = 64 * 1024);
+    explicit tile_stream_writer(std::ostream& stream, std::size_t buffer_size = 64 * 1024);
+#ifdef MAPBOX_VECTOR_TILE_HAS_FD_STREAMS
+    explicit tile_stream_writer(int fd, std::size_t buffer_size = 64 * 1024);
+#endif
+    ~tile_stream_writer();
+    tile_stream_writer(tile_stream_writer const&) = delete;
+    tile_stream_writer& operator=(tile_stream_writer const&) = delete;
+
+    void write(protozero::data_view const& tile);
+    void flush();
+
+private:
+    write_function writeAll;
+    std::size_t bufferSize;
+    std::string pending;
+};
+
+inline tile_stream_reader::tile_stream_reader(read_function read, tile_stream_options options)
+    : readSome(std::move(read)),
+      opts(options),
+      staging(new char[staging_size]) {
+    opts.bufferCount = std::max<std::size_t>(opts.bufferCount, opts.readAhead ? 2 : 1);
+    slots.resize(opts.bufferCount);
+    if (opts.readAhead) {
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            freeSlots.push_back(i);
+        }
+        reader = std::thread([this]() { produce(); });
+    }
+}
+
+inline tile_stream_reader::tile_stream_reader(std::istream& stream, tile_stream_options options)
+    : tile_stream_reader([&stream](char* data, std::size_t size) -> std::size_t {
+          stream.read(data, static_cast<std::streamsize>(size));
+          if (stream.bad()) {
+              throw std::runtime_error("could not read tile stream");
+          }
+          return static_cast<std::size_t>(stream.gcount());
+      }, options) {
+}
+
+#ifdef MAPBOX_VECTOR_TILE_HAS_FD_STREAMS
+inline tile_stream_reader::tile_stream_reader(int fd, tile_stream_options options)
+    : tile_stream_reader([fd](char* data, std::size_t size) -> std::size_t {
+          for (;;) {
+              const ssize_t result = ::read(fd, data, size);
+              if (result >= 0) {
+                  return static_cast<std::size_t>(result);
+              }
+              if (errno != EINTR) {
+                  throw std::runtime_error("could not read tile stream");
+              }
+          }
+      }, options) {
+}
+#endif
+
+inline tile_stream_reader::~tile_stream_reader() {
+    if (reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        reader.join();
+    }
+}
+
+inline bool tile_stream_reader::readByte(char& byte) {
+    if (stagingBegin == stagingEnd) {
+        stagingBegin = 0;
+        stagingEnd = readSome(staging.get(), staging_size);
+        if (stagingEnd == 0) {
+            return false;
+        }
+    }
+    byte = staging[stagingBegin++];
+    return true;
+}
+
+inline void tile_stream_reader::readExactly(char* data, std::size_t size) {
+    // Use what is staged and refill the staging buffer for small frames,
+    // large frames are read directly.
+    std::size_t done = 0;
+    for (;;) {
+        const std::size_t staged = std::min(size - done, stagingEnd - stagingBegin);
+        std::copy_n(staging.get() + stagingBegin, staged, data + done);
+        stagingBegin += staged;
+        done += staged;
+        if (done == size) {
+            return;
+        }
+        const bool direct = size - done >= staging_size;
+        const std::size_t result = direct ? readSome(data + done, size - done) : readSome(staging.get(), staging_size);
+        if (result == 0) {
+            throw std::runtime_error("truncated tile stream");
+        }
+        if (direct) {
+            done += result;
+        } else {
+            stagingBegin = 0;
+            stagingEnd = result;
+        }
+    }
+}
+
+inline bool tile_stream_reader::readFrame(frame_buffer& frame) {
+    std::uint64_t length = 0;
+    char byte = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        if (!readByte(byte)) {
+            if (shift == 0) {
+                return false;
+            }
+            throw std::runtime_error("truncated tile stream");
+        }
+        if (shift >= 64) {
+            throw std::runtime_error("invalid tile stream frame length");
+        }
+        length |= std::uint64_t(static_cast<unsigned char>(byte) & 0x7fu) << shift;
+        if (!(static_cast<unsigned char>(byte) & 0x80u)) {
+            break;
+        }
+    }
+    if (length > opts.maxFrameSize) {
+        throw std::runtime_error("tile stream frame exceeds the size limit");
+    }
+    const auto size = static_cast<std::size_t>(length);
+    if (size > frame.capacity) {
+        frame.data.reset();
+        frame.data.reset(new char[size]);
+        frame.capacity = size;
+    }
+    frame.size = size;
+    readExactly(frame.data.get(), size);
+    return true;
+}
+
+inline void tile_stream_reader::produce() {
+    try {
+        for (;;) {
+            std::size_t slot = no_slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this]() { return stopping || !freeSlots.empty(); });
+                if (stopping) {
+                    return;
+                }
+                slot = freeSlots.front();
+                freeSlots.pop_front();
+            }
+            const bool more = readFrame(slots[slot]);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (more) {
+                    filledSlots.push_back(slot);
+                } else {
+                    finished = true;
+                }
+            }
+            changed.notify_all();
+            if (!more) {
+                return;
+            }
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            finished = true;
+        }
+        changed.notify_all();
+    }
+}
+
+inline std::optional<protozero::data_view> tile_stream_reader::next() {
+    if (!opts.readAhead) {
+        frame_buffer& frame = slots[0];
+        if (!readFrame(frame)) {
+            return std::nullopt;
+        }
+        return protozero::data_view(frame.data.get(), frame.size);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    if (current != no_slot) {
+        freeSlots.push_back(current);
+        current = no_slot;
+        changed.notify_all();
+    }
+    changed.wait(lock, [this]() { return finished || !filledSlots.empty(); });
+    if (!filledSlots.empty()) {
+        current = filledSlots.front();
+        filledSlots.pop_front();
+        return protozero::data_view(slots[current].data.get(), slots[current].size);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return std::nullopt;
+}
+
+inline tile_stream_writer::tile_stream_writer(write_function write, std::size_t buffer_size)
+    : writeAll(std::move(write)),
+      bufferSize(buffer_size) {
+    pending.reserve(bufferSize + protozero::max_varint_length);
+}
+
+inline tile_stream_writer::tile_stream_writer(std::ostream& stream, std::size_t buffer_size)
+    : tile_stream_writer([&stream](const char* data, std::size_t size) {
+          if (!stream.write(data, static_cast<std::streamsize>(size))) {
+              throw std::runtime_error("could not write tile stream");
+          }
+      }, buffer_size) {
+}
+
+#ifdef MAPBOX_VECTOR_TILE_HAS_FD_STREAMS
+inline tile_stream_writer::tile_stream_writer(int fd, std::size_t buffer_size)
+    : tile_stream_writer([fd](const char* data, std::size_t size) {
+          std::size_t done = 0;
+          while (done < size) {
+              const ssize_t result = ::write(fd, data + done, size - done);
+              if (result < 0 && errno == EINTR) {
+                  continue;
+              }
+              if (result <= 0) {
+                  throw std::runtime_error("could not write tile stream");
+              }
+              done += static_cast<std::size_t>(result);
+          }
+      }, buffer_size) {
+}
+#endif
+
+inline tile_stream_writer::~tile_stream_writer() {
+    try {
+        flush();
+    } catch (...) {
+        // Destructors must not throw, flush() reports errors.
+    }
+}
+
+inline void tile_stream_writer::write(protozero::data_view const& tile) {
+    protozero::write_varint(std::back_inserter(pending), tile.size());
+    if (tile.size() >= bufferSize) {
+        flush();
+        writeAll(tile.data(), tile.size());
+        return;
+    }
+    pending.append(tile.data(), tile.size());
+    if (pending.size() >= bufferSize) {
+        flush();
+    }
+}
+
+inline void tile_stream_writer::flush() {
+    if (!pending.empty()) {
+        // Clear first so a failed write is not repeated by the destructor.
+        std::string data;
+        data.swap(pending);
+        writeAll(data.data(), data.size());
+        data.clear();
+        pending.swap(data);
+    }
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,720 @@
+#pragma once
+
+#include "vector_tile_config.hpp"
+#include "builder.hpp"
+#include "hilbert.hpp"
+#include <mapbox/vector_tile.hpp>
+#include <protozero/pbf_reader.hpp>
+#include <protozero/pbf_writer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace mapbox { namespace vector_tile {
+
+/**
+ * Selects what transcode() keeps of a tile.
+ */
+struct transcode_options {
+    // Names of the layers to keep, all layers are kept if empty.
+    std::unordered_set<std::string> layers;
+    // Keys to keep per layer name, layers without an entry keep all keys.
+    std::unordered_map<std::string, std::unordered_set<std::string>> keys;
+};
+
+namespace detail {
+
+// Views of the parts of a layer message, reused from layer to layer.
+struct layer_parts {
+    protozero::data_view name;
+    std::uint32_t version = 1;
+    std::uint32_t extent = 4096;
+    bool hasName = false;
+    bool hasVersion = false;
+    bool hasExtent = false;
+    std::vector<protozero::data_view> keys;
+    std::vector<protozero::data_view> values;
+    std::vector<protozero::data_view> features;
+
+    void read(protozero::data_view const& layer_view) {
+        hasName = hasVersion = hasExtent = false;
+        version = 1;
+        extent = 4096;
+        keys.clear();
+        values.clear();
+        features.clear();
+        protozero::pbf_reader layer_pbf(layer_view);
+        while (layer_pbf.next()) {
+            switch (layer_pbf.tag()) {
+            case LayerType::NAME:
+                name = layer_pbf.get_view();
+                hasName = true;
+                break;
+            case LayerType::FEATURES:
+                features.push_back(layer_pbf.get_view());
+                break;
+            case LayerType::KEYS:
+                keys.push_back(layer_pbf.get_view());
+                break;
+            case LayerType::VALUES:
+                values.push_back(layer_pbf.get_view());
+                break;
+            case LayerType::EXTENT:
+                extent = layer_pbf.get_uint32();
+                hasExtent = true;
+                break;
+            case LayerType::VERSION:
+                version = layer_pbf.get_uint32();
+                hasVersion = true;
+                break;
+            default:
+                layer_pbf.skip();
+                break;
+            }
+        }
+        if (!hasName) {
+            throw std::runtime_error("Layer missing name");
+        }
+    }
+
+    void writeHeader(protozero::pbf_writer& layer_writer) const {
+        if (hasVersion) {
+            layer_writer.add_uint32(LayerType::VERSION, version);
+        }
+        layer_writer.add_string(LayerType::NAME, name);
+        if (hasExtent) {
+            layer_writer.add_uint32(LayerType::EXTENT, extent);
+        }
+    }
+};
+
+// Read the type and the packed geometry of a feature.
+inline protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator> featureGeometry(protozero::data_view const& feature_view, GeomType& type) {
+    protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator> geometry;
+    protozero::pbf_reader feature_pbf(feature_view);
+    while (feature_pbf.next()) {
+        switch (feature_pbf.tag()) {
+        case FeatureType::TYPE:
+            type = static_cast<GeomType>(feature_pbf.get_enum());
+            break;
+        case FeatureType::GEOMETRY:
+            geometry = feature_pbf.get_packed_uint32();
+            break;
+        default:
+            feature_pbf.skip();
+            break;
+        }
+    }
+    return geometry;
+}
+
+// Read the packed tags of a feature, leaving all other fields untouched.
+inline protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator> featureTags(protozero::data_view const& feature_view) {
+    protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator> tags;
+    protozero::pbf_reader feature_pbf(feature_view);
+    while (feature_pbf.next(FeatureType::TAGS)) {
+        tags = feature_pbf.get_packed_uint32();
+    }
+    return tags;
+}
+
+// Write a feature replacing its tags and/or geometry. Fields without a
+// replacement are copied, packed fields byte for byte without decoding.
+inline void writeFeature(protozero::pbf_writer& layer_writer, protozero::data_view const& feature_view,
+                         std::vector<std::uint32_t> const* tags, std::vector<std::uint32_t> const* geometry = nullptr) {
+    protozero::pbf_writer feature_writer(layer_writer, LayerType::FEATURES);
+    protozero::pbf_reader feature_pbf(feature_view);
+    while (feature_pbf.next()) {
+        switch (feature_pbf.tag()) {
+        case FeatureType::ID:
+            feature_writer.add_uint64(FeatureType::ID, feature_pbf.get_uint64());
+            break;
+        case FeatureType::TAGS:
+            if (tags) {
+                feature_pbf.skip();
+                feature_writer.add_packed_uint32(FeatureType::TAGS, tags->begin(), tags->end());
+            } else {
+                feature_writer.add_bytes(FeatureType::TAGS, feature_pbf.get_view());
+            }
+            break;
+        case FeatureType::TYPE:
+            feature_writer.add_enum(FeatureType::TYPE, feature_pbf.get_enum());
+            break;
+        case FeatureType::GEOMETRY:
+            if (geometry) {
+                feature_pbf.skip();
+                feature_writer.add_packed_uint32(FeatureType::GEOMETRY, geometry->begin(), geometry->end());
+            } else {
+                feature_writer.add_bytes(FeatureType::GEOMETRY, feature_pbf.get_view());
+            }
+            break;
+        default:
+            feature_pbf.skip();
+            break;
+        }
+    }
+}
+
+} // namespace detail
+
+/**
+ * Write a copy of a tile keeping only the layers and keys selected by the
+ * options, appending it to output.
+ *
+ * Layers without dropped keys are copied byte for byte. Otherwise the key and
+ * value tables are compacted to the entries still referenced, and features
+ * are copied byte for byte unless their tags change, in which case only the
+ * tags are rewritten. Geometries are never decoded.
+ */
+inline void transcode(protozero::data_view const& tile, transcode_options const& options, std::string& output) {
+    constexpr std::uint32_t dropped = std::numeric_limits<std::uint32_t>::max();
+    protozero::deferred_lengths lengths;
+    protozero::pbf_writer tile_writer(output, lengths);
+    detail::layer_parts parts;
+    std::vector<std::uint32_t> key_map;
+    std::vector<std::uint32_t> value_map;
+    std::vector<std::uint32_t> tags;
+
+    protozero::pbf_reader tile_reader(tile);
+    while (tile_reader.next(TileType::LAYERS)) {
+        const protozero::data_view layer_view = tile_reader.get_view();
+        parts.read(layer_view);
+        const std::string name(parts.name.data(), parts.name.size());
+        if (!options.layers.empty() && options.layers.find(name) == options.layers.end()) {
+            continue;
+        }
+
+        const auto keys_it = options.keys.find(name);
+        key_map.assign(parts.keys.size(), dropped);
+        bool drops_keys = false;
+        std::uint32_t key_count = 0;
+        for (std::size_t i = 0; i < parts.keys.size(); ++i) {
+            if (keys_it == options.keys.end() ||
+                keys_it->second.find(std::string(parts.keys[i].data(), parts.keys[i].size())) != keys_it->second.end()) {
+                key_map[i] = key_count++;
+            } else {
+                drops_keys = true;
+            }
+        }
+        if (!drops_keys) {
+            tile_writer.add_message(TileType::LAYERS, layer_view);
+            continue;
+        }
+
+        // Keep the values still referenced by a kept key.
+        value_map.assign(parts.values.size(), dropped);
+        for (auto const& feature_view : parts.features) {
+            const auto feature_tags = detail::featureTags(feature_view);
+            auto tag_itr = feature_tags.begin();
+            while (tag_itr != feature_tags.end()) {
+                const std::uint32_t tag_key = *tag_itr++;
+                if (tag_itr == feature_tags.end()) {
+                    throw std::runtime_error("uneven number of feature tag ids");
+                }
+                const std::uint32_t tag_val = *tag_itr++;
+                if (tag_key >= key_map.size() || tag_val >= value_map.size()) {
+                    throw std::runtime_error("feature referenced out of range key or value");
+                }
+                if (key_map[tag_key] != dropped) {
+                    value_map[tag_val] = 0;
+                }
+            }
+        }
+        std::uint32_t value_count = 0;
+        for (auto& index : value_map) {
+            if (index != dropped) {
+                index = value_count++;
+            }
+        }
+
+        protozero::pbf_writer layer_writer(tile_writer, TileType::LAYERS);
+        parts.writeHeader(layer_writer);
+        for (std::size_t i = 0; i < parts.keys.size(); ++i) {
+            if (key_map[i] != dropped) {
+                layer_writer.add_string(LayerType::KEYS, parts.keys[i]);
+            }
+        }
+        for (std::size_t i = 0; i < parts.values.size(); ++i) {
+            if (value_map[i] != dropped) {
+                layer_writer.add_message(LayerType::VALUES, parts.values[i]);
+            }
+        }
+        for (auto const& feature_view : parts.features) {
+            const auto feature_tags = detail::featureTags(feature_view);
+            tags.clear();
+            bool changed = false;
+            for (auto tag_itr = feature_tags.begin(); tag_itr != feature_tags.end();) {
+                const std::uint32_t tag_key = *tag_itr++;
+                const std::uint32_t tag_val = *tag_itr++;
+                if (key_map[tag_key] == dropped) {
+                    changed = true;
+                    continue;
+                }
+                tags.push_back(key_map[tag_key]);
+                tags.push_back(value_map[tag_val]);
+                changed = changed || key_map[tag_key] != tag_key || value_map[tag_val] != tag_val;
+            }
+            if (changed) {
+                detail::writeFeature(layer_writer, feature_view, &tags);
+            } else {
+                layer_writer.add_message(LayerType::FEATURES, feature_view);
+            }
+        }
+    }
+    lengths.compact(output);
+}
+
+/**
+ * Merge several tiles into one, appending it to output.
+ *
+ * Layers with the same name are concatenated. Their key and value tables are
+ * unioned so each distinct key and value is written once, and the feature
+ * tags are remapped to the merged tables. Feature geometries are copied byte
+ * for byte. Layers only present in one tile are copied unchanged. The input
+ * tiles must stay alive during the call.
+ */
+inline void mergeTiles(std::vector<protozero::data_view> const& tiles, std::string& output) {
+    // Layer views grouped by name, in order of first appearance.
+    std::vector<std::pair<std::string_view, std::vector<protozero::data_view>>> layers;
+    std::unordered_map<std::string_view, std::size_t> layer_index;
+    for (auto const& tile : tiles) {
+        protozero::pbf_reader tile_reader(tile);
+        while (tile_reader.next(TileType::LAYERS)) {
+            const protozero::data_view layer_view = tile_reader.get_view();
+            protozero::pbf_reader layer_reader(layer_view);
+            if (!layer_reader.next(LayerType::NAME)) {
+                throw std::runtime_error("Layer missing name");
+            }
+            const protozero::data_view name = layer_reader.get_view();
+            const auto inserted = layer_index.emplace(std::string_view(name.data(), name.size()), layers.size());
+            if (inserted.second) {
+                layers.emplace_back(inserted.first->first, std::vector<protozero::data_view>());
+            }
+            layers[inserted.first->second].second.push_back(layer_view);
+        }
+    }
+
+    protozero::deferred_lengths lengths;
+    protozero::pbf_writer tile_writer(output, lengths);
+    detail::layer_parts parts;
+    std::unordered_map<std::string_view, std::uint32_t> keys;
+    std::unordered_map<std::string_view, std::uint32_t> values;
+    std::vector<std::string_view> key_table;
+    std::vector<std::string_view> value_table;
+    std::vector<std::uint32_t> key_map;
+    std::vector<std::uint32_t> value_map;
+    std::vector<std::uint32_t> tags;
+    for (auto const& named_layers : layers) {
+        auto const& layer_views = named_layers.second;
+        if (layer_views.size() == 1) {
+            tile_writer.add_message(TileType::LAYERS, layer_views.front());
+            continue;
+        }
+
+        // Union the tables of all layers first, the merged layer is written
+        // with keys and values ahead of the features.
+        keys.clear();
+        values.clear();
+        key_table.clear();
+        value_table.clear();
+        std::uint32_t version = 1;
+        std::uint32_t extent = 0;
+        for (auto const& layer_view : layer_views) {
+            parts.read(layer_view);
+            if (extent != 0 && parts.extent != extent) {
+                throw std::runtime_error("cannot merge layers with different extents");
+            }
+            extent = parts.extent;
+            version = std::max(version, parts.version);
+            for (auto const& key : parts.keys) {
+                if (keys.emplace(std::string_view(key.data(), key.size()), static_cast<std::uint32_t>(key_table.size())).second) {
+                    key_table.emplace_back(key.data(), key.size());
+                }
+            }
+            for (auto const& value : parts.values) {
+                if (values.emplace(std::string_view(value.data(), value.size()), static_cast<std::uint32_t>(value_table.size())).second) {
+                    value_table.emplace_back(value.data(), value.size());
+                }
+            }
+        }
+
+        protozero::pbf_writer layer_writer(tile_writer, TileType::LAYERS);
+        layer_writer.add_uint32(LayerType::VERSION, version);
+        layer_writer.add_string(LayerType::NAME, named_layers.first.data(), named_layers.first.size());
+        layer_writer.add_uint32(LayerType::EXTENT, extent);
+        for (auto const& key : key_table) {
+            layer_writer.add_string(LayerType::KEYS, key.data(), key.size());
+        }
+        for (auto const& value : value_table) {
+            layer_writer.add_message(LayerType::VALUES, value.data(), value.size());
+        }
+
+        for (auto const& layer_view : layer_views) {
+            parts.read(layer_view);
+            key_map.clear();
+            for (auto const& key : parts.keys) {
+                key_map.push_back(keys.find(std::string_view(key.data(), key.size()))->second);
+            }
+            value_map.clear();
+            for (auto const& value : parts.values) {
+                value_map.push_back(values.find(std::string_view(value.data(), value.size()))->second);
+            }
+
+            for (auto const& feature_view : parts.features) {
+                const auto feature_tags = detail::featureTags(feature_view);
+                tags.clear();
+                bool changed = false;
+                auto tag_itr = feature_tags.begin();
+                while (tag_itr != feature_tags.end()) {
+                    const std::uint32_t tag_key = *tag_itr++;
+                    if (tag_itr == feature_tags.end()) {
+                        throw std::runtime_error("uneven number of feature tag ids");
+                    }
+                    const std::uint32_t tag_val = *tag_itr++;
+                    if (tag_key >= key_map.size() || tag_val >= value_map.size()) {
+                        throw std::runtime_error("feature referenced out of range key or value");
+                    }
+                    tags.push_back(key_map[tag_key]);
+                    tags.push_back(value_map[tag_val]);
+                    changed = changed || key_map[tag_key] != tag_key || value_map[tag_val] != tag_val;
+                }
+                if (changed) {
+                    detail::writeFeature(layer_writer, feature_view, &tags);
+                } else {
+                    layer_writer.add_message(LayerType::FEATURES, feature_view);
+                }
+            }
+        }
+    }
+    lengths.compact(output);
+}
+
+namespace detail {
+
+// Collects the rescaled parts of a geometry, without consecutive duplicates.
+struct requantize_visitor {
+    using point_type = mapbox::geometry::point<std::int64_t>;
+
+    double scale = 1.0;
+    std::vector<point_type> points;
+    std::vector<std::size_t> partEnds;
+    // Twice the signed area of each part before rescaling.
+    std::vector<double> partAreas;
+    double area = 0.0;
+    std::int64_t startX = 0;
+    std::int64_t startY = 0;
+    std::int64_t lastX = 0;
+    std::int64_t lastY = 0;
+    bool open = false;
+
+    void reset(double scale_) {
+        scale = scale_;
+        points.clear();
+        partEnds.clear();
+        partAreas.clear();
+        open = false;
+    }
+    void finishPart() {
+        if (open) {
+            area += static_cast<double>(lastX) * static_cast<double>(startY) - static_cast<double>(startX) * static_cast<double>(lastY);
+            partEnds.push_back(points.size());
+            partAreas.push_back(area);
+            open = false;
+        }
+    }
+    void add(std::int64_t x, std::int64_t y) {
+        const point_type p(std::llround(static_cast<double>(x) * scale), std::llround(static_cast<double>(y) * scale));
+        const std::size_t part_start = partEnds.empty() ? 0 : partEnds.back();
+        if (points.size() == part_start || points.back() != p) {
+            points.push_back(p);
+        }
+    }
+    void moveTo(std::int64_t x, std::int64_t y) {
+        finishPart();
+        open = true;
+        area = 0.0;
+        startX = lastX = x;
+        startY = lastY = y;
+        add(x, y);
+    }
+    void lineTo(std::int64_t x, std::int64_t y) {
+        area += static_cast<double>(lastX) * static_cast<double>(y) - static_cast<double>(x) * static_cast<double>(lastY);
+        lastX = x;
+        lastY = y;
+        add(x, y);
+    }
+    void closePath() {
+        finishPart();
+    }
+};
+
+inline double ringArea(std::vector<mapbox::geometry::point<std::int64_t>> const& points, std::size_t begin, std::size_t end) {
+    double area = 0.0;
+    for (std::size_t i = begin, j = end - 1; i < end; j = i++) {
+        area += static_cast<double>(points[j].x) * static_cast<double>(points[i].y) -
+                static_cast<double>(points[i].x) * static_cast<double>(points[j].y);
+    }
+    return area;
+}
+
+// Encode the rescaled parts, dropping lines and rings that collapsed. Holes
+// of a dropped exterior ring are dropped with it.
+inline void encodeRequantized(GeomType type, requantize_visitor const& parts, std::vector<std::uint32_t>& commands) {
+    commands.clear();
+    geometry_encoder encoder(commands);
+    if (type == GeomType::POINT) {
+        // Every point is a part of its own, collapse duplicates across them.
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < parts.points.size(); ++i) {
+            count += (i == 0 || parts.points[i] != parts.points[i - 1]) ? 1 : 0;
+        }
+        if (count > 0) {
+            encoder.command(CommandType::MOVE_TO, count);
+            for (std::size_t i = 0; i < parts.points.size(); ++i) {
+                if (i == 0 || parts.points[i] != parts.points[i - 1]) {
+                    encoder.vertex(parts.points[i]);
+                }
+            }
+        }
+        return;
+    }
+    bool keep_holes = false;
+    std::size_t begin = 0;
+    for (std::size_t part = 0; part < parts.partEnds.size(); ++part) {
+        std::size_t end = parts.partEnds[part];
+        const std::size_t part_begin = begin;
+        begin = end;
+        if (type == GeomType::POLYGON) {
+            if (end - part_begin > 1 && parts.points[part_begin] == parts.points[end - 1]) {
+                --end;
+            }
+            const bool exterior = parts.partAreas[part] > 0.0;
+            const double area = end - part_begin >= 3 ? ringArea(parts.points, part_begin, end) : 0.0;
+            const bool valid = area < 0.0 || area > 0.0;
+            if (exterior) {
+                keep_holes = valid;
+            }
+            if (!valid || (!exterior && !keep_holes)) {
+                continue;
+            }
+        } else if (end - part_begin < 2) {
+            continue;
+        }
+        encoder.command(CommandType::MOVE_TO, 1);
+        encoder.vertex(parts.points[part_begin]);
+        encoder.command(CommandType::LINE_TO, end - part_begin - 1);
+        for (std::size_t i = part_begin + 1; i < end; ++i) {
+            encoder.vertex(parts.points[i]);
+        }
+        if (type == GeomType::POLYGON) {
+            encoder.command(CommandType::CLOSE, 1);
+        }
+    }
+}
+
+} // namespace detail
+
+/**
+ * Write a copy of a tile with every layer re-encoded at a new extent,
+ * appending it to output.
+ *
+ * Vertices are rescaled and rounded, consecutive duplicate vertices are
+ * collapsed, and lines, rings and features left without area or length are
+ * dropped. Keys, values, ids and tags are copied unchanged, as are layers
+ * already at the requested extent.
+ */
+inline void requantizeTile(protozero::data_view const& tile, std::uint32_t extent, std::string& output) {
+    if (extent == 0) {
+        throw std::runtime_error("extent must be positive");
+    }
+    protozero::deferred_lengths lengths;
+    protozero::pbf_writer tile_writer(output, lengths);
+    detail::layer_parts parts;
+    detail::requantize_visitor visitor;
+    std::vector<std::uint32_t> commands;
+
+    protozero::pbf_reader tile_reader(tile);
+    while (tile_reader.next(TileType::LAYERS)) {
+        const protozero::data_view layer_view = tile_reader.get_view();
+        parts.read(layer_view);
+        if (!parts.hasExtent) {
+            throw std::runtime_error("missing required field: extent");
+        }
+        if (parts.extent == 0) {
+            throw std::runtime_error("layer extent must be positive");
+        }
+        if (parts.extent == extent) {
+            tile_writer.add_message(TileType::LAYERS, layer_view);
+            continue;
+        }
+        const double scale = static_cast<double>(extent) / static_cast<double>(parts.extent);
+        parts.extent = extent;
+        parts.hasExtent = true;
+
+        protozero::pbf_writer layer_writer(tile_writer, TileType::LAYERS);
+        parts.writeHeader(layer_writer);
+        for (auto const& key : parts.keys) {
+            layer_writer.add_string(LayerType::KEYS, key);
+        }
+        for (auto const& value : parts.values) {
+            layer_writer.add_message(LayerType::VALUES, value);
+        }
+        for (auto const& feature_view : parts.features) {
+            GeomType type = GeomType::UNKNOWN;
+            const auto geometry = detail::featureGeometry(feature_view, type);
+            visitor.reset(scale);
+            detail::walkGeometry(geometry, visitor);
+            visitor.finishPart();
+            detail::encodeRequantized(type, visitor, commands);
+            if (!commands.empty()) {
+                detail::writeFeature(layer_writer, feature_view, nullptr, &commands);
+            }
+        }
+    }
+    lengths.compact(output);
+}
+
+namespace detail {
+
+// Hilbert index of the first vertex of a feature, clamped into the tile.
+inline std::uint64_t featureHilbertIndex(protozero::data_view const& feature_view, std::uint32_t extent) {
+    protozero::pbf_reader feature_pbf(feature_view);
+    while (feature_pbf.next(FeatureType::GEOMETRY)) {
+        const auto geometry = feature_pbf.get_packed_uint32();
+        auto itr = geometry.begin();
+        if (itr == geometry.end() || (*itr & 0x7) != CommandType::MOVE_TO || (*itr >> 3) == 0) {
+            break;
+        }
+        ++itr;
+        if (itr == geometry.end()) {
+            break;
+        }
+        const std::int64_t x = protozero::decode_zigzag32(*itr++);
+        if (itr == geometry.end()) {
+            break;
+        }
+        const std::int64_t y = protozero::decode_zigzag32(*itr);
+        std::uint64_t side = 1;
+        while (side < extent) {
+            side *= 2;
+        }
+        const auto clamp = [side](std::int64_t v) {
+            return static_cast<std::uint64_t>(std::clamp<std::int64_t>(v, 0, static_cast<std::int64_t>(side - 1)));
+        };
+        return hilbertIndex(side, clamp(x), clamp(y));
+    }
+    return std::numeric_limits<std::uint64_t>::max();
+}
+
+} // namespace detail
+
+/**
+ * Write a copy of a tile laid out for smaller size and better compression,
+ * appending it to output.
+ *
+ * Keys and values are ordered by how many tags reference them, so the most
+ * used ones get the shortest varint indices. Features are ordered along a
+ * Hilbert curve through their first vertex, which puts similar geometries
+ * next to each other for general purpose compressors. Geometries are not
+ * decoded.
+ *
+ * @return The number of bytes saved compared to the input tile.
+ */
+inline std::ptrdiff_t optimizeLayout(protozero::data_view const& tile, std::string& output) {
+    const std::size_t start_size = output.size();
+    protozero::deferred_lengths lengths;
+    protozero::pbf_writer tile_writer(output, lengths);
+    detail::layer_parts parts;
+    std::vector<std::size_t> key_counts;
+    std::vector<std::size_t> value_counts;
+    std::vector<std::uint32_t> key_order;
+    std::vector<std::uint32_t> value_order;
+    std::vector<std::uint32_t> key_map;
+    std::vector<std::uint32_t> value_map;
+    std::vector<std::pair<std::uint64_t, std::size_t>> feature_order;
+    std::vector<std::uint32_t> tags;
+
+    // Order table entries by descending reference count, stable otherwise.
+    const auto order_by_count = [](std::vector<std::size_t> const& counts, std::vector<std::uint32_t>& order, std::vector<std::uint32_t>& map) {
+        order.resize(counts.size());
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            order[i] = static_cast<std::uint32_t>(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&counts](std::uint32_t a, std::uint32_t b) { return counts[a] > counts[b]; });
+        map.resize(counts.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            map[order[i]] = static_cast<std::uint32_t>(i);
+        }
+    };
+
+    protozero::pbf_reader tile_reader(tile);
+    while (tile_reader.next(TileType::LAYERS)) {
+        parts.read(tile_reader.get_view());
+
+        key_counts.assign(parts.keys.size(), 0);
+        value_counts.assign(parts.values.size(), 0);
+        feature_order.clear();
+        for (std::size_t i = 0; i < parts.features.size(); ++i) {
+            const auto feature_tags = detail::featureTags(parts.features[i]);
+            auto tag_itr = feature_tags.begin();
+            while (tag_itr != feature_tags.end()) {
+                const std::uint32_t tag_key = *tag_itr++;
+                if (tag_itr == feature_tags.end()) {
+                    throw std::runtime_error("uneven number of feature tag ids");
+                }
+                const std::uint32_t tag_val = *tag_itr++;
+                if (tag_key >= key_counts.size() || tag_val >= value_counts.size()) {
+                    throw std::runtime_error("feature referenced out of range key or value");
+                }
+                ++key_counts[tag_key];
+                ++value_counts[tag_val];
+            }
+            feature_order.emplace_back(detail::featureHilbertIndex(parts.features[i], parts.extent), i);
+        }
+        order_by_count(key_counts, key_order, key_map);
+        order_by_count(value_counts, value_order, value_map);
+        std::stable_sort(feature_order.begin(), feature_order.end(),
+                         [](auto const& a, auto const& b) { return a.first < b.first; });
+
+        protozero::pbf_writer layer_writer(tile_writer, TileType::LAYERS);
+        parts.writeHeader(layer_writer);
+        for (auto const index : key_order) {
+            layer_writer.add_string(LayerType::KEYS, parts.keys[index]);
+        }
+        for (auto const index : value_order) {
+            layer_writer.add_message(LayerType::VALUES, parts.values[index]);
+        }
+        for (auto const& entry : feature_order) {
+            protozero::data_view const& feature_view = parts.features[entry.second];
+            const auto feature_tags = detail::featureTags(feature_view);
+            tags.clear();
+            bool changed = false;
+            for (auto tag_itr = feature_tags.begin(); tag_itr != feature_tags.end();) {
+                const std::uint32_t tag_key = *tag_itr++;
+                const std::uint32_t tag_val = *tag_itr++;
+                tags.push_back(key_map[tag_key]);
+                tags.push_back(value_map[tag_val]);
+                changed = changed || key_map[tag_key] != tag_key || value_map[tag_val] != tag_val;
+            }
+            if (changed) {
+                detail::writeFeature(layer_writer, feature_view, &tags);
+            } else {
+                layer_writer.add_message(LayerType::FEATURES, feature_view);
+            }
+        }
+    }
+    lengths.compact(output);
+    return static_cast<std::ptrdiff_t>(tile.size()) - static_cast<std::ptrdiff_t>(output.size() - start_size);
+}
+
+}} // namespace mapbox/vector_tile
@@ -0,0 +1,179 @@
+#ifndef PROTOZERO_BUFFER_CHUNKED_HPP
+#define PROTOZERO_BUFFER_CHUNKED_HPP
+
+/*****************************************************************************
+
+protozero - Minimalistic protocol buffer decoder and encoder in C++.
+
+This file is from https://github.com/mapbox/protozero where you can find more
+documentation.
+
+*****************************************************************************/
+
+/**
+ * @file buffer_chunked.hpp
+ *
+ * @brief Contains the chunked_buffer class.
+ */
+
+#include <protozero/buffer_tmpl.hpp>
+#include <protozero/config.hpp>
+#include <protozero/types.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace protozero {
+
+/**
+ * Buffer made of equally sized segments. Growing it never copies data that
+ * was already written, and the segments can be handed to a scatter/gather
+ * write (like writev) without assembling the message in one piece.
+ */
+class chunked_buffer {
+
+    std::vector<std::unique_ptr<char[]>> m_segments;
+    std::size_t m_segment_size;
+    std::size_t m_size = 0;
+
+    // Call fn(pointer, count) for the pieces of the range [pos, pos + count).
+    template <typename TFunc>
+    void for_each_piece(std::size_t pos, std::size_t count, TFunc&& fn) {
+        while (count > 0) {
+            const std::size_t offset = pos % m_segment_size;
+            const std::size_t piece = std::min(count, m_segment_size - offset);
+            std::forward<TFunc>(fn)(m_segments[pos / m_segment_size].get() + offset, piece);
+            pos += piece;
+            count -= piece;
+        }
+    }
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param segment_size Size of every segment in bytes, must not be 0.
+     */
+    explicit chunked_buffer(std::size_t segment_size = 64 * 1024) :
+        m_segment_size(segment_size) {
+        protozero_assert(segment_size > 0);
+    }
+
+    /// Number of bytes written.
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    /// Number of segments holding data.
+    std::size_t segment_count() const noexcept {
+        return (m_size + m_segment_size - 1) / m_segment_size;
+    }
+
+    /// The data in the segment with the given index.
+    data_view segment(std::size_t index) const noexcept {
+        protozero_assert(index < segment_count());
+        const std::size_t begin = index * m_segment_size;
+        return data_view{m_segments[index].get(), std::min(m_segment_size, m_size - begin)};
+    }
+
+    /// Make sure count more bytes can be written without allocating.
+    void reserve_additional(std::size_t count) {
+        const std::size_t needed = (m_size + count + m_segment_size - 1) / m_segment_size;
+        while (m_segments.size() < needed) {
+            m_segments.emplace_back(new char[m_segment_size]);
+        }
+    }
+
+    /// Set the size to size bytes, new bytes are zero.
+    void resize(std::size_t size) {
+        if (size > m_size) {
+            reserve_additional(size - m_size);
+            for_each_piece(m_size, size - m_size, [](char* data, std::size_t count) {
+                std::memset(data, 0, count);
+            });
+        }
+        m_size = size;
+    }
+
+    /// Append count bytes from data.
+    void append(const char* data, std::size_t count) {
+        reserve_additional(count);
+        const std::size_t pos = m_size;
+        m_size += count;
+        write_at(pos, data, count);
+    }
+
+    /// Overwrite count bytes starting at pos with data.
+    void write_at(std::size_t pos, const char* data, std::size_t count) {
+        protozero_assert(pos + count <= m_size);
+        for_each_piece(pos, count, [&data](char* dest, std::size_t piece) {
+            std::memcpy(dest, data, piece);
+            data += piece;
+        });
+    }
+
+    /// Copy count bytes from src to an earlier position dest.
+    void copy_within(std::size_t dest, std::size_t src, std::size_t count) {
+        protozero_assert(dest <= src && src + count <= m_size);
+        for_each_piece(dest, count, [this, &src](char* target, std::size_t piece) {
+            for_each_piece(src, piece, [&target](char* source, std::size_t part) {
+                std::memmove(target, source, part);
+                target += part;
+            });
+            src += piece;
+        });
+    }
+
+}; // class chunked_buffer
+
+/// @cond INTERNAL
+template <>
+struct buffer_customization<chunked_buffer> {
+
+    static std::size_t size(const chunked_buffer* buffer) noexcept {
+        return buffer->size();
+    }
+
+    static void append(chunked_buffer* buffer, const char* data, std::size_t count) {
+        buffer->append(data, count);
+    }
+
+    static void append_zeros(chunked_buffer* buffer, std::size_t count) {
+        buffer->resize(buffer->size() + count);
+    }
+
+    static void push_back(chunked_buffer* buffer, char value) {
+        buffer->append(&value, 1);
+    }
+
+    static void resize(chunked_buffer* buffer, std::size_t size) {
+        buffer->resize(size);
+    }
+
+    static void reserve_additional(chunked_buffer* buffer, std::size_t size) {
+        buffer->reserve_additional(size);
+    }
+
+    static void erase_range(chunked_buffer* buffer, std::size_t from, std::size_t to) {
+        buffer->copy_within(from, to, buffer->size() - to);
+        buffer->resize(buffer->size() - (to - from));
+    }
+
+    static void write_at(chunked_buffer* buffer, std::size_t pos, const char* data, std::size_t count) {
+        buffer->write_at(pos, data, count);
+    }
+
+    static void copy_within(chunked_buffer* buffer, std::size_t dest, std::size_t src, std::size_t count) {
+        buffer->copy_within(dest, src, count);
+    }
+
+};
+/// @endcond
+
+} // end namespace protozero
+
+#endif // PROTOZERO_BUFFER_CHUNKED_HPP
@@ -0,0 +1,139 @@
+#ifndef PROTOZERO_BUFFER_FIXED_HPP
+#define PROTOZERO_BUFFER_FIXED_HPP
+
+/*****************************************************************************
+
+protozero - Minimalistic protocol buffer decoder and encoder in C++.
+
+This file is from https://github.com/mapbox/protozero where you can find more
+documentation.
+
+*****************************************************************************/
+
+/**
+ * @file buffer_fixed.hpp
+ *
+ * @brief Contains the fixed_size_buffer_adaptor class.
+ */
+
+#include <protozero/buffer_tmpl.hpp>
+#include <protozero/config.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace protozero {
+
+/**
+ * Adaptor writing into a memory area owned by the caller, for instance the
+ * buffer a message will be sent from. Writing more than its capacity throws
+ * std::length_error, the data written so far stays valid.
+ */
+class fixed_size_buffer_adaptor {
+
+    char* m_data;
+    std::size_t m_capacity;
+    std::size_t m_size = 0;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param data Pointer to the memory written to.
+     * @param capacity Number of bytes available there.
+     */
+    fixed_size_buffer_adaptor(char* data, std::size_t capacity) noexcept :
+        m_data(data),
+        m_capacity(capacity) {
+    }
+
+    /// Pointer to the start of the written data.
+    char* data() noexcept {
+        return m_data;
+    }
+
+    /// Pointer to the start of the written data.
+    const char* data() const noexcept {
+        return m_data;
+    }
+
+    /// Number of bytes written.
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    /// Number of bytes that can be written in total.
+    std::size_t capacity() const noexcept {
+        return m_capacity;
+    }
+
+    /// Extend the written data by count bytes, returning where they start.
+    char* grow(std::size_t count) {
+        if (m_capacity - m_size < count) {
+            throw std::length_error{"fixed size data store exhausted"};
+        }
+        char* const start = m_data + m_size;
+        m_size += count;
+        return start;
+    }
+
+    /// Shrink the written data to size bytes.
+    void shrink(std::size_t size) noexcept {
+        protozero_assert(size <= m_size);
+        m_size = size;
+    }
+
+}; // class fixed_size_buffer_adaptor
+
+/// @cond INTERNAL
+template <>
+struct buffer_customization<fixed_size_buffer_adaptor> {
+
+    static std::size_t size(const fixed_size_buffer_adaptor* buffer) noexcept {
+        return buffer->size();
+    }
+
+    static void append(fixed_size_buffer_adaptor* buffer, const char* data, std::size_t count) {
+        std::memcpy(buffer->grow(count), data, count);
+    }
+
+    static void append_zeros(fixed_size_buffer_adaptor* buffer, std::size_t count) {
+        std::memset(buffer->grow(count), 0, count);
+    }
+
+    static void push_back(fixed_size_buffer_adaptor* buffer, char value) {
+        *buffer->grow(1) = value;
+    }
+
+    static void resize(fixed_size_buffer_adaptor* buffer, std::size_t size) {
+        if (size > buffer->size()) {
+            append_zeros(buffer, size - buffer->size());
+        } else {
+            buffer->shrink(size);
+        }
+    }
+
+    static void reserve_additional(fixed_size_buffer_adaptor* /*buffer*/, std::size_t /*size*/) noexcept {
+    }
+
+    static void erase_range(fixed_size_buffer_adaptor* buffer, std::size_t from, std::size_t to) {
+        std::memmove(buffer->data() + from, buffer->data() + to, buffer->size() - to);
+        buffer->shrink(buffer->size() - (to - from));
+    }
+
+    static void write_at(fixed_size_buffer_adaptor* buffer, std::size_t pos, const char* data, std::size_t count) {
+        std::memcpy(buffer->data() + pos, data, count);
+    }
+
+    static void copy_within(fixed_size_buffer_adaptor* buffer, std::size_t dest, std::size_t src, std::size_t count) {
+        std::memmove(buffer->data() + dest, buffer->data() + src, count);
+    }
+
+};
+/// @endcond
+
+} // end namespace protozero
+
+#endif // PROTOZERO_BUFFER_FIXED_HPP
@@ -0,0 +1,79 @@
+#ifndef PROTOZERO_BUFFER_TMPL_HPP
+#define PROTOZERO_BUFFER_TMPL_HPP
+
+/*****************************************************************************
+
+protozero - Minimalistic protocol buffer decoder and encoder in C++.
+
+This file is from https://github.com/mapbox/protozero where you can find more
+documentation.
+
+*****************************************************************************/
+
+/**
+ * @file buffer_tmpl.hpp
+ *
+ * @brief Contains the customization points for buffer implementations.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+namespace protozero {
+
+/**
+ * The basic_pbf_writer can write into any buffer type for which this
+ * template is specialized or which fits the default implementation. The
+ * default works for contiguous containers of char with the interface of
+ * std::string or std::vector<char>, including those with a custom allocator
+ * like std::pmr::string, which allows writing into arena memory.
+ *
+ * All positions are byte offsets from the start of the buffer. Writes into
+ * existing data (write_at, copy_within) never change the buffer size.
+ */
+template <typename T, typename Enable = void>
+struct buffer_customization {
+
+    static std::size_t size(const T* buffer) noexcept {
+        return buffer->size();
+    }
+
+    static void append(T* buffer, const char* data, std::size_t count) {
+        buffer->insert(buffer->end(), data, data + count);
+    }
+
+    static void append_zeros(T* buffer, std::size_t count) {
+        buffer->resize(buffer->size() + count, '\0');
+    }
+
+    static void push_back(T* buffer, char value) {
+        buffer->push_back(value);
+    }
+
+    static void resize(T* buffer, std::size_t size) {
+        buffer->resize(size);
+    }
+
+    static void reserve_additional(T* buffer, std::size_t size) {
+        buffer->reserve(buffer->size() + size);
+    }
+
+    static void erase_range(T* buffer, std::size_t from, std::size_t to) {
+        buffer->erase(std::next(buffer->begin(), long(from)), std::next(buffer->begin(), long(to)));
+    }
+
+    static void write_at(T* buffer, std::size_t pos, const char* data, std::size_t count) {
+        std::memcpy(buffer->data() + pos, data, count);
+    }
+
+    // Copy count bytes from src to dest, the ranges may overlap.
+    static void copy_within(T* buffer, std::size_t dest, std::size_t src, std::size_t count) {
+        std::memmove(buffer->data() + dest, buffer->data() + src, count);
+    }
+
+}; // struct buffer_customization
+
+} // end namespace protozero
+
+#endif // PROTOZERO_BUFFER_TMPL_HPP
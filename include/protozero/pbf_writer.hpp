@@ -16,6 +16,7 @@ documentation.
  * @brief Contains the pbf_writer class.
  */
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -23,7 +24,9 @@ documentation.
 #include <limits>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include <protozero/buffer_tmpl.hpp>
 #include <protozero/config.hpp>
 #include <protozero/types.hpp>
 #include <protozero/varint.hpp>
@@ -36,28 +39,95 @@ namespace protozero {
 
 namespace detail {
 
-    template <typename T> class packed_field_varint;
-    template <typename T> class packed_field_svarint;
-    template <typename T> class packed_field_fixed;
+    template <typename TBuffer, typename T> class packed_field_varint;
+    template <typename TBuffer, typename T> class packed_field_svarint;
+    template <typename TBuffer, typename T> class packed_field_fixed;
 
 } // end namespace detail
 
 /**
- * The pbf_writer is used to write PBF formatted messages into a buffer.
+ * Bookkeeping for a pbf_writer that does not shift the data of a submessage
+ * when it is closed.
+ *
+ * Normally the length of a submessage with unknown size is written into
+ * space reserved for the largest possible varint, and the unused bytes are
+ * removed by moving the whole submessage, once for every level of nesting.
+ * A pbf_writer constructed with a deferred_lengths object instead only
+ * records the unused bytes; compact() removes all of them in a single pass
+ * once the message is complete. Until then the buffer does not hold a valid
+ * message.
+ */
+class deferred_lengths {
+
+    template <typename TBuffer> friend class basic_pbf_writer;
+
+    struct gap {
+        std::size_t pos;
+        std::size_t size;
+    };
+
+    std::vector<gap> m_gaps;
+
+    // Sum of the sizes of all recorded gaps.
+    std::size_t m_gap_bytes = 0;
+
+public:
+
+    /// The number of bytes compact() will remove.
+    std::size_t pending() const noexcept {
+        return m_gap_bytes;
+    }
+
+    /**
+     * Remove the unused length bytes of all closed submessages from data.
+     *
+     * @pre All submessages of writers using this object are closed and data
+     *      is the buffer they wrote to.
+     */
+    template <typename TBuffer>
+    void compact(TBuffer& data) {
+        if (m_gaps.empty()) {
+            return;
+        }
+        // Gaps are recorded when submessages close, inner ones first.
+        std::sort(m_gaps.begin(), m_gaps.end(), [](const gap& a, const gap& b) {
+            return a.pos < b.pos;
+        });
+        std::size_t out = m_gaps.front().pos;
+        for (std::size_t i = 0; i < m_gaps.size(); ++i) {
+            const std::size_t begin = m_gaps[i].pos + m_gaps[i].size;
+            const std::size_t end = i + 1 < m_gaps.size() ? m_gaps[i + 1].pos : buffer_customization<TBuffer>::size(&data);
+            buffer_customization<TBuffer>::copy_within(&data, out, begin, end - begin);
+            out += end - begin;
+        }
+        buffer_customization<TBuffer>::resize(&data, out);
+        m_gaps.clear();
+        m_gap_bytes = 0;
+    }
+
+}; // class deferred_lengths
+
+/**
+ * The basic_pbf_writer is used to write PBF formatted messages into a buffer
+ * of type TBuffer, accessed through buffer_customization<TBuffer>. Use the
+ * pbf_writer alias to write into a std::string.
  *
  * Almost all methods in this class can throw an std::bad_alloc exception if
- * the std::string used as a buffer wants to resize.
+ * the buffer wants to resize.
  */
-class pbf_writer {
+template <typename TBuffer>
+class basic_pbf_writer {
 
-    // A pointer to a string buffer holding the data already written to the
+    using buffer = buffer_customization<TBuffer>;
+
+    // A pointer to the buffer holding the data already written to the
     // PBF message. For default constructed writers or writers that have been
     // rolled back, this is a nullptr.
-    std::string* m_data;
+    TBuffer* m_data;
 
     // A pointer to a parent writer object if this is a submessage. If this
     // is a top-level writer, it is a nullptr.
-    pbf_writer* m_parent_writer;
+    basic_pbf_writer* m_parent_writer;
 
     // This is usually 0. If there is an open submessage, this is set in the
     // parent to the rollback position, ie. the last position before the
@@ -69,10 +139,22 @@ class pbf_writer {
     // parent to the position where the data of the submessage is written to.
     std::size_t m_pos = 0;
 
+    // Shared by all writers of a message whose submessage lengths are fixed
+    // up at the end, nullptr otherwise.
+    deferred_lengths* m_deferred = nullptr;
+
+    // If there is an open submessage of a writer with deferred lengths, this
+    // is set in the parent to the number of gaps and gap bytes recorded when
+    // it was opened.
+    std::size_t m_gap_count = 0;
+    std::size_t m_gap_bytes = 0;
+
     void add_varint(uint64_t value) {
         protozero_assert(m_pos == 0 && "you can't add fields to a parent pbf_writer if there is an existing pbf_writer for a submessage");
         protozero_assert(m_data);
-        write_varint(std::back_inserter(*m_data), value);
+        char data[max_varint_length] = {};
+        const auto n = write_varint(data, value);
+        buffer::append(m_data, data, std::size_t(n));
     }
 
     void add_field(pbf_tag_type tag, pbf_wire_type type) {
@@ -93,7 +175,7 @@ class pbf_writer {
 #if PROTOZERO_BYTE_ORDER != PROTOZERO_LITTLE_ENDIAN
         detail::byteswap_inplace(&value);
 #endif
-        m_data->append(reinterpret_cast<const char*>(&value), sizeof(T));
+        buffer::append(m_data, reinterpret_cast<const char*>(&value), sizeof(T));
     }
 
     template <typename T, typename It>
@@ -102,7 +184,7 @@ class pbf_writer {
             return;
         }
 
-        pbf_writer sw(*this, tag);
+        basic_pbf_writer sw(*this, tag);
 
         while (first != last) {
             sw.add_fixed<T>(*first++);
@@ -125,31 +207,79 @@ class pbf_writer {
     }
 
     template <typename It>
-    void add_packed_varint(pbf_tag_type tag, It first, It last) {
+    void add_packed_varint(pbf_tag_type tag, It first, It last, std::input_iterator_tag) {
         if (first == last) {
             return;
         }
 
-        pbf_writer sw(*this, tag);
+        basic_pbf_writer sw(*this, tag);
 
         while (first != last) {
             sw.add_varint(uint64_t(*first++));
         }
     }
 
+    // Forward iterators allow a sizing pass, so the length is written up
+    // front and the data never has to be moved.
     template <typename It>
-    void add_packed_svarint(pbf_tag_type tag, It first, It last) {
+    void add_packed_varint(pbf_tag_type tag, It first, It last, std::forward_iterator_tag) {
+        if (first == last) {
+            return;
+        }
+
+        const std::size_t length = length_of_varints(first, last);
+        add_length_varint(tag, pbf_length_type(length));
+        reserve(length);
+
+        // Encode in batches on the stack, appending each with one call.
+        char data[512];
+        while (first != last) {
+            const char* const end = write_varints(data, data + sizeof(data), first, last);
+            buffer::append(m_data, data, std::size_t(end - data));
+        }
+    }
+
+    template <typename It>
+    void add_packed_varint(pbf_tag_type tag, It first, It last) {
+        add_packed_varint(tag, first, last, typename std::iterator_traits<It>::iterator_category());
+    }
+
+    template <typename It>
+    void add_packed_svarint(pbf_tag_type tag, It first, It last, std::input_iterator_tag) {
         if (first == last) {
             return;
         }
 
-        pbf_writer sw(*this, tag);
+        basic_pbf_writer sw(*this, tag);
 
         while (first != last) {
             sw.add_varint(encode_zigzag64(*first++));
         }
     }
 
+    template <typename It>
+    void add_packed_svarint(pbf_tag_type tag, It first, It last, std::forward_iterator_tag) {
+        if (first == last) {
+            return;
+        }
+
+        std::size_t length = 0;
+        for (It it = first; it != last; ++it) {
+            length += std::size_t(length_of_varint(encode_zigzag64(*it)));
+        }
+        add_length_varint(tag, pbf_length_type(length));
+        reserve(length);
+
+        while (first != last) {
+            add_varint(encode_zigzag64(*first++));
+        }
+    }
+
+    template <typename It>
+    void add_packed_svarint(pbf_tag_type tag, It first, It last) {
+        add_packed_svarint(tag, first, last, typename std::iterator_traits<It>::iterator_category());
+    }
+
     // The number of bytes to reserve for the varint holding the length of
     // a length-delimited field. The length has to fit into pbf_length_type,
     // and a varint needs 8 bit for every 7 bit.
@@ -168,22 +298,30 @@ class pbf_writer {
         protozero_assert(m_pos == 0);
         protozero_assert(m_data);
         if (size == 0) {
-            m_rollback_pos = m_data->size();
+            m_rollback_pos = buffer::size(m_data);
             add_field(tag, pbf_wire_type::length_delimited);
-            m_data->append(std::size_t(reserve_bytes), '\0');
+            buffer::append_zeros(m_data, std::size_t(reserve_bytes));
+            if (m_deferred) {
+                m_gap_count = m_deferred->m_gaps.size();
+                m_gap_bytes = m_deferred->m_gap_bytes;
+            }
         } else {
             m_rollback_pos = size_is_known;
             add_length_varint(tag, pbf_length_type(size));
             reserve(size);
         }
-        m_pos = m_data->size();
+        m_pos = buffer::size(m_data);
     }
 
     void rollback_submessage() {
         protozero_assert(m_pos != 0);
         protozero_assert(m_rollback_pos != size_is_known);
         protozero_assert(m_data);
-        m_data->resize(m_rollback_pos);
+        buffer::resize(m_data, m_rollback_pos);
+        if (m_deferred) {
+            m_deferred->m_gaps.resize(m_gap_count);
+            m_deferred->m_gap_bytes = m_gap_bytes;
+        }
         m_pos = 0;
     }
 
@@ -191,12 +329,28 @@ class pbf_writer {
         protozero_assert(m_pos != 0);
         protozero_assert(m_rollback_pos != size_is_known);
         protozero_assert(m_data);
-        const auto length = pbf_length_type(m_data->size() - m_pos);
+        protozero_assert(buffer::size(m_data) >= m_pos - reserve_bytes);
+        char data[reserve_bytes];
+        if (m_deferred) {
+            // Gaps of nested submessages are inside this one and will be
+            // removed as well.
+            const auto length = pbf_length_type(buffer::size(m_data) - m_pos - (m_deferred->m_gap_bytes - m_gap_bytes));
+            const auto n = write_varint(data, length);
+            buffer::write_at(m_data, m_pos - reserve_bytes, data, std::size_t(n));
+            const auto unused = std::size_t(reserve_bytes - n);
+            if (unused > 0) {
+                m_deferred->m_gaps.push_back(deferred_lengths::gap{m_pos - unused, unused});
+                m_deferred->m_gap_bytes += unused;
+            }
+            m_pos = 0;
+            return;
+        }
 
-        protozero_assert(m_data->size() >= m_pos - reserve_bytes);
-        const auto n = write_varint(m_data->begin() + long(m_pos) - reserve_bytes, length);
+        const auto length = pbf_length_type(buffer::size(m_data) - m_pos);
+        const auto n = write_varint(data, length);
+        buffer::write_at(m_data, m_pos - reserve_bytes, data, std::size_t(n));
 
-        m_data->erase(m_data->begin() + long(m_pos) - reserve_bytes + n, m_data->begin() + long(m_pos));
+        buffer::erase_range(m_data, m_pos - reserve_bytes + std::size_t(n), m_pos);
         m_pos = 0;
     }
 
@@ -205,7 +359,7 @@ class pbf_writer {
         if (m_pos == 0 || m_rollback_pos == size_is_known) {
             return;
         }
-        if (m_data->size() - m_pos == 0) {
+        if (buffer::size(m_data) - m_pos == 0) {
             rollback_submessage();
         } else {
             commit_submessage();
@@ -220,20 +374,31 @@ class pbf_writer {
 public:
 
     /**
-     * Create a writer using the given string as a data store. The pbf_writer
-     * stores a reference to that string and adds all data to it. The string
+     * Create a writer using the given buffer as a data store. The pbf_writer
+     * stores a reference to that buffer and adds all data to it. The buffer
      * doesn't have to be empty. The pbf_writer will just append data.
      */
-    explicit pbf_writer(std::string& data) noexcept :
+    explicit basic_pbf_writer(TBuffer& data) noexcept :
         m_data(&data),
         m_parent_writer(nullptr) {
     }
 
+    /**
+     * Create a writer using the given buffer as a data store that defers
+     * fixing up the lengths of submessages. Call lengths.compact(data) after
+     * all submessages are closed to get a valid message.
+     */
+    basic_pbf_writer(TBuffer& data, deferred_lengths& lengths) noexcept :
+        m_data(&data),
+        m_parent_writer(nullptr),
+        m_deferred(&lengths) {
+    }
+
     /**
      * Create a writer without a data store. In this form the writer can not
      * be used!
      */
-    pbf_writer() noexcept :
+    basic_pbf_writer() noexcept :
         m_data(nullptr),
         m_parent_writer(nullptr) {
     }
@@ -248,25 +413,26 @@ public:
      *        Setting this allows some optimizations but is only possible in
      *        a few very specific cases.
      */
-    pbf_writer(pbf_writer& parent_writer, pbf_tag_type tag, std::size_t size=0) :
+    basic_pbf_writer(basic_pbf_writer& parent_writer, pbf_tag_type tag, std::size_t size=0) :
         m_data(parent_writer.m_data),
-        m_parent_writer(&parent_writer) {
+        m_parent_writer(&parent_writer),
+        m_deferred(parent_writer.m_deferred) {
         m_parent_writer->open_submessage(tag, size);
     }
 
     /// A pbf_writer object can be copied
-    pbf_writer(const pbf_writer&) noexcept = default;
+    basic_pbf_writer(const basic_pbf_writer&) noexcept = default;
 
     /// A pbf_writer object can be copied
-    pbf_writer& operator=(const pbf_writer&) noexcept = default;
+    basic_pbf_writer& operator=(const basic_pbf_writer&) noexcept = default;
 
     /// A pbf_writer object can be moved
-    pbf_writer(pbf_writer&&) noexcept = default;
+    basic_pbf_writer(basic_pbf_writer&&) noexcept = default;
 
     /// A pbf_writer object can be moved
-    pbf_writer& operator=(pbf_writer&&) noexcept = default;
+    basic_pbf_writer& operator=(basic_pbf_writer&&) noexcept = default;
 
-    ~pbf_writer() {
+    ~basic_pbf_writer() {
         if (m_parent_writer) {
             m_parent_writer->close_submessage();
         }
@@ -277,12 +443,15 @@ public:
      *
      * @param other Other object to swap data with.
      */
-    void swap(pbf_writer& other) noexcept {
+    void swap(basic_pbf_writer& other) noexcept {
         using std::swap;
         swap(m_data, other.m_data);
         swap(m_parent_writer, other.m_parent_writer);
         swap(m_rollback_pos, other.m_rollback_pos);
         swap(m_pos, other.m_pos);
+        swap(m_deferred, other.m_deferred);
+        swap(m_gap_count, other.m_gap_count);
+        swap(m_gap_bytes, other.m_gap_bytes);
     }
 
     /**
@@ -295,7 +464,7 @@ public:
      */
     void reserve(std::size_t size) {
         protozero_assert(m_data);
-        m_data->reserve(m_data->size() + size);
+        buffer::reserve_additional(m_data, size);
     }
 
     /**
@@ -327,7 +496,7 @@ public:
         add_field(tag, pbf_wire_type::varint);
         protozero_assert(m_pos == 0 && "you can't add fields to a parent pbf_writer if there is an existing pbf_writer for a submessage");
         protozero_assert(m_data);
-        m_data->append(1, value);
+        buffer::push_back(m_data, char(value));
     }
 
     /**
@@ -478,7 +647,7 @@ public:
         protozero_assert(m_data);
         protozero_assert(size <= std::numeric_limits<pbf_length_type>::max());
         add_length_varint(tag, pbf_length_type(size));
-        m_data->append(value, size);
+        buffer::append(m_data, value, size);
     }
 
     /**
@@ -528,8 +697,8 @@ public:
         (void)std::initializer_list<size_t>{sum_size += values.size()...};
         protozero_assert(sum_size <= std::numeric_limits<pbf_length_type>::max());
         add_length_varint(tag, pbf_length_type(sum_size));
-        m_data->reserve(m_data->size() + sum_size);
-        (void)std::initializer_list<int>{(m_data->append(values.data(), values.size()), 0)...};
+        buffer::reserve_additional(m_data, sum_size);
+        (void)std::initializer_list<int>{(buffer::append(m_data, values.data(), values.size()), 0)...};
     }
 
     /**
@@ -816,29 +985,34 @@ public:
 
     ///@}
 
-    template <typename T> friend class detail::packed_field_varint;
-    template <typename T> friend class detail::packed_field_svarint;
-    template <typename T> friend class detail::packed_field_fixed;
+    template <typename B, typename T> friend class detail::packed_field_varint;
+    template <typename B, typename T> friend class detail::packed_field_svarint;
+    template <typename B, typename T> friend class detail::packed_field_fixed;
 
-}; // class pbf_writer
+}; // class basic_pbf_writer
+
+/// Writer for PBF formatted messages into a std::string.
+using pbf_writer = basic_pbf_writer<std::string>;
 
 /**
- * Swap two pbf_writer objects.
+ * Swap two basic_pbf_writer objects.
  *
  * @param lhs First object.
  * @param rhs Second object.
  */
-inline void swap(pbf_writer& lhs, pbf_writer& rhs) noexcept {
+template <typename TBuffer>
+inline void swap(basic_pbf_writer<TBuffer>& lhs, basic_pbf_writer<TBuffer>& rhs) noexcept {
     lhs.swap(rhs);
 }
 
 namespace detail {
 
+    template <typename TBuffer>
     class packed_field {
 
     protected:
 
-        pbf_writer m_writer;
+        basic_pbf_writer<TBuffer> m_writer;
 
     public:
 
@@ -848,11 +1022,11 @@ namespace detail {
         packed_field(packed_field&&) = default;
         packed_field& operator=(packed_field&&) = default;
 
-        packed_field(pbf_writer& parent_writer, pbf_tag_type tag) :
+        packed_field(basic_pbf_writer<TBuffer>& parent_writer, pbf_tag_type tag) :
             m_writer(parent_writer, tag) {
         }
 
-        packed_field(pbf_writer& parent_writer, pbf_tag_type tag, std::size_t size) :
+        packed_field(basic_pbf_writer<TBuffer>& parent_writer, pbf_tag_type tag, std::size_t size) :
             m_writer(parent_writer, tag, size) {
         }
 
@@ -862,55 +1036,55 @@ namespace detail {
 
     }; // class packed_field
 
-    template <typename T>
-    class packed_field_fixed : public packed_field {
+    template <typename TBuffer, typename T>
+    class packed_field_fixed : public packed_field<TBuffer> {
 
     public:
 
         template <typename P>
-        packed_field_fixed(pbf_writer& parent_writer, P tag) :
-            packed_field(parent_writer, static_cast<pbf_tag_type>(tag)) {
+        packed_field_fixed(basic_pbf_writer<TBuffer>& parent_writer, P tag) :
+            packed_field<TBuffer>(parent_writer, static_cast<pbf_tag_type>(tag)) {
         }
 
         template <typename P>
-        packed_field_fixed(pbf_writer& parent_writer, P tag, std::size_t size) :
-            packed_field(parent_writer, static_cast<pbf_tag_type>(tag), size * sizeof(T)) {
+        packed_field_fixed(basic_pbf_writer<TBuffer>& parent_writer, P tag, std::size_t size) :
+            packed_field<TBuffer>(parent_writer, static_cast<pbf_tag_type>(tag), size * sizeof(T)) {
         }
 
         void add_element(T value) {
-            m_writer.add_fixed<T>(value);
+            this->m_writer.template add_fixed<T>(value);
         }
 
     }; // class packed_field_fixed
 
-    template <typename T>
-    class packed_field_varint : public packed_field {
+    template <typename TBuffer, typename T>
+    class packed_field_varint : public packed_field<TBuffer> {
 
     public:
 
         template <typename P>
-        packed_field_varint(pbf_writer& parent_writer, P tag) :
-            packed_field(parent_writer, static_cast<pbf_tag_type>(tag)) {
+        packed_field_varint(basic_pbf_writer<TBuffer>& parent_writer, P tag) :
+            packed_field<TBuffer>(parent_writer, static_cast<pbf_tag_type>(tag)) {
         }
 
         void add_element(T value) {
-            m_writer.add_varint(uint64_t(value));
+            this->m_writer.add_varint(uint64_t(value));
         }
 
     }; // class packed_field_varint
 
-    template <typename T>
-    class packed_field_svarint : public packed_field {
+    template <typename TBuffer, typename T>
+    class packed_field_svarint : public packed_field<TBuffer> {
 
     public:
 
         template <typename P>
-        packed_field_svarint(pbf_writer& parent_writer, P tag) :
-            packed_field(parent_writer, static_cast<pbf_tag_type>(tag)) {
+        packed_field_svarint(basic_pbf_writer<TBuffer>& parent_writer, P tag) :
+            packed_field<TBuffer>(parent_writer, static_cast<pbf_tag_type>(tag)) {
         }
 
         void add_element(T value) {
-            m_writer.add_varint(encode_zigzag64(value));
+            this->m_writer.add_varint(encode_zigzag64(value));
         }
 
     }; // class packed_field_svarint
@@ -918,46 +1092,46 @@ namespace detail {
 } // end namespace detail
 
 /// Class for generating packed repeated bool fields.
-using packed_field_bool     = detail::packed_field_varint<bool>;
+using packed_field_bool     = detail::packed_field_varint<std::string, bool>;
 
 /// Class for generating packed repeated enum fields.
-using packed_field_enum     = detail::packed_field_varint<int32_t>;
+using packed_field_enum     = detail::packed_field_varint<std::string, int32_t>;
 
 /// Class for generating packed repeated int32 fields.
-using packed_field_int32    = detail::packed_field_varint<int32_t>;
+using packed_field_int32    = detail::packed_field_varint<std::string, int32_t>;
 
 /// Class for generating packed repeated sint32 fields.
-using packed_field_sint32   = detail::packed_field_svarint<int32_t>;
+using packed_field_sint32   = detail::packed_field_svarint<std::string, int32_t>;
 
 /// Class for generating packed repeated uint32 fields.
-using packed_field_uint32   = detail::packed_field_varint<uint32_t>;
+using packed_field_uint32   = detail::packed_field_varint<std::string, uint32_t>;
 
 /// Class for generating packed repeated int64 fields.
-using packed_field_int64    = detail::packed_field_varint<int64_t>;
+using packed_field_int64    = detail::packed_field_varint<std::string, int64_t>;
 
 /// Class for generating packed repeated sint64 fields.
-using packed_field_sint64   = detail::packed_field_svarint<int64_t>;
+using packed_field_sint64   = detail::packed_field_svarint<std::string, int64_t>;
 
 /// Class for generating packed repeated uint64 fields.
-using packed_field_uint64   = detail::packed_field_varint<uint64_t>;
+using packed_field_uint64   = detail::packed_field_varint<std::string, uint64_t>;
 
 /// Class for generating packed repeated fixed32 fields.
-using packed_field_fixed32  = detail::packed_field_fixed<uint32_t>;
+using packed_field_fixed32  = detail::packed_field_fixed<std::string, uint32_t>;
 
 /// Class for generating packed repeated sfixed32 fields.
-using packed_field_sfixed32 = detail::packed_field_fixed<int32_t>;
+using packed_field_sfixed32 = detail::packed_field_fixed<std::string, int32_t>;
 
 /// Class for generating packed repeated fixed64 fields.
-using packed_field_fixed64  = detail::packed_field_fixed<uint64_t>;
+using packed_field_fixed64  = detail::packed_field_fixed<std::string, uint64_t>;
 
 /// Class for generating packed repeated sfixed64 fields.
-using packed_field_sfixed64 = detail::packed_field_fixed<int64_t>;
+using packed_field_sfixed64 = detail::packed_field_fixed<std::string, int64_t>;
 
 /// Class for generating packed repeated float fields.
-using packed_field_float    = detail::packed_field_fixed<float>;
+using packed_field_float    = detail::packed_field_fixed<std::string, float>;
 
 /// Class for generating packed repeated double fields.
-using packed_field_double   = detail::packed_field_fixed<double>;
+using packed_field_double   = detail::packed_field_fixed<std::string, double>;
 
 } // end namespace protozero
 
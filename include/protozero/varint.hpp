@@ -16,7 +16,9 @@ documentation.
  * @brief Contains low-level varint and zigzag encoding and decoding functions.
  */
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 
 #include <protozero/exception.hpp>
 
@@ -154,6 +156,110 @@ inline int write_varint(T data, uint64_t value) {
     return n;
 }
 
+/**
+ * Get the length of the varint the specified value would produce.
+ *
+ * @param value The integer to be encoded.
+ * @returns the number of bytes the varint would have if we created it.
+ */
+inline int length_of_varint(uint64_t value) noexcept {
+    int n = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        ++n;
+    }
+
+    return n;
+}
+
+/**
+ * Get the total length of the varints all values in a range would produce.
+ * The length of each value is computed without branches, so the loop can
+ * be vectorized.
+ *
+ * @tparam It A forward iterator type, dereferencing it must yield a type
+ *         convertible to uint64_t.
+ */
+template <typename It>
+inline std::size_t length_of_varints(It first, It last) noexcept {
+    std::size_t length = 0;
+
+    for (; first != last; ++first) {
+        const auto value = uint64_t(*first);
+        length += 1 + std::size_t(value >= (uint64_t(1) << 7))
+                    + std::size_t(value >= (uint64_t(1) << 14))
+                    + std::size_t(value >= (uint64_t(1) << 21))
+                    + std::size_t(value >= (uint64_t(1) << 28))
+                    + std::size_t(value >= (uint64_t(1) << 35))
+                    + std::size_t(value >= (uint64_t(1) << 42))
+                    + std::size_t(value >= (uint64_t(1) << 49))
+                    + std::size_t(value >= (uint64_t(1) << 56))
+                    + std::size_t(value >= (uint64_t(1) << 63));
+    }
+
+    return length;
+}
+
+namespace detail {
+
+    // Write four values below 0x80 at once, if that is what comes next.
+    template <typename It>
+    inline bool write_small_varints(char*& data, It& first, It last, std::random_access_iterator_tag) {
+        if (last - first < 4) {
+            return false;
+        }
+        const auto v0 = uint64_t(first[0]);
+        const auto v1 = uint64_t(first[1]);
+        const auto v2 = uint64_t(first[2]);
+        const auto v3 = uint64_t(first[3]);
+        if ((v0 | v1 | v2 | v3) >= 0x80) {
+            return false;
+        }
+        data[0] = char(v0);
+        data[1] = char(v1);
+        data[2] = char(v2);
+        data[3] = char(v3);
+        data += 4;
+        first += 4;
+        return true;
+    }
+
+    template <typename It>
+    inline bool write_small_varints(char*& /*data*/, It& /*first*/, It /*last*/, std::forward_iterator_tag) {
+        return false;
+    }
+
+} // end namespace detail
+
+/**
+ * Varint encode the values of a range into a memory area, as many as fit.
+ * For random access ranges, groups of four values below 0x80, which make up
+ * most of a delta encoded geometry, are written with a single check.
+ *
+ * @tparam It A forward iterator type, dereferencing it must yield a type
+ *         convertible to uint64_t.
+ * @param data Start of the memory area.
+ * @param data_end End of the memory area.
+ * @param first Iterator to the first value to write, advanced past all
+ *              values written. Writing stops when fewer than
+ *              max_varint_length bytes are left.
+ * @param last Iterator one past the last value.
+ * @returns Pointer one past the last byte written.
+ */
+template <typename It>
+inline char* write_varints(char* data, const char* data_end, It& first, It last) {
+    while (first != last && data_end - data >= max_varint_length) {
+        if (detail::write_small_varints(data, first, last,
+                                        typename std::iterator_traits<It>::iterator_category())) {
+            continue;
+        }
+        data += write_varint(data, uint64_t(*first++));
+    }
+
+    return data;
+}
+
 /**
  * ZigZag encodes a 32 bit integer.
  */
@@ -0,0 +1,456 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+#include <protozero/buffer_chunked.hpp>
+#include <protozero/buffer_fixed.hpp>
+
+#include <catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory_resource>
+#include <stdexcept>
+#include <thread>
+
+namespace vt = mapbox::vector_tile;
+
+static std::string stringify_geom(vt::points_arrays_type const& geom) {
+    std::string s;
+    for (auto const& point_array : geom) {
+        s += "[";
+        for (auto const& point : point_array) {
+            s += "(" + std::to_string(point.x) + "," + std::to_string(point.y) + ")";
+        }
+        s += "]";
+    }
+    return s;
+}
+
+TEST_CASE( "Encoded tile round-trips through buffer" ) {
+    using point = mapbox::geometry::point<std::int32_t>;
+    vt::tile_builder builder;
+    auto& peaks = builder.addLayer("peaks");
+    {
+        vt::feature_builder feature(peaks);
+        feature.setId(1);
+        feature.addProperty("name", "Grossglockner");
+        feature.addProperty("ele", std::uint64_t(3798));
+        feature.addProperty("glacier", true);
+        feature.setGeometry(point(10, 20));
+        feature.commit();
+    }
+    {
+        vt::feature_builder feature(peaks);
+        feature.setId(2);
+        feature.addProperty("name", std::string("Ortler"));
+        feature.addProperty("ele", mapbox::feature::value(std::uint64_t(3905)));
+        feature.addProperty("glacier", true);
+        feature.setGeometry(mapbox::geometry::multi_point<std::int32_t>{ { 5, 7 }, { 3, 2 } });
+        feature.commit();
+    }
+    {
+        vt::feature_builder feature(peaks);
+        feature.addProperty("name", "discarded");
+        feature.setGeometry(point(1, 1));
+    }
+    auto& water = builder.addLayer("water", 512, 2);
+    {
+        vt::feature_builder feature(water);
+        feature.addProperty("depth", -1.5);
+        feature.addProperty("level", std::int64_t(-3));
+        mapbox::geometry::polygon<std::int32_t> polygon;
+        polygon.push_back({ { 0, 0 }, { 10, 0 }, { 10, 10 }, { 0, 10 }, { 0, 0 } });
+        polygon.push_back({ { 2, 2 }, { 2, 4 }, { 4, 4 } });
+        feature.setGeometry(mapbox::geometry::geometry<std::int32_t>(polygon));
+        feature.commit();
+    }
+    {
+        vt::feature_builder feature(water);
+        feature.setGeometry(mapbox::geometry::multi_line_string<std::int32_t>{ { { 2, 2 }, { 10, 10 } }, { { 1, 1 }, { 3, 5 }, { 3, 2 } } });
+        feature.commit();
+    }
+    REQUIRE(builder.layerCount() == 2);
+    REQUIRE_THROWS(builder.addLayer("water"));
+
+    const std::string data = builder.serialize();
+    vt::buffer tile(data);
+    REQUIRE(tile.layerNames() == std::vector<std::string>({ "peaks", "water" }));
+
+    auto const peaks_layer = tile.getLayer("peaks");
+    REQUIRE(peaks_layer.featureCount() == 2);
+    REQUIRE(peaks_layer.getExtent() == 4096);
+    REQUIRE(peaks_layer.getVersion() == 2);
+    auto const first = vt::feature(peaks_layer.getFeature(0), peaks_layer);
+    CHECK(std::get<std::uint64_t>(first.getID()) == 1);
+    CHECK(first.getType() == vt::GeomType::POINT);
+    CHECK(std::get<std::string>(first.getValue("name")) == "Grossglockner");
+    CHECK(std::get<std::uint64_t>(first.getValue("ele")) == 3798);
+    CHECK(std::get<bool>(first.getValue("glacier")));
+    CHECK(stringify_geom(first.getGeometries<vt::points_arrays_type>(1.0)) == "[(10,20)]");
+    auto const second = vt::feature(peaks_layer.getFeature(1), peaks_layer);
+    CHECK(std::get<std::string>(second.getValue("name")) == "Ortler");
+    CHECK(stringify_geom(second.getGeometries<vt::points_arrays_type>(1.0)) == "[(5,7)][(3,2)]");
+
+    // Keys and the shared "true" value are written once.
+    auto const stats = peaks_layer.statistics();
+    REQUIRE(stats.keys.size() == 3);
+    CHECK(stats.keys[2].key == "glacier");
+    CHECK(stats.keys[2].distinctValues == 1);
+
+    auto const water_layer = tile.getLayer("water");
+    REQUIRE(water_layer.getExtent() == 512);
+    REQUIRE(water_layer.featureCount() == 2);
+    auto const polygon = vt::feature(water_layer.getFeature(0), water_layer);
+    CHECK(std::holds_alternative<mapbox::feature::null_value_t>(polygon.getID()));
+    CHECK(polygon.getType() == vt::GeomType::POLYGON);
+    CHECK(std::get<double>(polygon.getValue("depth")) == Approx(-1.5));
+    CHECK(std::get<std::int64_t>(polygon.getValue("level")) == -3);
+    CHECK(stringify_geom(polygon.getGeometries<vt::points_arrays_type>(1.0)) ==
+          "[(0,0)(10,0)(10,10)(0,10)(0,0)][(2,2)(2,4)(4,4)(2,2)]");
+    auto const lines = vt::feature(water_layer.getFeature(1), water_layer);
+    CHECK(lines.getType() == vt::GeomType::LINESTRING);
+    CHECK(stringify_geom(lines.getGeometries<vt::points_arrays_type>(1.0)) == "[(2,2)(10,10)][(1,1)(3,5)(3,2)]");
+}
+
+TEST_CASE( "Lazily opened tiles check layers on first access" ) {
+    vt::tile_builder builder;
+    auto& roads = builder.addLayer("roads", 8192, 2);
+    {
+        vt::feature_builder feature(roads);
+        feature.addProperty("name", "main street");
+        feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { 0, 0 }, { 10, 0 } });
+        feature.commit();
+    }
+    std::string data = builder.serialize();
+    {
+        // A layer with a name but a truncated feature after it.
+        protozero::pbf_writer writer(data);
+        writer.add_message(vt::TileType::LAYERS, std::string("\x0a\x03" "bad" "\x12\x64", 7));
+    }
+
+    REQUIRE_THROWS(vt::buffer{ data });
+    const vt::buffer tile(data, vt::buffer::LAZY);
+    CHECK((tile.layerNames() == std::vector<std::string>{ "bad", "roads" }));
+    CHECK(tile.hasLayer("roads"));
+    CHECK_FALSE(tile.hasLayer("water"));
+    REQUIRE_THROWS(tile.getLayer("bad"));
+    const vt::layer layer = tile.getLayer("roads");
+    CHECK(layer.getExtent() == 8192);
+    CHECK(layer.getVersion() == 2);
+    REQUIRE(layer.featureCount() == 1);
+    CHECK(std::get<std::string>(vt::feature(layer.getFeature(0), layer).getValue("name")) == "main street");
+}
+
+TEST_CASE( "Feature builder rejects invalid features" ) {
+    vt::tile_builder builder;
+    auto& layer = builder.addLayer("invalid");
+    {
+        vt::feature_builder feature(layer);
+        REQUIRE_THROWS(vt::feature_builder{ layer });
+        REQUIRE_THROWS(feature.commit());
+        REQUIRE_THROWS(feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { 1, 1 } }));
+    }
+    {
+        vt::feature_builder feature(layer);
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(1, 1));
+        REQUIRE_THROWS(feature.setGeometry(mapbox::geometry::point<std::int32_t>(2, 2)));
+        REQUIRE_THROWS(feature.addTag(0, 0));
+        feature.rollback();
+        REQUIRE_THROWS(feature.commit());
+    }
+    REQUIRE(layer.featureCount() == 0);
+}
+
+TEST_CASE( "Size budget drops the lowest priority features" ) {
+    vt::tile_builder builder;
+    auto& peaks = builder.addLayer("peaks");
+    peaks.setPriorityKey("ele");
+    for (std::uint64_t i = 0; i < 20; ++i) {
+        vt::feature_builder feature(peaks);
+        feature.setId(i);
+        feature.addProperty("ele", std::uint64_t(1000 + (i * 7) % 20 * 100));
+        feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { 0, 0 }, { 100, 100 }, { 200, 0 }, { 300, 100 } });
+        feature.commit();
+    }
+    auto& huts = builder.addLayer("huts");
+    {
+        vt::feature_builder feature(huts);
+        feature.setPriority(1e9);
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(5, 5));
+        feature.commit();
+    }
+
+    const std::size_t full_size = builder.encodedSize();
+    REQUIRE(builder.serialize().size() == full_size);
+
+    std::string data;
+    REQUIRE(builder.serialize(data, full_size) == 0);
+    REQUIRE(data.size() == full_size);
+
+    data.clear();
+    const std::size_t budget = full_size / 2;
+    const std::size_t dropped = builder.serialize(data, budget);
+    REQUIRE(dropped > 0);
+    REQUIRE(data.size() <= budget);
+
+    vt::buffer tile(data);
+    auto const layer = tile.getLayer("peaks");
+    REQUIRE(layer.featureCount() == 20 - dropped);
+    // The remaining peaks are the highest ones.
+    auto const stats = layer.statistics();
+    CHECK(stats.keys[0].min == Approx(1000.0 + static_cast<double>(dropped) * 100.0));
+    CHECK(tile.getLayer("huts").featureCount() == 1);
+
+    data.clear();
+    REQUIRE_THROWS(builder.serialize(data, 10));
+
+    // Budgeted tiles can be written to other buffers as well.
+    std::string expected;
+    builder.serialize(expected, budget);
+    std::vector<char> memory(budget);
+    protozero::fixed_size_buffer_adaptor fixed(memory.data(), memory.size());
+    REQUIRE(builder.serialize(fixed, budget) == dropped);
+    REQUIRE(std::string(fixed.data(), fixed.size()) == expected);
+    protozero::chunked_buffer chunked(64);
+    REQUIRE(builder.serialize(chunked, budget) == dropped);
+    std::string joined;
+    for (std::size_t i = 0; i < chunked.segment_count(); ++i) {
+        joined += chunked.segment(i).to_string();
+    }
+    REQUIRE(joined == expected);
+}
+
+TEST_CASE( "NaN priorities are dropped first and variant properties set priorities" ) {
+    vt::tile_builder builder;
+    auto& cities = builder.addLayer("cities");
+    cities.setPriorityKey("pop");
+    for (std::uint64_t i = 0; i < 4; ++i) {
+        vt::feature_builder feature(cities);
+        feature.setId(i);
+        if (i == 0) {
+            feature.addProperty("pop", mapbox::feature::value(std::int64_t(-50)));
+        } else if (i == 1) {
+            feature.addProperty("pop", mapbox::feature::value(std::uint64_t(500)));
+        } else if (i == 2) {
+            feature.addProperty("pop", std::numeric_limits<double>::quiet_NaN());
+        } else {
+            feature.setPriority(std::numeric_limits<double>::quiet_NaN());
+            feature.addProperty("pop", std::uint64_t(10));
+        }
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(5, 5));
+        feature.commit();
+    }
+
+    // Features are dropped in the order 3, 2 (both NaN, later first), 0, 1.
+    const std::vector<std::uint64_t> drop_order = { 3, 2, 0, 1 };
+    const std::size_t full_size = builder.encodedSize();
+    std::size_t dropped = 0;
+    for (std::size_t budget = full_size - 1; dropped < 3; --budget) {
+        std::string data;
+        dropped = builder.serialize(data, budget);
+        vt::buffer tile(data);
+        auto const layer = tile.getLayer("cities");
+        std::vector<std::uint64_t> remaining;
+        for (std::size_t i = 0; i < layer.featureCount(); ++i) {
+            remaining.push_back(std::get<std::uint64_t>(vt::feature(layer.getFeature(i), layer).getID()));
+        }
+        std::vector<std::uint64_t> expected(drop_order.rbegin(), drop_order.rend() - static_cast<std::ptrdiff_t>(dropped));
+        std::sort(expected.begin(), expected.end());
+        REQUIRE(remaining == expected);
+    }
+}
+
+static void build_grid_layer(vt::layer_builder& layer) {
+    for (std::int32_t i = 0; i < 500; ++i) {
+        vt::feature_builder feature(layer);
+        feature.setId(static_cast<std::uint64_t>(i));
+        feature.addProperty("layer", layer.getName());
+        feature.addProperty("row", std::int64_t(i / 10));
+        feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { i, 0 }, { i, 4096 } });
+        feature.commit();
+    }
+}
+
+TEST_CASE( "Layers can be built in parallel" ) {
+    const std::vector<std::string> names = { "roads", "water", "landuse", "buildings", "pois" };
+    vt::tile_builder sequential;
+    for (auto const& name : names) {
+        build_grid_layer(sequential.addLayer(name));
+    }
+    vt::tile_builder parallel;
+    for (auto const& name : names) {
+        parallel.addLayer(name);
+    }
+    parallel.buildLayers(build_grid_layer, 3);
+
+    const std::string data = parallel.serialize();
+    REQUIRE(data.size() == parallel.encodedSize());
+    REQUIRE(data == sequential.serialize());
+
+    REQUIRE_THROWS_WITH(parallel.buildLayers([](vt::layer_builder& layer) {
+        if (layer.getName() == "water") {
+            throw std::runtime_error("failed");
+        }
+    }), "failed");
+
+    // The error of the first failing layer wins, even when thrown last.
+    REQUIRE_THROWS_WITH(parallel.buildLayers([](vt::layer_builder& layer) {
+        if (layer.getName() == "water") {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            throw std::runtime_error("water failed");
+        }
+        if (layer.getName() == "pois") {
+            throw std::runtime_error("pois failed");
+        }
+    }, 5), "water failed");
+}
+
+template <typename TBuffer>
+static void write_nested(protozero::basic_pbf_writer<TBuffer>& writer) {
+    for (std::uint32_t i = 0; i < 3; ++i) {
+        protozero::basic_pbf_writer<TBuffer> outer(writer, 3);
+        outer.add_string(1, "outer");
+        for (std::uint32_t j = 0; j < 50; ++j) {
+            protozero::basic_pbf_writer<TBuffer> inner(outer, 2);
+            inner.add_uint32(1, i * 100 + j);
+            std::vector<std::int32_t> values(j * 3, -static_cast<std::int32_t>(j));
+            inner.add_packed_sint32(2, values.begin(), values.end());
+        }
+        {
+            protozero::basic_pbf_writer<TBuffer> dropped(outer, 2);
+            dropped.add_uint32(1, 42);
+            dropped.rollback();
+        }
+    }
+}
+
+TEST_CASE( "Deferred submessage lengths produce the same message" ) {
+    std::string expected = "prefix";
+    {
+        protozero::pbf_writer writer(expected);
+        write_nested(writer);
+    }
+    std::string data = "prefix";
+    protozero::deferred_lengths lengths;
+    {
+        protozero::pbf_writer writer(data, lengths);
+        write_nested(writer);
+    }
+    REQUIRE(lengths.pending() > 0);
+    REQUIRE(data.size() == expected.size() + lengths.pending());
+    lengths.compact(data);
+    REQUIRE(lengths.pending() == 0);
+    REQUIRE(data == expected);
+}
+
+TEST_CASE( "Tiles can be encoded into other buffers" ) {
+    vt::tile_builder builder;
+    for (auto const& name : { "roads", "water" }) {
+        build_grid_layer(builder.addLayer(name));
+    }
+    const std::string expected = builder.serialize();
+
+    SECTION( "fixed size buffer" ) {
+        std::vector<char> memory(expected.size());
+        protozero::fixed_size_buffer_adaptor buffer(memory.data(), memory.size());
+        builder.serialize(buffer);
+        REQUIRE(std::string(buffer.data(), buffer.size()) == expected);
+
+        protozero::fixed_size_buffer_adaptor small(memory.data(), memory.size() - 1);
+        REQUIRE_THROWS_AS(builder.serialize(small), std::length_error const&);
+    }
+
+    SECTION( "chunked buffer" ) {
+        protozero::chunked_buffer buffer(1000);
+        builder.serialize(buffer);
+        REQUIRE(buffer.size() == expected.size());
+        REQUIRE(buffer.segment_count() == (expected.size() + 999) / 1000);
+        std::string joined;
+        for (std::size_t i = 0; i < buffer.segment_count(); ++i) {
+            joined += buffer.segment(i).to_string();
+        }
+        REQUIRE(joined == expected);
+    }
+
+    SECTION( "arena backed string" ) {
+        std::pmr::monotonic_buffer_resource arena;
+        std::pmr::string buffer(&arena);
+        builder.serialize(buffer);
+        REQUIRE(std::string(buffer.data(), buffer.size()) == expected);
+    }
+
+    SECTION( "vector" ) {
+        std::vector<char> buffer;
+        builder.serialize(buffer);
+        REQUIRE(std::string(buffer.data(), buffer.size()) == expected);
+    }
+}
+
+TEST_CASE( "Nested submessages can be written into chunked and fixed buffers" ) {
+    std::string expected;
+    {
+        protozero::pbf_writer writer(expected);
+        write_nested(writer);
+    }
+    protozero::chunked_buffer chunked(7);
+    {
+        protozero::basic_pbf_writer<protozero::chunked_buffer> writer(chunked);
+        write_nested(writer);
+    }
+    std::string joined;
+    for (std::size_t i = 0; i < chunked.segment_count(); ++i) {
+        joined += chunked.segment(i).to_string();
+    }
+    REQUIRE(joined == expected);
+
+    std::vector<char> memory(expected.size() * 2);
+    protozero::fixed_size_buffer_adaptor fixed(memory.data(), memory.size());
+    protozero::deferred_lengths lengths;
+    {
+        protozero::basic_pbf_writer<protozero::fixed_size_buffer_adaptor> writer(fixed, lengths);
+        write_nested(writer);
+    }
+    lengths.compact(fixed);
+    REQUIRE(std::string(fixed.data(), fixed.size()) == expected);
+}
+
+TEST_CASE( "Varints are measured and written in batches" ) {
+    std::vector<std::uint64_t> values;
+    for (std::uint64_t i = 0; i < 300; ++i) {
+        values.push_back(i % 7 == 0 ? i << (i % 64) : i % 100);
+    }
+    std::string expected;
+    std::size_t length = 0;
+    for (auto const value : values) {
+        protozero::write_varint(std::back_inserter(expected), value);
+        length += static_cast<std::size_t>(protozero::length_of_varint(value));
+    }
+    REQUIRE(protozero::length_of_varints(values.begin(), values.end()) == length);
+    REQUIRE(expected.size() == length);
+
+    // A small area forces writing in several batches.
+    std::string data;
+    char area[24];
+    auto first = values.cbegin();
+    while (first != values.cend()) {
+        const char* end = protozero::write_varints(area, area + sizeof(area), first, values.cend());
+        data.append(area, static_cast<std::size_t>(end - area));
+    }
+    REQUIRE(data == expected);
+
+    std::string packed;
+    protozero::pbf_writer writer(packed);
+    writer.add_packed_uint64(1, values.begin(), values.end());
+    protozero::pbf_reader reader(packed);
+    REQUIRE(reader.next(1));
+    auto range = reader.get_packed_uint64();
+    REQUIRE(std::vector<std::uint64_t>(range.begin(), range.end()) == values);
+}
+
+TEST_CASE( "Out of range coordinate deltas are rejected" ) {
+    vt::layer_builder layer("layer");
+    vt::feature_builder feature(layer);
+    const std::int64_t far = std::int64_t(std::numeric_limits<std::int32_t>::max()) + 20;
+    REQUIRE_THROWS_WITH(feature.setGeometry(mapbox::geometry::line_string<std::int64_t>{ { 0, 0 }, { 10, 10 }, { far, 0 } }),
+                        "geometry coordinate out of range");
+}
@@ -0,0 +1,157 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+#include <mapbox/vector_tile/tile_cache.hpp>
+
+#include "test_tiles.hpp"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vt = mapbox::vector_tile;
+
+// A value with a fixed cost for eviction tests.
+struct sized_value {
+    std::size_t bytes;
+    std::size_t memoryUsage() const { return bytes; }
+};
+
+// A tile with a second, empty layer whose name needs an allocation.
+static std::string build_cache_tile(std::size_t features) {
+    return build_points_tile("peaks", features) + build_points_tile("a layer name too long for small string storage", 0);
+}
+
+static vt::tile_key key(std::uint32_t x, std::uint32_t source = 0) {
+    return vt::tile_key{ source, vt::tile_address{ 10, x, 7 } };
+}
+
+TEST_CASE( "Decoded tiles own their data and account for their memory" ) {
+    const std::string data = build_cache_tile(50);
+    const vt::decoded_tile tile(data);
+    REQUIRE(tile.data() == protozero::data_view(data));
+    REQUIRE(tile.getLayer("peaks").featureCount() == 50);
+    REQUIRE(tile.layerNames().size() == 2);
+    REQUIRE_THROWS_WITH(tile.getLayer("lakes"), "no layer by the name of 'lakes'");
+
+    const vt::layer& peaks = tile.getLayer("peaks");
+    REQUIRE(peaks.memoryUsage() >= sizeof(vt::layer) + 50 * sizeof(protozero::data_view));
+    REQUIRE(tile.memoryUsage() > data.size() + peaks.memoryUsage());
+    REQUIRE(tile.memoryUsage() < 2 * data.size() + 4096);
+}
+
+TEST_CASE( "The tile cache evicts least recently used values over budget" ) {
+    vt::tile_cache<sized_value> cache(1000, 1);
+    const auto value = [](std::size_t bytes) { return std::make_shared<const sized_value>(sized_value{ bytes }); };
+    cache.insert(key(1), value(400));
+    cache.insert(key(2), value(400));
+    REQUIRE(cache.memoryUsage() == 800);
+    // Using 1 makes 2 the least recently used.
+    REQUIRE(cache.find(key(1)));
+    cache.insert(key(3), value(400));
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.memoryUsage() == 800);
+    REQUIRE(cache.find(key(1)));
+    REQUIRE_FALSE(cache.find(key(2)));
+    REQUIRE(cache.find(key(3)));
+
+    // Keys differ by source, replacing a value updates the accounting.
+    REQUIRE_FALSE(cache.find(key(1, 1)));
+    cache.insert(key(1), value(100));
+    REQUIRE(cache.memoryUsage() == 500);
+
+    // Values larger than the budget are returned but not kept.
+    const auto large = cache.get(key(4), [&value](vt::tile_key const&) { return value(2000); });
+    REQUIRE(large->bytes == 2000);
+    REQUIRE_FALSE(cache.find(key(4)));
+    REQUIRE(cache.memoryUsage() == 500);
+
+    cache.erase(key(1));
+    REQUIRE(cache.memoryUsage() == 400);
+    cache.clear();
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.memoryUsage() == 0);
+}
+
+TEST_CASE( "The budget of the tile cache is shared by its shards" ) {
+    vt::tile_cache<sized_value> cache(1000, 16);
+    const auto value = [](std::size_t bytes) { return std::make_shared<const sized_value>(sized_value{ bytes }); };
+    // Far more than a sixteenth of the budget is kept.
+    cache.insert(key(1), value(900));
+    REQUIRE(cache.find(key(1)));
+    REQUIRE(cache.memoryUsage() == 900);
+
+    // Later values evict across shards until the total fits.
+    for (std::uint32_t x = 2; x < 40; ++x) {
+        cache.insert(key(x), value(300));
+        REQUIRE(cache.memoryUsage() <= 1000);
+        REQUIRE(cache.find(key(x)));
+    }
+    REQUIRE_FALSE(cache.find(key(1)));
+    REQUIRE(cache.size() == 3);
+    REQUIRE(cache.memoryUsage() == 900);
+
+    cache.insert(key(50), value(1000));
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.memoryUsage() == 1000);
+}
+
+TEST_CASE( "Concurrent requests for a tile decode it once" ) {
+    const std::string data = build_cache_tile(200);
+    vt::tile_cache<> cache(64 * 1024 * 1024);
+    std::atomic<int> loads{ 0 };
+    const auto load = [&](vt::tile_key const&) {
+        ++loads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return std::make_shared<const vt::decoded_tile>(data);
+    };
+
+    std::vector<std::shared_ptr<const vt::decoded_tile>> results(8);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i]() { results[i] = cache.get(key(5), load); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(loads == 1);
+    for (auto const& result : results) {
+        REQUIRE(result == results[0]);
+    }
+    REQUIRE(results[0]->getLayer("peaks").featureCount() == 200);
+    REQUIRE(cache.memoryUsage() == results[0]->memoryUsage());
+}
+
+TEST_CASE( "Failed loads are reported to every waiter and not cached" ) {
+    vt::tile_cache<sized_value> cache(1000, 4);
+    std::atomic<int> loads{ 0 };
+    const auto failing = [&](vt::tile_key const&) -> std::shared_ptr<const sized_value> {
+        ++loads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        throw std::runtime_error("tile not found");
+    };
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&]() {
+            try {
+                cache.get(key(6), failing);
+            } catch (std::runtime_error const& error) {
+                if (std::string(error.what()) == "tile not found") {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failures == 4);
+    REQUIRE(loads >= 1);
+    REQUIRE(cache.get(key(6), [](vt::tile_key const&) { return std::make_shared<const sized_value>(sized_value{ 10 }); })->bytes == 10);
+}
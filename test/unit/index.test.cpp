@@ -0,0 +1,117 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+#include <mapbox/vector_tile/layer_index.hpp>
+
+#include "test_tiles.hpp"
+
+#include <catch.hpp>
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace vt = mapbox::vector_tile;
+
+TEST_CASE( "Tile indexes round trip through their serialized form" ) {
+    const std::string data = build_roads_tile();
+    const vt::tile_index index = vt::tile_index::build(data);
+    const vt::tile_index parsed = vt::tile_index::parse(index.serialize());
+
+    CHECK(parsed.tileSize() == data.size());
+    CHECK(parsed.tileHash() == index.tileHash());
+    CHECK(parsed.matches(data));
+    REQUIRE(parsed.getLayers().size() == 2);
+    for (std::size_t i = 0; i < parsed.getLayers().size(); ++i) {
+        auto const& expected = index.getLayers()[i];
+        auto const& actual = parsed.getLayers()[i];
+        CHECK(actual.name == expected.name);
+        CHECK(actual.offset == expected.offset);
+        CHECK(actual.length == expected.length);
+        CHECK(actual.version == expected.version);
+        CHECK(actual.extent == expected.extent);
+        CHECK(actual.featureCount == expected.featureCount);
+        CHECK(actual.hasTables);
+        CHECK(actual.features == expected.features);
+        CHECK(actual.keys == expected.keys);
+        CHECK(actual.values == expected.values);
+    }
+
+    auto const* roads = parsed.findLayer("roads");
+    REQUIRE(roads != nullptr);
+    CHECK(roads->version == 2);
+    CHECK(roads->extent == 8192);
+    CHECK(roads->featureCount == 3);
+    CHECK(parsed.findLayer("water") == nullptr);
+}
+
+TEST_CASE( "Tiles opened with an index decode like scanned tiles" ) {
+    const std::string data = build_roads_tile();
+    const vt::tile_index index = vt::tile_index::parse(vt::tile_index::build(data).serialize());
+    const vt::buffer scanned(data);
+    const vt::buffer indexed(protozero::data_view(data), index);
+
+    CHECK(indexed.layerNames() == scanned.layerNames());
+    for (auto const& name : scanned.layerNames()) {
+        const vt::layer expected = scanned.getLayer(name);
+        const vt::layer actual = indexed.getLayer(name);
+        CHECK(actual.getName() == expected.getName());
+        CHECK(actual.getVersion() == expected.getVersion());
+        CHECK(actual.getExtent() == expected.getExtent());
+        REQUIRE(actual.featureCount() == expected.featureCount());
+        for (std::size_t i = 0; i < expected.featureCount(); ++i) {
+            CHECK(actual.getFeature(i) == expected.getFeature(i));
+            const vt::feature expected_feature(expected.getFeature(i), expected);
+            const vt::feature actual_feature(actual.getFeature(i), actual);
+            const auto expected_properties = expected_feature.getProperties();
+            const auto actual_properties = actual_feature.getProperties();
+            REQUIRE(actual_properties.size() == expected_properties.size());
+            for (auto const& property : expected_properties) {
+                REQUIRE(actual_properties.count(property.first) == 1);
+                CHECK(actual_properties.at(property.first).index() == property.second.index());
+            }
+        }
+    }
+    const vt::layer roads = indexed.getLayer("roads");
+    const vt::feature street(roads.getFeature(1), roads);
+    // Buffers refer to the entries of their index, which can't be a temporary.
+    static_assert(!std::is_constructible_v<vt::buffer, protozero::data_view, vt::tile_index>);
+    static_assert(std::is_constructible_v<vt::buffer, protozero::data_view, vt::tile_index const&>);
+    CHECK(std::get<std::string>(street.getValue("name")) == "street 1");
+    CHECK(std::get<std::uint64_t>(street.getValue("lanes")) == 2);
+}
+
+TEST_CASE( "Indexes without tables fall back to parsing layers" ) {
+    const std::string data = build_roads_tile();
+    const vt::tile_index index = vt::tile_index::parse(vt::tile_index::build(data, false).serialize());
+    REQUIRE(index.getLayers().size() == 2);
+    CHECK_FALSE(index.getLayers()[0].hasTables);
+    CHECK(index.getLayers()[0].features.empty());
+    CHECK(index.getLayers()[0].featureCount == 3);
+
+    const vt::buffer indexed(protozero::data_view(data), index);
+    const vt::layer roads = indexed.getLayer("roads");
+    CHECK(roads.featureCount() == 3);
+    CHECK(roads.getExtent() == 8192);
+}
+
+TEST_CASE( "Mismatched and corrupt tile indexes are rejected" ) {
+    const std::string data = build_roads_tile();
+    const vt::tile_index index = vt::tile_index::build(data);
+
+    std::string changed = data;
+    changed.back() = static_cast<char>(changed.back() ^ 1);
+    CHECK_FALSE(index.matches(changed));
+    CHECK_FALSE(index.matches(build_roads_tile() + "x"));
+    CHECK_THROWS_WITH(vt::buffer(protozero::data_view(data.data(), data.size() - 1), index), "tile index does not match the tile");
+
+    CHECK_THROWS_WITH(vt::tile_index::parse(std::string("\x08\x02", 2)), "unsupported tile index version");
+    CHECK_THROWS(vt::tile_index::parse(std::string("\x08", 1)));
+
+    // A table pointing past the end of its layer is caught when the layer is set up.
+    vt::layer_index_entry entry = index.getLayers()[1];
+    entry.values[0] = 1u << 20;
+    const vt::buffer tile(data);
+    CHECK_THROWS_WITH(vt::layer(tile.getLayers().at("areas"), entry), "layer index does not match the layer");
+}
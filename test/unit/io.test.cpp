@@ -0,0 +1,669 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+#include <mapbox/vector_tile/decompress.hpp>
+#include <mapbox/vector_tile/mapped_file.hpp>
+#include <mapbox/vector_tile/pmtiles.hpp>
+#include <mapbox/vector_tile/tile_loader.hpp>
+#include <mapbox/vector_tile/tile_scheduler.hpp>
+#include <mapbox/vector_tile/tile_stream.hpp>
+
+#include "test_tiles.hpp"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <functional>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vt = mapbox::vector_tile;
+
+static std::string temp_path(std::string const& name) {
+    return "/tmp/vector-tile-" + name;
+}
+
+static void write_file(std::string const& path, std::string const& data) {
+    std::ofstream stream(path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+TEST_CASE( "Tiles are decoded from a memory mapped file" ) {
+    const std::string path = temp_path("mapped.mvt");
+    const std::string data = build_points_tile("places", 20);
+    write_file(path, data);
+
+    vt::mapped_file file(path, vt::mapped_file::SEQUENTIAL | vt::mapped_file::WILLNEED);
+    REQUIRE(file.size() == data.size());
+    REQUIRE(file.view() == protozero::data_view(data));
+
+    vt::mapped_file moved(std::move(file));
+    REQUIRE(file.size() == 0);
+    vt::buffer tile(moved.view());
+    REQUIRE(tile.layerNames() == std::vector<std::string>{ "places" });
+    REQUIRE(tile.getLayer("places").featureCount() == 20);
+    std::remove(path.c_str());
+}
+
+TEST_CASE( "Empty and missing files are handled when mapping" ) {
+    const std::string path = temp_path("empty.mvt");
+    write_file(path, std::string());
+    vt::mapped_file file(path);
+    REQUIRE(file.size() == 0);
+    REQUIRE(vt::buffer(file.view()).layerNames().empty());
+    std::remove(path.c_str());
+
+    REQUIRE_THROWS_WITH(vt::mapped_file(temp_path("missing.mvt")), "could not open: '" + temp_path("missing.mvt") + "'");
+}
+
+struct test_entry {
+    std::uint64_t tileId;
+    std::uint64_t offset;
+    std::uint32_t length;
+    std::uint32_t runLength;
+};
+
+static std::string encode_directory(std::vector<test_entry> const& entries) {
+    std::string data;
+    const auto add = [&data](std::uint64_t value) { protozero::write_varint(std::back_inserter(data), value); };
+    add(entries.size());
+    std::uint64_t last_id = 0;
+    for (auto const& entry : entries) {
+        add(entry.tileId - last_id);
+        last_id = entry.tileId;
+    }
+    for (auto const& entry : entries) {
+        add(entry.runLength);
+    }
+    for (auto const& entry : entries) {
+        add(entry.length);
+    }
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const bool follows = i > 0 && entries[i].offset == entries[i - 1].offset + entries[i - 1].length;
+        add(follows ? 0 : entries[i].offset + 1);
+    }
+    return data;
+}
+
+static void put_uint64(std::string& data, std::size_t pos, std::uint64_t value) {
+    for (std::size_t i = 0; i < 8; ++i) {
+        data[pos + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+// An archive with a tile at zoom 0, one tile content shared by all zoom 1
+// tiles and all zoom 3 tiles behind leaf directories of four tiles each.
+// Directories are passed through compress_directory if given.
+static std::string build_archive(std::uint8_t internal_compression = vt::COMPRESSION_NONE,
+                                 std::function<std::string(std::string const&)> const& compress_directory = nullptr) {
+    const auto encode = [&compress_directory](std::vector<test_entry> const& entries) {
+        const std::string directory = encode_directory(entries);
+        return compress_directory ? compress_directory(directory) : directory;
+    };
+    std::string tile_data;
+    std::vector<test_entry> root;
+    const auto add_tile = [&tile_data](std::string const& data, std::uint64_t tile_id, std::uint32_t run_length) {
+        test_entry entry{ tile_id, tile_data.size(), static_cast<std::uint32_t>(data.size()), run_length };
+        tile_data += data;
+        return entry;
+    };
+    root.push_back(add_tile(build_points_tile("0/0/0", 1), 0, 1));
+    root.push_back(add_tile(build_points_tile("shared", 1), 1, 4));
+
+    std::string leaves;
+    std::vector<test_entry> leaf;
+    for (std::uint64_t id = vt::pmtiles_reader::tileId(3, 0, 0); id < vt::pmtiles_reader::tileId(4, 0, 0); ++id) {
+        leaf.push_back(test_entry{ id, 0, 0, 1 });
+    }
+    for (std::uint32_t x = 0; x < 8; ++x) {
+        for (std::uint32_t y = 0; y < 8; ++y) {
+            const std::uint64_t id = vt::pmtiles_reader::tileId(3, x, y);
+            leaf[id - leaf.front().tileId] = add_tile(build_points_tile("3/" + std::to_string(x) + "/" + std::to_string(y), 1), id, 1);
+        }
+    }
+    for (std::size_t i = 0; i < leaf.size(); i += 4) {
+        const std::string directory = encode(std::vector<test_entry>(leaf.begin() + static_cast<std::ptrdiff_t>(i),
+                                                                     leaf.begin() + static_cast<std::ptrdiff_t>(i + 4)));
+        root.push_back(test_entry{ leaf[i].tileId, leaves.size(), static_cast<std::uint32_t>(directory.size()), 0 });
+        leaves += directory;
+    }
+
+    const std::string root_directory = encode(root);
+    const std::string metadata = "{\"name\":\"test\"}";
+    std::string archive(127, '\0');
+    archive.replace(0, 7, "PMTiles");
+    archive[7] = 3;
+    put_uint64(archive, 8, 127);
+    put_uint64(archive, 16, root_directory.size());
+    put_uint64(archive, 24, 127 + root_directory.size());
+    put_uint64(archive, 32, metadata.size());
+    put_uint64(archive, 40, 127 + root_directory.size() + metadata.size());
+    put_uint64(archive, 48, leaves.size());
+    put_uint64(archive, 56, 127 + root_directory.size() + metadata.size() + leaves.size());
+    put_uint64(archive, 64, tile_data.size());
+    archive[97] = static_cast<char>(internal_compression);
+    archive[98] = vt::COMPRESSION_NONE;
+    archive[99] = 1;
+    archive[101] = 3;
+    return archive + root_directory + metadata + leaves + tile_data;
+}
+
+static std::string layer_name(protozero::data_view const& data) {
+    const auto names = vt::buffer(data).layerNames();
+    return names.size() == 1 ? names.front() : std::string();
+}
+
+TEST_CASE( "PMTiles tile ids follow the Hilbert curve per zoom level" ) {
+    REQUIRE(vt::pmtiles_reader::tileId(0, 0, 0) == 0);
+    REQUIRE(vt::pmtiles_reader::tileId(1, 0, 0) == 1);
+    REQUIRE(vt::pmtiles_reader::tileId(1, 0, 1) == 2);
+    REQUIRE(vt::pmtiles_reader::tileId(1, 1, 1) == 3);
+    REQUIRE(vt::pmtiles_reader::tileId(1, 1, 0) == 4);
+    REQUIRE(vt::pmtiles_reader::tileId(2, 0, 0) == 5);
+    REQUIRE(vt::pmtiles_reader::tileId(12, 3423, 1763) == 19078479);
+    REQUIRE_THROWS(vt::pmtiles_reader::tileId(1, 2, 0));
+}
+
+TEST_CASE( "Tiles are read from a PMTiles archive" ) {
+    const std::string path = temp_path("archive.pmtiles");
+    write_file(path, build_archive());
+    const vt::pmtiles_reader reader(path, 4);
+
+    REQUIRE(reader.getHeader().maxZoom == 3);
+    REQUIRE(reader.getMetadata().to_string() == "{\"name\":\"test\"}");
+    REQUIRE(layer_name(*reader.getTile(0, 0, 0)) == "0/0/0");
+    REQUIRE(layer_name(*reader.getTile(1, 0, 0)) == "shared");
+    REQUIRE(layer_name(*reader.getTile(1, 1, 0)) == "shared");
+    REQUIRE_FALSE(reader.getTile(2, 1, 1));
+    REQUIRE_FALSE(reader.getTile(4, 0, 0));
+    REQUIRE(layer_name(*reader.getTile(3, 5, 2)) == "3/5/2");
+
+    // Sixteen leaf directories share a cache of four, read concurrently.
+    std::vector<std::thread> threads;
+    std::vector<std::size_t> errors(4, 0);
+    for (std::uint32_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&reader, &errors, t]() {
+            for (int round = 0; round < 20; ++round) {
+                for (std::uint32_t x = 0; x < 8; ++x) {
+                    for (std::uint32_t y = 0; y < 8; ++y) {
+                        const auto tile = reader.getTile(3, (x + t) % 8, y);
+                        if (!tile || layer_name(*tile) != "3/" + std::to_string((x + t) % 8) + "/" + std::to_string(y)) {
+                            ++errors[t];
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(errors == std::vector<std::size_t>(4, 0));
+    std::remove(path.c_str());
+}
+
+TEST_CASE( "Invalid PMTiles archives are rejected" ) {
+    std::string archive = build_archive();
+    REQUIRE_THROWS_WITH(vt::pmtiles_reader(protozero::data_view(archive.data(), 100)), "not a PMTiles archive");
+    archive[97] = vt::COMPRESSION_BROTLI;
+    REQUIRE_THROWS_WITH(vt::pmtiles_reader(protozero::data_view(archive)), "unsupported PMTiles directory compression");
+    archive[97] = vt::COMPRESSION_NONE;
+    archive[7] = 2;
+    REQUIRE_THROWS_WITH(vt::pmtiles_reader(protozero::data_view(archive)), "unsupported PMTiles version");
+}
+
+TEST_CASE( "Tile compression is detected from the leading bytes" ) {
+    REQUIRE(vt::detectCompression(protozero::data_view(build_points_tile("places", 1))) == vt::TILE_UNCOMPRESSED);
+    REQUIRE(vt::detectCompression(protozero::data_view("\x1f\x8b\x08", 3)) == vt::TILE_GZIP);
+    REQUIRE(vt::detectCompression(protozero::data_view("\x78\x9c", 2)) == vt::TILE_ZLIB);
+    REQUIRE(vt::detectCompression(protozero::data_view("\x28\xb5\x2f\xfd", 4)) == vt::TILE_ZSTD);
+    REQUIRE(vt::detectCompression(protozero::data_view()) == vt::TILE_UNCOMPRESSED);
+}
+
+TEST_CASE( "Pooled buffers are reused per size class" ) {
+    vt::buffer_pool pool(2);
+    const void* first = nullptr;
+    {
+        vt::pooled_buffer buffer = pool.acquire(100);
+        REQUIRE(buffer.capacity() == 4096);
+        REQUIRE(buffer.size() == 0);
+        buffer.resize(100);
+        REQUIRE_THROWS(buffer.resize(5000));
+        first = buffer.data();
+    }
+    REQUIRE(pool.freeCount() == 1);
+    vt::pooled_buffer again = pool.acquire(4096);
+    REQUIRE(static_cast<const void*>(again.data()) == first);
+    vt::pooled_buffer larger = pool.acquire(4097);
+    REQUIRE(larger.capacity() == 8192);
+    REQUIRE(pool.freeCount() == 0);
+
+    vt::pooled_buffer moved(std::move(larger));
+    REQUIRE(static_cast<const void*>(larger.data()) == nullptr);
+    moved = vt::pooled_buffer();
+    REQUIRE(pool.freeCount() == 1);
+}
+
+TEST_CASE( "Uncompressed tiles are passed through without a copy" ) {
+    const std::string data = build_points_tile("places", 3);
+    vt::buffer_pool pool;
+    vt::tile_decompressor decompressor(pool);
+    vt::decompressed_tile tile = decompressor.decompress(protozero::data_view(data));
+    REQUIRE_FALSE(tile.isCopy());
+    REQUIRE(static_cast<const void*>(tile.view().data()) == data.data());
+}
+
+static std::vector<vt::tile_address> write_tile_tree(std::string const& root) {
+    std::filesystem::remove_all(root);
+    std::vector<vt::tile_address> tiles;
+    for (std::uint32_t x = 0; x < 8; ++x) {
+        for (std::uint32_t y = 0; y < 8; ++y) {
+            const vt::tile_address address{ 3, x, y };
+            tiles.push_back(address);
+            // Leave a few holes in the pyramid.
+            if ((x + y) % 5 == 0) {
+                continue;
+            }
+            const std::string directory = root + "/3/" + std::to_string(x);
+            std::filesystem::create_directories(directory);
+            write_file(directory + "/" + std::to_string(y) + ".mvt", build_points_tile("tile-" + std::to_string(x) + "-" + std::to_string(y), x + y + 1));
+        }
+    }
+    return tiles;
+}
+
+TEST_CASE( "Tiles are loaded in batches from a z/x/y directory" ) {
+    const std::string root = temp_path("tree");
+    const std::vector<vt::tile_address> tiles = write_tile_tree(root);
+
+    for (bool io_uring : { true, false }) {
+        vt::tile_loader_options options;
+        options.useIoUring = io_uring;
+        options.queueDepth = 4;
+        // Smaller than two tiles, so only one is held at a time.
+        options.memoryBudget = 1;
+        options.threads = 3;
+        vt::tile_loader loader(root, options);
+        if (!io_uring) {
+            REQUIRE_FALSE(loader.usesIoUring());
+        }
+        REQUIRE(loader.path(vt::tile_address{ 3, 1, 2 }) == root + "/3/1/2.mvt");
+
+        std::map<std::pair<std::uint32_t, std::uint32_t>, std::size_t> loaded;
+        const std::size_t found = loader.load(tiles, [&loaded](vt::tile_address const& address, protozero::data_view const& data) {
+            vt::buffer tile(data);
+            const std::string name = "tile-" + std::to_string(address.x) + "-" + std::to_string(address.y);
+            REQUIRE(tile.layerNames() == std::vector<std::string>{ name });
+            ++loaded[{ address.x, address.y }];
+            REQUIRE(tile.getLayer(name).featureCount() == address.x + address.y + 1);
+        });
+        REQUIRE(found == 52);
+        REQUIRE(loaded.size() == 52);
+        for (auto const& entry : loaded) {
+            REQUIRE(entry.second == 1);
+        }
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE( "Tile loader errors are reported after outstanding reads" ) {
+    const std::string root = temp_path("tree-errors");
+    std::vector<vt::tile_address> tiles = write_tile_tree(root);
+    for (bool io_uring : { true, false }) {
+        vt::tile_loader_options options;
+        options.useIoUring = io_uring;
+        vt::tile_loader loader(root, options);
+
+        std::size_t calls = 0;
+        REQUIRE_THROWS_WITH(loader.load(tiles, [&calls](vt::tile_address const&, protozero::data_view const&) {
+            if (++calls == 10) {
+                throw std::runtime_error("decode failed");
+            }
+        }), "decode failed");
+
+        // A directory where a tile should be cannot be read.
+        std::filesystem::create_directories(root + "/3/0/0.mvt");
+        REQUIRE_THROWS_WITH(loader.load(tiles, [](vt::tile_address const&, protozero::data_view const&) {}), "could not read: '" + root + "/3/0/0.mvt'");
+        std::filesystem::remove(root + "/3/0/0.mvt");
+
+        // The loader can be used again afterwards.
+        REQUIRE(loader.load(tiles, [](vt::tile_address const&, protozero::data_view const&) {}) == 52);
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE( "Tile priorities follow the distance to the view center" ) {
+    const vt::tile_view view{ 4.5, 6.5, 4 };
+    const double center = vt::tilePriority(vt::tile_address{ 4, 4, 6 }, view);
+    const double neighbor = vt::tilePriority(vt::tile_address{ 4, 5, 6 }, view);
+    const double corner = vt::tilePriority(vt::tile_address{ 4, 6, 8 }, view);
+    CHECK(center == Approx(0.0));
+    CHECK(neighbor == Approx(1.0));
+    CHECK(corner > neighbor);
+    // The child under the view center is one level away and half a tile off.
+    CHECK(vt::tilePriority(vt::tile_address{ 5, 9, 13 }, view) == Approx(4.0 + std::sqrt(0.5)));
+    CHECK(vt::tilePriority(vt::tile_address{ 3, 2, 3 }, view) == Approx(4.0 + std::sqrt(0.125)));
+}
+
+TEST_CASE( "Scheduled tiles are decoded most urgent first" ) {
+    // Tiles of one mapped file, as in an archive.
+    const std::string path = temp_path("scheduled.bin");
+    std::string contents;
+    std::map<std::uint32_t, std::pair<std::size_t, std::size_t>> offsets;
+    for (std::uint32_t x = 0; x < 8; ++x) {
+        const std::string tile = build_points_tile("tile-" + std::to_string(x), x + 1);
+        offsets[x] = { contents.size(), tile.size() };
+        contents += tile;
+    }
+    write_file(path, contents);
+    const vt::mapped_file file(path);
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    // Catch is not thread safe, results are checked after wait().
+    std::vector<std::uint32_t> order;
+    std::vector<std::size_t> feature_counts;
+    vt::tile_scheduler_options options;
+    options.threads = 1;
+    options.readAhead = 2;
+    vt::tile_scheduler scheduler(
+        [&file, &offsets](vt::tile_key const& key) -> std::optional<protozero::data_view> {
+            const auto it = offsets.find(key.address.x);
+            if (it == offsets.end()) {
+                return std::nullopt;
+            }
+            return protozero::data_view(file.data() + it->second.first, it->second.second);
+        },
+        [&order, &feature_counts, &released](vt::tile_key const& key, vt::buffer const& tile) {
+            order.push_back(key.address.x);
+            feature_counts.push_back(tile.getLayer("tile-" + std::to_string(key.address.x)).featureCount());
+            released.wait();
+        },
+        options);
+
+    // The first tile occupies the only thread until released.
+    scheduler.request(vt::tile_key{ 0, vt::tile_address{ 3, 0, 0 } }, 0.0);
+    while (scheduler.size() != 0) {
+        std::this_thread::yield();
+    }
+    for (std::uint32_t x = 1; x < 8; ++x) {
+        scheduler.request(vt::tile_key{ 0, vt::tile_address{ 3, x, 0 } }, double(x));
+    }
+    // Missing tiles are skipped.
+    scheduler.request(vt::tile_key{ 0, vt::tile_address{ 3, 9, 0 } }, 0.5);
+    // The view moves to the other end, tile 2 is requested again as most urgent.
+    scheduler.reprioritize([](vt::tile_key const& key) { return -double(key.address.x); });
+    scheduler.request(vt::tile_key{ 0, vt::tile_address{ 3, 2, 0 } }, -100.0);
+    REQUIRE(scheduler.cancel(vt::tile_key{ 0, vt::tile_address{ 3, 5, 0 } }));
+    REQUIRE_FALSE(scheduler.cancel(vt::tile_key{ 1, vt::tile_address{ 3, 5, 0 } }));
+    REQUIRE(scheduler.size() == 7);
+
+    release.set_value();
+    scheduler.wait();
+    REQUIRE(scheduler.size() == 0);
+    CHECK((order == std::vector<std::uint32_t>{ 0, 2, 7, 6, 4, 3, 1 }));
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        CHECK(feature_counts[i] == order[i] + 1);
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE( "Scheduled tiles are read ahead after decoding" ) {
+    const std::string data = build_points_tile("tile", 1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    // Locate (L) and decode (D) calls, all on the only thread.
+    std::vector<std::string> calls;
+    vt::tile_scheduler_options options;
+    options.threads = 1;
+    options.readAhead = 2;
+    vt::tile_scheduler scheduler(
+        [&data, &calls](vt::tile_key const& key) -> std::optional<protozero::data_view> {
+            calls.push_back("L" + std::to_string(key.address.x));
+            return protozero::data_view(data);
+        },
+        [&calls, &released](vt::tile_key const& key, vt::buffer const&) {
+            calls.push_back("D" + std::to_string(key.address.x));
+            released.wait();
+        },
+        options);
+
+    scheduler.request(vt::tile_key{ 0, vt::tile_address{ 3, 0, 0 } }, 0.0);
+    while (scheduler.size() != 0) {
+        std::this_thread::yield();
+    }
+    for (std::uint32_t x = 1; x < 5; ++x) {
+        scheduler.request(vt::tile_key{ 0, vt::tile_address{ 3, x, 0 } }, double(x));
+    }
+    release.set_value();
+    scheduler.wait();
+    // Tiles read ahead are not located again when they are decoded.
+    CHECK((calls == std::vector<std::string>{ "L0", "D0", "L1", "L2", "D1", "L3", "D2", "L4", "D3", "D4" }));
+}
+
+TEST_CASE( "Scheduler errors are reported by wait" ) {
+    const std::string data = build_points_tile("tile", 1);
+    std::atomic<std::size_t> decoded{ 0 };
+    vt::tile_scheduler_options options;
+    options.threads = 2;
+    vt::tile_scheduler scheduler(
+        [&data](vt::tile_key const& key) -> std::optional<protozero::data_view> {
+            if (key.address.x == 3) {
+                throw std::runtime_error("could not locate tile");
+            }
+            return protozero::data_view(data);
+        },
+        [&decoded](vt::tile_key const&, vt::buffer const&) { ++decoded; },
+        options);
+    for (std::uint32_t x = 0; x < 2; ++x) {
+        scheduler.request(vt::tile_key{ 0, vt::tile_address{ 2, x, 0 } }, 0.0);
+    }
+    scheduler.wait();
+    for (std::uint32_t x = 2; x < 6; ++x) {
+        scheduler.request(vt::tile_key{ 0, vt::tile_address{ 2, x, 0 } }, double(x));
+    }
+    REQUIRE_THROWS_WITH(scheduler.wait(), "could not locate tile");
+    // The other tiles are still decoded and the error is reported once.
+    scheduler.wait();
+    CHECK(decoded == 5);
+}
+
+TEST_CASE( "Tiles round trip through a length-prefixed stream" ) {
+    std::vector<std::string> tiles;
+    for (std::size_t i = 0; i < 20; ++i) {
+        tiles.push_back(build_points_tile("layer-" + std::to_string(i), i * 40));
+    }
+    tiles.push_back(std::string());
+
+    std::stringstream stream;
+    {
+        vt::tile_stream_writer writer(stream, 1024);
+        for (auto const& tile : tiles) {
+            writer.write(protozero::data_view(tile));
+        }
+    }
+
+    for (bool read_ahead : { false, true }) {
+        stream.clear();
+        stream.seekg(0);
+        vt::tile_stream_options options;
+        options.bufferCount = 3;
+        options.readAhead = read_ahead;
+        vt::tile_stream_reader reader(stream, options);
+        std::size_t count = 0;
+        while (auto data = reader.next()) {
+            REQUIRE(count < tiles.size());
+            REQUIRE(*data == protozero::data_view(tiles[count]));
+            if (!tiles[count].empty()) {
+                REQUIRE(vt::buffer(*data).layerNames() == std::vector<std::string>{ "layer-" + std::to_string(count) });
+            }
+            ++count;
+        }
+        REQUIRE(count == tiles.size());
+        REQUIRE_FALSE(reader.next());
+    }
+}
+
+TEST_CASE( "Tile streams are read from a pipe while decoding" ) {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    const std::string tile = build_points_tile("places", 500);
+    std::thread producer([&tile, fd = fds[1]]() {
+        {
+            vt::tile_stream_writer writer(fd);
+            for (int i = 0; i < 50; ++i) {
+                writer.write(protozero::data_view(tile));
+            }
+        }
+        ::close(fd);
+    });
+
+    vt::tile_stream_options options;
+    options.readAhead = true;
+    std::size_t features = 0;
+    {
+        vt::tile_stream_reader reader(fds[0], options);
+        while (auto data = reader.next()) {
+            features += vt::buffer(*data).getLayer("places").featureCount();
+        }
+    }
+    producer.join();
+    ::close(fds[0]);
+    REQUIRE(features == 50 * 500);
+}
+
+TEST_CASE( "Broken tile streams are rejected" ) {
+    const std::string tile = build_points_tile("places", 10);
+    std::stringstream stream;
+    {
+        vt::tile_stream_writer writer(stream);
+        writer.write(protozero::data_view(tile));
+        writer.write(protozero::data_view(tile));
+    }
+    const std::string encoded = stream.str();
+
+    for (bool read_ahead : { false, true }) {
+        vt::tile_stream_options options;
+        options.readAhead = read_ahead;
+
+        std::istringstream truncated(encoded.substr(0, encoded.size() - 3));
+        vt::tile_stream_reader reader(truncated, options);
+        REQUIRE(reader.next());
+        REQUIRE_THROWS_WITH(reader.next(), "truncated tile stream");
+
+        options.maxFrameSize = tile.size() - 1;
+        std::istringstream complete(encoded);
+        vt::tile_stream_reader limited(complete, options);
+        REQUIRE_THROWS_WITH(limited.next(), "tile stream frame exceeds the size limit");
+    }
+}
+
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZLIB
+
+static std::string deflate_tile(std::string const& data, int window_bits) {
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    std::string output(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+TEST_CASE( "Gzip and zlib compressed tiles are decompressed into pooled buffers" ) {
+    const std::string data = build_points_tile("places", 2000);
+    REQUIRE(data.size() > 8192);
+    vt::buffer_pool pool;
+    vt::tile_decompressor decompressor(pool);
+    for (int window_bits : { 15 + 16, 15 }) {
+        const std::string compressed = deflate_tile(data, window_bits);
+        vt::decompressed_tile tile = decompressor.decompress(protozero::data_view(compressed));
+        REQUIRE(tile.isCopy());
+        REQUIRE(tile.view() == protozero::data_view(data));
+        vt::buffer decoded(tile.view());
+        REQUIRE(decoded.getLayer("places").featureCount() == 2000);
+    }
+    // Both buffers went back to the pool and are reused.
+    REQUIRE(pool.freeCount() >= 1);
+    const std::size_t free = pool.freeCount();
+    {
+        vt::decompressed_tile tile = decompressor.decompress(protozero::data_view(deflate_tile(data, 15 + 16)));
+        REQUIRE(pool.freeCount() == free - 1);
+    }
+    REQUIRE(pool.freeCount() == free);
+}
+
+TEST_CASE( "Corrupt and oversized compressed tiles are rejected" ) {
+    const std::string data = build_points_tile("places", 2000);
+    const std::string compressed = deflate_tile(data, 15 + 16);
+    vt::buffer_pool pool;
+    vt::tile_decompressor decompressor(pool);
+    REQUIRE_THROWS_WITH(decompressor.decompress(protozero::data_view(compressed.data(), compressed.size() / 2)), "compressed tile is truncated");
+
+    vt::tile_decompressor limited(pool, 4096);
+    REQUIRE_THROWS_WITH(limited.decompress(protozero::data_view(compressed)), "decompressed tile exceeds the size limit");
+
+    std::string corrupt = compressed;
+    corrupt[12] = static_cast<char>(~corrupt[12]);
+    corrupt[13] = static_cast<char>(~corrupt[13]);
+    REQUIRE_THROWS(decompressor.decompress(protozero::data_view(corrupt)));
+}
+
+TEST_CASE( "Gzip compressed PMTiles directories are decompressed" ) {
+    const auto gzip = [](std::string const& directory) { return deflate_tile(directory, 15 + 16); };
+    const std::string archive = build_archive(vt::COMPRESSION_GZIP, gzip);
+    const vt::pmtiles_reader reader{ protozero::data_view(archive) };
+    REQUIRE(layer_name(*reader.getTile(0, 0, 0)) == "0/0/0");
+    REQUIRE(layer_name(*reader.getTile(1, 1, 0)) == "shared");
+    REQUIRE(layer_name(*reader.getTile(3, 5, 2)) == "3/5/2");
+    REQUIRE_FALSE(reader.getTile(2, 1, 1));
+
+    // The declared compression has to match the directories.
+    const std::string mislabeled = build_archive(vt::COMPRESSION_GZIP);
+    REQUIRE_THROWS_WITH(vt::pmtiles_reader{ protozero::data_view(mislabeled) }, "PMTiles directory is not compressed as declared");
+}
+
+#endif
+
+#ifdef MAPBOX_VECTOR_TILE_WITH_ZSTD
+
+TEST_CASE( "Zstd compressed tiles round trip through the decompressor" ) {
+    const std::string data = build_points_tile("places", 2000);
+    std::string compressed(ZSTD_compressBound(data.size()), '\0');
+    compressed.resize(ZSTD_compress(&compressed[0], compressed.size(), data.data(), data.size(), 3));
+    REQUIRE(vt::detectCompression(protozero::data_view(compressed)) == vt::TILE_ZSTD);
+
+    vt::buffer_pool pool;
+    vt::tile_decompressor decompressor(pool);
+    {
+        vt::decompressed_tile tile = decompressor.decompress(protozero::data_view(compressed));
+        REQUIRE(tile.isCopy());
+        REQUIRE(tile.view() == protozero::data_view(data));
+        REQUIRE(vt::buffer(tile.view()).getLayer("places").featureCount() == 2000);
+    }
+    REQUIRE_THROWS_WITH(decompressor.decompress(protozero::data_view(compressed.data(), compressed.size() / 2)), "compressed tile is truncated");
+
+    // A raw content dictionary shared by the encoder and the decoder.
+    const std::string dictionary = build_points_tile("places", 20);
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    std::string with_dictionary(ZSTD_compressBound(data.size()), '\0');
+    with_dictionary.resize(ZSTD_compress_usingDict(context, &with_dictionary[0], with_dictionary.size(), data.data(), data.size(),
+                                                   dictionary.data(), dictionary.size(), 3));
+    ZSTD_freeCCtx(context);
+    decompressor.setZstdDictionary(protozero::data_view(dictionary));
+    REQUIRE(decompressor.decompress(protozero::data_view(with_dictionary)).view() == protozero::data_view(data));
+}
+
+#endif
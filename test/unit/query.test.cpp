@@ -0,0 +1,317 @@
+#include <mapbox/vector_tile.hpp>
+#include <protozero/pbf_writer.hpp>
+
+#include <catch.hpp>
+
+#include <limits>
+
+namespace vt = mapbox::vector_tile;
+
+static void add_point_feature(protozero::pbf_writer& layer, std::uint64_t id, std::vector<std::uint32_t> const& tags, std::int32_t x, std::int32_t y) {
+    protozero::pbf_writer feature(layer, vt::LayerType::FEATURES);
+    feature.add_uint64(vt::FeatureType::ID, id);
+    feature.add_packed_uint32(vt::FeatureType::TAGS, tags.begin(), tags.end());
+    feature.add_enum(vt::FeatureType::TYPE, vt::GeomType::POINT);
+    const std::vector<std::uint32_t> geometry = { (1 << 3) | vt::CommandType::MOVE_TO, protozero::encode_zigzag32(x), protozero::encode_zigzag32(y) };
+    feature.add_packed_uint32(vt::FeatureType::GEOMETRY, geometry.begin(), geometry.end());
+}
+
+// A "peaks" layer with the elevation stored as every numeric value type.
+static std::string build_peaks_tile() {
+    std::string data;
+    protozero::pbf_writer tile(data);
+    {
+        protozero::pbf_writer layer(tile, vt::TileType::LAYERS);
+        layer.add_uint32(vt::LayerType::VERSION, 2);
+        layer.add_string(vt::LayerType::NAME, "peaks");
+        add_point_feature(layer, 1, { 0, 0, 1, 6 }, 10, 10);
+        add_point_feature(layer, 2, { 0, 1, 1, 7 }, 20, 20);
+        add_point_feature(layer, 3, { 1, 8 }, 30, 30);
+        add_point_feature(layer, 4, { 0, 2 }, 40, 40);
+        add_point_feature(layer, 5, { 0, 3 }, 50, 50);
+        add_point_feature(layer, 6, { 0, 4 }, 60, 60);
+        add_point_feature(layer, 7, { 0, 5 }, 70, 70);
+        add_point_feature(layer, 8, { 0, 1 }, 80, 80);
+        layer.add_string(vt::LayerType::KEYS, "ele");
+        layer.add_string(vt::LayerType::KEYS, "name");
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_uint64(vt::ValueType::UINT, 3798);
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_double(vt::ValueType::DOUBLE, 3905.5);
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_sint64(vt::ValueType::SINT, -12);
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_float(vt::ValueType::FLOAT, 2962.0f);
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "unknown");
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_int64(vt::ValueType::INT, 4478);
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "Grossglockner");
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "Ortler");
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "Nameless");
+        }
+        layer.add_uint32(vt::LayerType::EXTENT, 4096);
+    }
+    return data;
+}
+
+TEST_CASE( "Top features by numeric property" ) {
+    const std::string data = build_peaks_tile();
+    vt::buffer tile(data);
+    auto const layer = tile.getLayer("peaks");
+    REQUIRE(layer.featureCount() == 8);
+
+    // ele per feature: 3798, 3905.5, none, -12, 2962, "unknown", 4478, 3905.5
+    auto const top = layer.topFeatures("ele", 3);
+    REQUIRE(top == std::vector<std::size_t>({ 6, 1, 7 }));
+
+    auto const all = layer.topFeatures("ele", 100);
+    REQUIRE(all == std::vector<std::size_t>({ 6, 1, 7, 0, 4, 3 }));
+
+    REQUIRE(layer.topFeatures("ele", 0).empty());
+    REQUIRE(layer.topFeatures("name", 3).empty());
+    REQUIRE(layer.topFeatures("missing", 3).empty());
+}
+
+TEST_CASE( "Top features skip NaN values" ) {
+    std::string data;
+    protozero::pbf_writer tile(data);
+    {
+        protozero::pbf_writer layer(tile, vt::TileType::LAYERS);
+        layer.add_uint32(vt::LayerType::VERSION, 2);
+        layer.add_string(vt::LayerType::NAME, "peaks");
+        add_point_feature(layer, 1, { 0, 0 }, 10, 10);
+        add_point_feature(layer, 2, { 0, 1 }, 20, 20);
+        add_point_feature(layer, 3, { 0, 2 }, 30, 30);
+        add_point_feature(layer, 4, { 0, 1 }, 40, 40);
+        layer.add_string(vt::LayerType::KEYS, "ele");
+        for (const double ele : { 100.0, std::numeric_limits<double>::quiet_NaN(), 300.0 }) {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_double(vt::ValueType::DOUBLE, ele);
+        }
+        layer.add_uint32(vt::LayerType::EXTENT, 4096);
+    }
+    vt::buffer buffer(data);
+    auto const layer = buffer.getLayer("peaks");
+    REQUIRE(layer.topFeatures("ele", 10) == std::vector<std::size_t>({ 2, 0 }));
+}
+
+static void add_feature(protozero::pbf_writer& layer, vt::GeomType type, std::vector<std::uint32_t> const& geometry) {
+    protozero::pbf_writer feature(layer, vt::LayerType::FEATURES);
+    feature.add_enum(vt::FeatureType::TYPE, type);
+    feature.add_packed_uint32(vt::FeatureType::GEOMETRY, geometry.begin(), geometry.end());
+}
+
+static std::uint32_t command(vt::CommandType cmd, std::uint32_t count) {
+    return (count << 3) | cmd;
+}
+
+static std::uint32_t param(std::int32_t delta) {
+    return protozero::encode_zigzag32(delta);
+}
+
+// A square with a square hole, a line and a multipoint.
+static std::string build_shapes_tile() {
+    std::string data;
+    protozero::pbf_writer tile(data);
+    {
+        protozero::pbf_writer layer(tile, vt::TileType::LAYERS);
+        layer.add_uint32(vt::LayerType::VERSION, 2);
+        layer.add_string(vt::LayerType::NAME, "shapes");
+        add_feature(layer, vt::GeomType::POLYGON, {
+            command(vt::CommandType::MOVE_TO, 1), param(0), param(0),
+            command(vt::CommandType::LINE_TO, 3), param(100), param(0), param(0), param(100), param(-100), param(0),
+            command(vt::CommandType::CLOSE, 1),
+            command(vt::CommandType::MOVE_TO, 1), param(25), param(-75),
+            command(vt::CommandType::LINE_TO, 3), param(0), param(50), param(50), param(0), param(0), param(-50),
+            command(vt::CommandType::CLOSE, 1) });
+        add_feature(layer, vt::GeomType::LINESTRING, {
+            command(vt::CommandType::MOVE_TO, 1), param(200), param(0),
+            command(vt::CommandType::LINE_TO, 1), param(100), param(0) });
+        add_feature(layer, vt::GeomType::POINT, {
+            command(vt::CommandType::MOVE_TO, 2), param(10), param(200), param(30), param(0) });
+        layer.add_uint32(vt::LayerType::EXTENT, 4096);
+    }
+    return data;
+}
+
+TEST_CASE( "Hit tests on encoded geometry" ) {
+    const std::string data = build_shapes_tile();
+    vt::buffer tile(data);
+    auto const layer = tile.getLayer("shapes");
+    REQUIRE(layer.featureCount() == 3);
+    using point = mapbox::geometry::point<double>;
+
+    auto const polygon = vt::feature(layer.getFeature(0), layer);
+    auto const bbox = polygon.getBoundingBox();
+    CHECK(bbox.min == mapbox::geometry::point<std::int64_t>(0, 0));
+    CHECK(bbox.max == mapbox::geometry::point<std::int64_t>(100, 100));
+    CHECK(polygon.contains(point(10, 10)));
+    CHECK(polygon.contains(point(90, 50)));
+    CHECK_FALSE(polygon.contains(point(50, 50)));
+    CHECK_FALSE(polygon.contains(point(150, 50)));
+    CHECK(polygon.contains(point(10, 10), bbox));
+    CHECK_FALSE(polygon.contains(point(50, 50), bbox));
+    CHECK_FALSE(polygon.contains(point(150, 50), bbox));
+    CHECK(polygon.distanceTo(point(10, 10)) == Approx(0.0));
+    CHECK(polygon.distanceTo(point(50, 50)) == Approx(25.0));
+    CHECK(polygon.distanceTo(point(-3, 50)) == Approx(3.0));
+    CHECK(polygon.distanceTo(point(103, 104)) == Approx(5.0));
+
+    auto const line = vt::feature(layer.getFeature(1), layer);
+    CHECK_FALSE(line.contains(point(250, 0)));
+    CHECK(line.distanceTo(point(250, 10)) == Approx(10.0));
+    CHECK(line.distanceTo(point(196, 3)) == Approx(5.0));
+
+    auto const points = vt::feature(layer.getFeature(2), layer);
+    CHECK(points.distanceTo(point(10, 200)) == Approx(0.0));
+    CHECK(points.distanceTo(point(43, 204)) == Approx(5.0));
+}
+
+TEST_CASE( "Layer statistics" ) {
+    const std::string peaks_data = build_peaks_tile();
+    vt::buffer peaks_tile(peaks_data);
+    auto const peaks = peaks_tile.getLayer("peaks").statistics();
+    REQUIRE(peaks.featureCount == 8);
+    CHECK(peaks.geometryCounts[vt::GeomType::POINT] == 8);
+    CHECK(peaks.vertexCount == 8);
+    REQUIRE(peaks.keys.size() == 2);
+
+    auto const& ele = peaks.keys[0];
+    CHECK(ele.key == "ele");
+    CHECK(ele.featureCount == 7);
+    CHECK(ele.coverage == Approx(7.0 / 8.0));
+    CHECK(ele.distinctValues == 6);
+    CHECK(ele.min == Approx(-12.0));
+    CHECK(ele.max == Approx(4478.0));
+    CHECK(ele.valueTypes == ((1u << vt::ValueType::STRING) | (1u << vt::ValueType::FLOAT) | (1u << vt::ValueType::DOUBLE) |
+                             (1u << vt::ValueType::INT) | (1u << vt::ValueType::UINT) | (1u << vt::ValueType::SINT)));
+
+    auto const& name = peaks.keys[1];
+    CHECK(name.key == "name");
+    CHECK(name.featureCount == 3);
+    CHECK(name.distinctValues == 3);
+    CHECK(name.valueTypes == (1u << vt::ValueType::STRING));
+    CHECK(name.min > name.max);
+
+    const std::string shapes_data = build_shapes_tile();
+    vt::buffer shapes_tile(shapes_data);
+    auto const shapes = shapes_tile.getLayer("shapes").statistics();
+    CHECK(shapes.geometryCounts[vt::GeomType::POLYGON] == 1);
+    CHECK(shapes.geometryCounts[vt::GeomType::LINESTRING] == 1);
+    CHECK(shapes.geometryCounts[vt::GeomType::POINT] == 1);
+    CHECK(shapes.vertexCount == 12);
+    CHECK(shapes.keys.empty());
+
+    // A key repeated in the key table is reported once, under its first position.
+    std::string repeated_data;
+    {
+        protozero::pbf_writer tile(repeated_data);
+        protozero::pbf_writer layer(tile, vt::TileType::LAYERS);
+        layer.add_uint32(vt::LayerType::VERSION, 2);
+        layer.add_string(vt::LayerType::NAME, "repeated");
+        add_point_feature(layer, 1, { 0, 0 }, 10, 10);
+        add_point_feature(layer, 2, { 2, 1 }, 20, 20);
+        add_point_feature(layer, 3, { 1, 0, 2, 1 }, 30, 30);
+        layer.add_string(vt::LayerType::KEYS, "ele");
+        layer.add_string(vt::LayerType::KEYS, "name");
+        layer.add_string(vt::LayerType::KEYS, "ele");
+        for (const std::uint64_t number : { std::uint64_t(100), std::uint64_t(200) }) {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_uint64(vt::ValueType::UINT, number);
+        }
+        layer.add_uint32(vt::LayerType::EXTENT, 4096);
+    }
+    vt::buffer repeated_tile(repeated_data);
+    auto const repeated = repeated_tile.getLayer("repeated").statistics();
+    REQUIRE(repeated.keys.size() == 2);
+    CHECK(repeated.keys[0].key == "ele");
+    CHECK(repeated.keys[0].featureCount == 3);
+    CHECK(repeated.keys[0].max == Approx(200.0));
+    CHECK(repeated.keys[1].key == "name");
+    CHECK(repeated.keys[1].featureCount == 1);
+}
+
+TEST_CASE( "Batch lookup of several keys" ) {
+    const std::string data = build_peaks_tile();
+    vt::buffer tile(data);
+    auto const layer = tile.getLayer("peaks");
+    const vt::key_set keys(layer, { "name", "missing", "ele" });
+    REQUIRE(keys.size() == 3);
+
+    std::vector<mapbox::feature::value> values;
+    std::string warning;
+    vt::feature(layer.getFeature(0), layer).getValues(keys, values, &warning);
+    REQUIRE(values.size() == 3);
+    CHECK(std::get<std::string>(values[0]) == "Grossglockner");
+    CHECK(std::holds_alternative<mapbox::feature::null_value_t>(values[1]));
+    CHECK(std::get<std::uint64_t>(values[2]) == 3798);
+    CHECK(warning.empty());
+
+    vt::feature(layer.getFeature(2), layer).getValues(keys, values, &warning);
+    CHECK(std::get<std::string>(values[0]) == "Nameless");
+    CHECK(std::holds_alternative<mapbox::feature::null_value_t>(values[2]));
+
+    std::vector<protozero::data_view> views;
+    vt::feature(layer.getFeature(6), layer).getValues(keys, views);
+    REQUIRE(views.size() == 3);
+    CHECK(views[0].size() == 0);
+    CHECK(views[2].size() > 0);
+}
+
+TEST_CASE( "Batch lookup reports duplicate keys like getValue" ) {
+    std::string data;
+    protozero::pbf_writer tile(data);
+    {
+        protozero::pbf_writer layer(tile, vt::TileType::LAYERS);
+        layer.add_uint32(vt::LayerType::VERSION, 2);
+        layer.add_string(vt::LayerType::NAME, "duplicates");
+        add_point_feature(layer, 1, { 1, 1, 2, 0 }, 0, 0);
+        layer.add_string(vt::LayerType::KEYS, "hello");
+        layer.add_string(vt::LayerType::KEYS, "hello");
+        layer.add_string(vt::LayerType::KEYS, "unique");
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "single_value");
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "world");
+        }
+        layer.add_uint32(vt::LayerType::EXTENT, 4096);
+    }
+    vt::buffer buffer(data);
+    auto const layer = buffer.getLayer("duplicates");
+    auto const feature = vt::feature(layer.getFeature(0), layer);
+
+    std::vector<mapbox::feature::value> values;
+    std::string warning;
+    feature.getValues(vt::key_set(layer, { "unique" }), values, &warning);
+    CHECK(warning.empty());
+    CHECK(std::get<std::string>(values[0]) == "single_value");
+
+    feature.getValues(vt::key_set(layer, { "unique", "hello" }), values, &warning);
+    CHECK(warning == "duplicate keys with different tag ids are found");
+    CHECK(std::get<std::string>(values[1]) == "world");
+    CHECK(std::get<std::string>(feature.getValue("hello")) == "world");
+}
@@ -0,0 +1,135 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+#include <mapbox/vector_tile/mapped_file.hpp>
+#include <mapbox/vector_tile/snapshot.hpp>
+
+#include "test_tiles.hpp"
+
+#include <catch.hpp>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace vt = mapbox::vector_tile;
+
+static bool same_properties(vt::feature::properties_type const& a, vt::feature::properties_type const& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (auto const& entry : a) {
+        const auto other = b.find(entry.first);
+        if (other == b.end() || other->second.index() != entry.second.index()) {
+            return false;
+        }
+        const bool equal = std::visit([&other](auto const& value) {
+            using type = std::decay_t<decltype(value)>;
+            if constexpr (std::is_same_v<type, double>) {
+                // Snapshots have to round trip doubles bit for bit.
+                return std::bit_cast<std::uint64_t>(std::get<double>(other->second)) == std::bit_cast<std::uint64_t>(value);
+            } else if constexpr (std::is_same_v<type, bool> || std::is_same_v<type, std::uint64_t> || std::is_same_v<type, std::int64_t> ||
+                                 std::is_same_v<type, std::string>) {
+                return std::get<type>(other->second) == value;
+            } else {
+                return std::is_same_v<type, mapbox::feature::null_value_t>;
+            }
+        }, entry.second);
+        if (!equal) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE( "Snapshots hold the decoded form of a tile" ) {
+    const std::string data = build_roads_tile();
+    const std::string image = vt::createSnapshot(protozero::data_view(data));
+    const vt::tile_snapshot snapshot{ protozero::data_view(image), protozero::data_view(data) };
+    REQUIRE(snapshot.sourceHash() == vt::tile_snapshot::hashSource(protozero::data_view(data)));
+    REQUIRE((snapshot.layerNames() == std::vector<std::string>{ "roads", "areas" }));
+
+    const vt::buffer tile(data);
+    for (auto const& name : tile.layerNames()) {
+        const vt::layer layer = tile.getLayer(name);
+        const vt::snapshot_layer restored = snapshot.getLayer(name);
+        REQUIRE(restored.getName() == name);
+        REQUIRE(restored.getVersion() == layer.getVersion());
+        REQUIRE(restored.getExtent() == layer.getExtent());
+        REQUIRE(restored.featureCount() == layer.featureCount());
+        for (std::size_t i = 0; i < layer.featureCount(); ++i) {
+            const vt::feature feature(layer.getFeature(i), layer);
+            const vt::snapshot_feature restored_feature = restored.getFeature(i);
+            REQUIRE(restored_feature.getType() == feature.getType());
+            REQUIRE(restored_feature.getID() == feature.getID());
+            REQUIRE(same_properties(restored_feature.getProperties(), feature.getProperties()));
+
+            const auto paths = feature.getGeometries<vt::points_arrays_type>(1.0);
+            REQUIRE(restored_feature.ringCount() == paths.size());
+            std::size_t points = 0;
+            for (std::size_t r = 0; r < paths.size(); ++r) {
+                const auto ring = restored_feature.getRing(r);
+                REQUIRE(ring.size() == paths[r].size());
+                for (std::size_t p = 0; p < ring.size(); ++p) {
+                    REQUIRE(ring[p].x == paths[r][p].x);
+                    REQUIRE(ring[p].y == paths[r][p].y);
+                }
+                points += ring.size();
+            }
+            REQUIRE(restored_feature.getPoints().size() == points);
+            REQUIRE(restored_feature.getTriangles().empty());
+        }
+    }
+    REQUIRE(std::get<std::uint64_t>(snapshot.getLayer("roads").getFeature(0).getID()) == 7);
+    REQUIRE(std::get<double>(snapshot.getLayer("areas").getValue(0)) == Approx(-3.5));
+    REQUIRE_THROWS_WITH(snapshot.getLayer("water"), "no layer by the name of 'water'");
+}
+
+TEST_CASE( "Snapshots are saved with one write and mapped back in" ) {
+    const std::string data = build_roads_tile();
+    const std::string path = "/tmp/vector-tile-snapshot.bin";
+    std::size_t calls = 0;
+    vt::saveSnapshot(path, vt::createSnapshot(protozero::data_view(data), [&calls](vt::feature const& feature) {
+        ++calls;
+        REQUIRE(feature.getType() == vt::GeomType::POLYGON);
+        return std::vector<std::uint32_t>{ 0, 1, 2, 0, 2, 3 };
+    }));
+    REQUIRE(calls == 1);
+
+    const vt::mapped_file file(path);
+    const vt::tile_snapshot snapshot(file.view(), protozero::data_view(data));
+    const vt::snapshot_feature polygon = snapshot.getLayer("areas").getFeature(0);
+    REQUIRE(polygon.ringCount() == 2);
+    REQUIRE(polygon.getPoints().size() == 10);
+    const auto triangles = polygon.getTriangles();
+    REQUIRE((std::vector<std::uint32_t>(triangles.begin(), triangles.end()) == std::vector<std::uint32_t>{ 0, 1, 2, 0, 2, 3 }));
+    std::remove(path.c_str());
+
+    REQUIRE_THROWS_WITH(vt::createSnapshot(protozero::data_view(data), [](vt::feature const&) { return std::vector<std::uint32_t>{ 0, 1, 10 }; }),
+                        "triangle index out of range");
+}
+
+TEST_CASE( "Stale and corrupt snapshots are rejected" ) {
+    const std::string data = build_roads_tile();
+    std::string image = vt::createSnapshot(protozero::data_view(data));
+
+    std::string changed = data;
+    changed.back() = static_cast<char>(changed.back() ^ 1);
+    REQUIRE_THROWS_WITH(vt::tile_snapshot(protozero::data_view(image), protozero::data_view(changed)), "tile snapshot does not match its source tile");
+    REQUIRE_THROWS_WITH(vt::tile_snapshot(protozero::data_view(data), protozero::data_view(data)), "not a tile snapshot");
+
+    const std::uint64_t hash = vt::tile_snapshot::hashSource(protozero::data_view(data));
+    std::string truncated = image.substr(0, image.size() - 8);
+    REQUIRE_THROWS_WITH(vt::tile_snapshot(protozero::data_view(truncated), hash), "tile snapshot is corrupt");
+
+    // Point the first layer's features past the end of the image.
+    std::string corrupt = image;
+    const std::uint64_t past_end = corrupt.size();
+    std::memcpy(&corrupt[sizeof(vt::detail::snapshot_header) + offsetof(vt::detail::snapshot_layer_record, features)], &past_end, sizeof(past_end));
+    REQUIRE_THROWS_WITH(vt::tile_snapshot(protozero::data_view(corrupt), hash), "tile snapshot is corrupt");
+}
@@ -0,0 +1,141 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/stitch.hpp>
+#include <protozero/pbf_writer.hpp>
+
+#include <catch.hpp>
+
+#include <optional>
+
+namespace vt = mapbox::vector_tile;
+
+struct test_line {
+    std::optional<std::uint64_t> id;
+    std::uint32_t value;
+    std::vector<std::pair<std::int32_t, std::int32_t>> points;
+};
+
+// A "trails" layer with a "name" key and the values "a" and "b".
+static std::string build_trails_tile(std::vector<test_line> const& lines) {
+    std::string data;
+    protozero::pbf_writer tile(data);
+    {
+        protozero::pbf_writer layer(tile, vt::TileType::LAYERS);
+        layer.add_uint32(vt::LayerType::VERSION, 2);
+        layer.add_string(vt::LayerType::NAME, "trails");
+        for (auto const& line : lines) {
+            protozero::pbf_writer feature(layer, vt::LayerType::FEATURES);
+            if (line.id) {
+                feature.add_uint64(vt::FeatureType::ID, *line.id);
+            }
+            const std::vector<std::uint32_t> tags = { 0, line.value };
+            feature.add_packed_uint32(vt::FeatureType::TAGS, tags.begin(), tags.end());
+            feature.add_enum(vt::FeatureType::TYPE, vt::GeomType::LINESTRING);
+            std::vector<std::uint32_t> geometry;
+            std::int32_t x = 0;
+            std::int32_t y = 0;
+            for (std::size_t i = 0; i < line.points.size(); ++i) {
+                if (i < 2) {
+                    geometry.push_back(((i == 0 ? 1 : static_cast<std::uint32_t>(line.points.size() - 1)) << 3) |
+                                       (i == 0 ? vt::CommandType::MOVE_TO : vt::CommandType::LINE_TO));
+                }
+                geometry.push_back(protozero::encode_zigzag32(line.points[i].first - x));
+                geometry.push_back(protozero::encode_zigzag32(line.points[i].second - y));
+                x = line.points[i].first;
+                y = line.points[i].second;
+            }
+            feature.add_packed_uint32(vt::FeatureType::GEOMETRY, geometry.begin(), geometry.end());
+        }
+        layer.add_string(vt::LayerType::KEYS, "name");
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "a");
+        }
+        {
+            protozero::pbf_writer value(layer, vt::LayerType::VALUES);
+            value.add_string(vt::ValueType::STRING, "b");
+        }
+        layer.add_uint32(vt::LayerType::EXTENT, 4096);
+    }
+    return data;
+}
+
+TEST_CASE( "Stitch lines cut at tile boundaries" ) {
+    // Trail 1 crosses three tiles, its middle piece is stored reversed. Trail
+    // 2 has other properties and touches trail 1 on the first tile edge.
+    const std::string tile0 = build_trails_tile({
+        { 1, 0, { { 100, 100 }, { 4096, 200 } } },
+        { 1, 1, { { 4000, 4000 }, { 4096, 200 } } } });
+    const std::string tile1 = build_trails_tile({
+        { 1, 0, { { 4096, 300 }, { 2000, 250 }, { 0, 200 } } } });
+    const std::string tile2 = build_trails_tile({
+        { 1, 0, { { 0, 300 }, { 500, 500 } } },
+        { 1, 0, { { 1000, 1000 }, { 1500, 1500 } } } });
+
+    vt::line_stitcher stitcher;
+    stitcher.addLayer(vt::buffer(tile0).getLayer("trails"), 0, 0);
+    stitcher.addLayer(vt::buffer(tile1).getLayer("trails"), 1, 0);
+    stitcher.addLayer(vt::buffer(tile2).getLayer("trails"), 2, 0);
+    stitcher.stitch();
+
+    REQUIRE(stitcher.getGroups().size() == 2);
+    auto const& lines = stitcher.getLines();
+    REQUIRE(lines.size() == 3);
+
+    using point = vt::line_stitcher::point_type;
+    auto const trail = stitcher.getPoints(lines[0]);
+    REQUIRE(std::vector<point>(trail.begin(), trail.end()) == std::vector<point>({
+        { 100, 100 }, { 4096, 200 }, { 6096, 250 }, { 8192, 300 }, { 8692, 500 } }));
+    CHECK(std::get<std::string>(stitcher.getGroups()[lines[0].group].properties.at("name")) == "a");
+
+    CHECK(lines[1].group != lines[0].group);
+    CHECK(lines[1].size == 2);
+    CHECK(lines[2].group == lines[0].group);
+    CHECK(lines[2].size == 2);
+}
+
+TEST_CASE( "Stitch lines of tiles encoded with a buffer" ) {
+    // The trail runs from (100, 100) to (6096, 250) in world coordinates,
+    // both tiles hold it up to 64 units beyond their edge. Trail 2 only
+    // lies in the buffer of the first tile.
+    const std::string tile0 = build_trails_tile({
+        { 1, 0, { { 100, 100 }, { 4160, 202 } } },
+        { 2, 1, { { 4110, 10 }, { 4150, 50 } } } });
+    const std::string tile1 = build_trails_tile({
+        { 1, 0, { { -64, 198 }, { 2000, 250 } } } });
+
+    vt::line_stitcher stitcher(64);
+    stitcher.addLayer(vt::buffer(tile0).getLayer("trails"), 0, 0);
+    stitcher.addLayer(vt::buffer(tile1).getLayer("trails"), 1, 0);
+    stitcher.stitch();
+
+    auto const& lines = stitcher.getLines();
+    REQUIRE(lines.size() == 1);
+    using point = vt::line_stitcher::point_type;
+    auto const trail = stitcher.getPoints(lines[0]);
+    REQUIRE(std::vector<point>(trail.begin(), trail.end()) == std::vector<point>({
+        { 100, 100 }, { 4096, 200 }, { 6096, 250 } }));
+
+    // Without the buffer size the repeated parts overlap and are not joined.
+    vt::line_stitcher unbuffered;
+    unbuffered.addLayer(vt::buffer(tile0).getLayer("trails"), 0, 0);
+    unbuffered.addLayer(vt::buffer(tile1).getLayer("trails"), 1, 0);
+    unbuffered.stitch();
+    CHECK(unbuffered.getLines().size() == 3);
+}
+
+TEST_CASE( "Stitch lines of features without ids" ) {
+    const std::string tile0 = build_trails_tile({ { std::nullopt, 0, { { 100, 100 }, { 4096, 200 } } } });
+    const std::string tile1 = build_trails_tile({ { std::nullopt, 0, { { 0, 200 }, { 2000, 250 } } } });
+
+    vt::line_stitcher stitcher;
+    const vt::buffer buffer0(tile0);
+    const vt::buffer buffer1(tile1);
+    stitcher.addLayer(buffer0.getLayer("trails"), 0, 0);
+    stitcher.addLayer(buffer1.getLayer("trails"), 1, 0);
+    stitcher.stitch();
+
+    REQUIRE(stitcher.getGroups().size() == 1);
+    CHECK(std::holds_alternative<mapbox::feature::null_value_t>(stitcher.getGroups()[0].id));
+    REQUIRE(stitcher.getLines().size() == 1);
+    CHECK(stitcher.getLines()[0].size == 3);
+}
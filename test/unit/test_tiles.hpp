@@ -0,0 +1,57 @@
+#pragma once
+
+#include <mapbox/geometry.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Tiles shared by the unit tests.
+
+// A point layer with an id and a "name" property per feature.
+inline std::string build_points_tile(std::string const& layer_name, std::size_t features) {
+    mapbox::vector_tile::tile_builder builder;
+    auto& layer = builder.addLayer(layer_name);
+    for (std::size_t i = 0; i < features; ++i) {
+        mapbox::vector_tile::feature_builder feature(layer);
+        feature.setId(i);
+        feature.addProperty("name", "feature " + std::to_string(i));
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>{ static_cast<std::int32_t>(i), 5 });
+        feature.commit();
+    }
+    return builder.serialize();
+}
+
+// A version 2 "roads" layer with an extent of 8192 and three streets with
+// ids 7 to 9, followed by an "areas" layer with a polygon with a hole and
+// a multipoint without properties.
+inline std::string build_roads_tile() {
+    mapbox::vector_tile::tile_builder builder;
+    auto& roads = builder.addLayer("roads", 8192, 2);
+    for (std::int32_t i = 0; i < 3; ++i) {
+        mapbox::vector_tile::feature_builder feature(roads);
+        feature.setId(std::uint64_t(7 + i));
+        feature.addProperty("name", "street " + std::to_string(i));
+        feature.addProperty("lanes", std::uint64_t(i + 1));
+        feature.addProperty("oneway", i == 0);
+        feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { 0, i }, { 10, i }, { 10, i + 20 } });
+        feature.commit();
+    }
+    auto& areas = builder.addLayer("areas");
+    {
+        mapbox::vector_tile::feature_builder feature(areas);
+        feature.addProperty("height", -3.5);
+        feature.addProperty("level", std::int64_t(-2));
+        feature.setGeometry(mapbox::geometry::polygon<std::int32_t>{
+            { { 0, 0 }, { 100, 0 }, { 100, 100 }, { 0, 100 }, { 0, 0 } },
+            { { 10, 10 }, { 10, 20 }, { 20, 20 }, { 20, 10 }, { 10, 10 } } });
+        feature.commit();
+    }
+    {
+        mapbox::vector_tile::feature_builder feature(areas);
+        feature.setGeometry(mapbox::geometry::multi_point<std::int32_t>{ { 1, 2 }, { 3, 4 } });
+        feature.commit();
+    }
+    return builder.serialize();
+}
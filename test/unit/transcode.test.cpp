@@ -0,0 +1,242 @@
+#include <mapbox/vector_tile.hpp>
+#include <mapbox/vector_tile/builder.hpp>
+#include <mapbox/vector_tile/transcode.hpp>
+#include <protozero/pbf_writer.hpp>
+
+#include <catch.hpp>
+
+namespace vt = mapbox::vector_tile;
+
+static std::string build_source_tile() {
+    vt::tile_builder builder;
+    auto& peaks = builder.addLayer("peaks");
+    for (std::uint64_t i = 0; i < 3; ++i) {
+        vt::feature_builder feature(peaks);
+        feature.setId(i);
+        feature.addProperty("ele", std::uint64_t(3000 + i));
+        feature.addProperty("name", "peak " + std::to_string(i));
+        feature.addProperty("source", "survey");
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(static_cast<std::int32_t>(i), 7));
+        feature.commit();
+    }
+    {
+        vt::feature_builder feature(peaks);
+        feature.addProperty("name", "unnamed");
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(100, 100));
+        feature.commit();
+    }
+    auto& water = builder.addLayer("water");
+    {
+        vt::feature_builder feature(water);
+        feature.addProperty("class", "lake");
+        feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { 0, 0 }, { 5, 5 } });
+        feature.commit();
+    }
+    return builder.serialize();
+}
+
+TEST_CASE( "Transcode drops layers and keys" ) {
+    const std::string source = build_source_tile();
+    vt::transcode_options options;
+    options.layers = { "peaks" };
+    options.keys["peaks"] = { "name" };
+    std::string output;
+    vt::transcode(source, options, output);
+    REQUIRE(output.size() < source.size());
+
+    vt::buffer tile(output);
+    REQUIRE(tile.layerNames() == std::vector<std::string>({ "peaks" }));
+    auto const layer = tile.getLayer("peaks");
+    REQUIRE(layer.featureCount() == 4);
+    auto const stats = layer.statistics();
+    REQUIRE(stats.keys.size() == 1);
+    CHECK(stats.keys[0].key == "name");
+    CHECK(stats.keys[0].distinctValues == 4);
+    for (std::size_t i = 0; i < 3; ++i) {
+        auto const feature = vt::feature(layer.getFeature(i), layer);
+        CHECK(std::get<std::uint64_t>(feature.getID()) == i);
+        auto const properties = feature.getProperties();
+        REQUIRE(properties.size() == 1);
+        CHECK(std::get<std::string>(properties.at("name")) == "peak " + std::to_string(i));
+        auto const geom = feature.getGeometries<vt::points_arrays_type>(1.0);
+        CHECK(geom[0][0].x == static_cast<std::int16_t>(i));
+        CHECK(geom[0][0].y == 7);
+    }
+}
+
+TEST_CASE( "Transcode copies untouched layers byte for byte" ) {
+    const std::string source = build_source_tile();
+    vt::transcode_options options;
+    options.keys["peaks"] = { "ele", "name", "source" };
+    std::string output;
+    vt::transcode(source, options, output);
+    CHECK(output == source);
+}
+
+TEST_CASE( "Merge tiles with shared layers" ) {
+    const std::string base = build_source_tile();
+    vt::tile_builder overlay_builder;
+    auto& huts = overlay_builder.addLayer("huts");
+    {
+        vt::feature_builder feature(huts);
+        feature.addProperty("name", "Erzherzog-Johann-Hütte");
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(50, 60));
+        feature.commit();
+    }
+    auto& peaks = overlay_builder.addLayer("peaks");
+    {
+        vt::feature_builder feature(peaks);
+        feature.setId(42);
+        feature.addProperty("source", "survey");
+        feature.addProperty("prominence", std::uint64_t(2424));
+        feature.addProperty("name", "peak 1");
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(9, 9));
+        feature.commit();
+    }
+    const std::string overlay = overlay_builder.serialize();
+
+    std::string output;
+    vt::mergeTiles({ base, overlay }, output);
+    vt::buffer tile(output);
+    REQUIRE(tile.layerNames() == std::vector<std::string>({ "huts", "peaks", "water" }));
+    CHECK(tile.getLayer("huts").featureCount() == 1);
+    CHECK(tile.getLayer("water").featureCount() == 1);
+
+    auto const layer = tile.getLayer("peaks");
+    REQUIRE(layer.featureCount() == 5);
+    auto const stats = layer.statistics();
+    REQUIRE(stats.keys.size() == 4);
+    CHECK(stats.keys[3].key == "prominence");
+    // "peak 1" and "survey" are shared by both tiles.
+    CHECK(stats.keys[1].distinctValues == 4);
+    CHECK(stats.keys[2].distinctValues == 1);
+
+    auto const original = vt::feature(layer.getFeature(1), layer);
+    CHECK(std::get<std::uint64_t>(original.getValue("ele")) == 3001);
+    CHECK(std::get<std::string>(original.getValue("name")) == "peak 1");
+    auto const merged = vt::feature(layer.getFeature(4), layer);
+    CHECK(std::get<std::uint64_t>(merged.getID()) == 42);
+    CHECK(std::get<std::uint64_t>(merged.getValue("prominence")) == 2424);
+    CHECK(std::get<std::string>(merged.getValue("name")) == "peak 1");
+    CHECK(std::get<std::string>(merged.getValue("source")) == "survey");
+    auto const geom = merged.getGeometries<vt::points_arrays_type>(1.0);
+    CHECK(geom[0][0].x == 9);
+}
+
+TEST_CASE( "Requantize layers to a smaller extent" ) {
+    using point = mapbox::geometry::point<std::int32_t>;
+    vt::tile_builder builder;
+    auto& shapes = builder.addLayer("shapes", 4096);
+    {
+        vt::feature_builder feature(shapes);
+        feature.setId(1);
+        feature.addProperty("kind", "line");
+        feature.setGeometry(mapbox::geometry::line_string<std::int32_t>{ { 0, 0 }, { 3, 0 }, { 4000, 4000 } });
+        feature.commit();
+    }
+    {
+        // Collapses to a single point and is dropped.
+        vt::feature_builder feature(shapes);
+        mapbox::geometry::polygon<std::int32_t> polygon;
+        polygon.push_back({ { 100, 100 }, { 103, 100 }, { 103, 103 }, { 100, 103 } });
+        feature.setGeometry(polygon);
+        feature.commit();
+    }
+    {
+        // The hole collapses, the exterior ring survives.
+        vt::feature_builder feature(shapes);
+        mapbox::geometry::polygon<std::int32_t> polygon;
+        polygon.push_back({ { 0, 0 }, { 800, 0 }, { 800, 800 }, { 0, 800 } });
+        polygon.push_back({ { 200, 200 }, { 200, 202 }, { 202, 202 } });
+        feature.setGeometry(polygon);
+        feature.commit();
+    }
+    {
+        vt::feature_builder feature(shapes);
+        feature.setGeometry(mapbox::geometry::multi_point<std::int32_t>{ point(8, 8), point(9, 9), point(80, 80) });
+        feature.commit();
+    }
+    auto& labels = builder.addLayer("labels", 512);
+    {
+        vt::feature_builder feature(labels);
+        feature.setGeometry(point(1, 2));
+        feature.commit();
+    }
+    const std::string source = builder.serialize();
+
+    std::string output;
+    vt::requantizeTile(source, 512, output);
+    REQUIRE(output.size() < source.size());
+    vt::buffer tile(output);
+    auto const layer = tile.getLayer("shapes");
+    REQUIRE(layer.getExtent() == 512);
+    REQUIRE(layer.featureCount() == 3);
+
+    auto const line = vt::feature(layer.getFeature(0), layer);
+    CHECK(std::get<std::uint64_t>(line.getID()) == 1);
+    CHECK(std::get<std::string>(line.getValue("kind")) == "line");
+    auto const line_geom = line.getGeometries<vt::points_arrays_type>(1.0);
+    REQUIRE(line_geom.size() == 1);
+    REQUIRE(line_geom[0].size() == 2);
+    CHECK(line_geom[0][1].x == 500);
+
+    auto const polygon = vt::feature(layer.getFeature(1), layer);
+    CHECK(polygon.getType() == vt::GeomType::POLYGON);
+    auto const polygon_geom = polygon.getGeometries<vt::points_arrays_type>(1.0);
+    REQUIRE(polygon_geom.size() == 1);
+    CHECK(polygon_geom[0][2].x == 100);
+
+    auto const points = vt::feature(layer.getFeature(2), layer);
+    CHECK(points.getGeometries<vt::points_arrays_type>(1.0).size() == 2);
+
+    CHECK(tile.getLayer("labels").getExtent() == 512);
+
+    // A layer with an extent of 0 cannot be rescaled.
+    std::string zero_extent;
+    {
+        protozero::pbf_writer tile_writer(zero_extent);
+        protozero::pbf_writer layer_writer(tile_writer, vt::TileType::LAYERS);
+        layer_writer.add_uint32(vt::LayerType::VERSION, 2);
+        layer_writer.add_string(vt::LayerType::NAME, "flat");
+        layer_writer.add_uint32(vt::LayerType::EXTENT, 0);
+    }
+    output.clear();
+    REQUIRE_THROWS_WITH(vt::requantizeTile(zero_extent, 512, output), "layer extent must be positive");
+}
+
+TEST_CASE( "Optimize layout by reference frequency and Hilbert order" ) {
+    // 150 distinct rarely used values come first in the value table, the
+    // frequently used "path" value would need two byte indices.
+    vt::tile_builder builder;
+    auto& trails = builder.addLayer("trails");
+    for (std::int32_t i = 0; i < 150; ++i) {
+        vt::feature_builder feature(trails);
+        feature.addProperty("ref", std::int64_t(i));
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(4000 - i * 20, 4000 - i * 20));
+        feature.commit();
+    }
+    for (std::int32_t i = 0; i < 200; ++i) {
+        vt::feature_builder feature(trails);
+        feature.addProperty("class", "path");
+        feature.setGeometry(mapbox::geometry::point<std::int32_t>(i * 20, 10));
+        feature.commit();
+    }
+    const std::string source = builder.serialize();
+
+    std::string output;
+    const auto saved = vt::optimizeLayout(source, output);
+    CHECK(saved > 0);
+    CHECK(static_cast<std::ptrdiff_t>(source.size()) - saved == static_cast<std::ptrdiff_t>(output.size()));
+
+    vt::buffer tile(output);
+    auto const layer = tile.getLayer("trails");
+    REQUIRE(layer.featureCount() == 350);
+    auto const stats = layer.statistics();
+    REQUIRE(stats.keys.size() == 2);
+    CHECK(stats.keys[0].key == "class");
+    CHECK(stats.keys[0].featureCount == 200);
+    CHECK(stats.keys[1].distinctValues == 150);
+    auto const first = vt::feature(layer.getFeature(0), layer);
+    CHECK(first.getGeometries<vt::points_arrays_type>(1.0)[0][0].x == 0);
+    CHECK(std::get<std::string>(first.getValue("class")) == "path");
+}